@@ -0,0 +1,65 @@
+#include "audio-ring.h"
+#include <string.h>
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void copy_in(AudioRing *ring, size_t position, const int16_t *samples, size_t count);
+static void copy_out(const AudioRing *ring, size_t position, int16_t *out, size_t count);
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+void audio_ring_init(AudioRing *ring, int16_t *samples, size_t capacity) {
+    ring->samples = samples;
+    ring->capacity = capacity;
+    atomic_init(&ring->write_position, 0);
+    atomic_init(&ring->read_position, 0);
+}
+
+size_t audio_ring_write(AudioRing *ring, const int16_t *samples, size_t count) {
+    size_t write_position = atomic_load_explicit(&ring->write_position, memory_order_relaxed);
+    size_t read_position = atomic_load_explicit(&ring->read_position, memory_order_acquire);
+
+    size_t space = ring->capacity - (write_position - read_position);
+    if (count > space) {
+        count = space;
+    }
+
+    copy_in(ring, write_position, samples, count);
+    atomic_store_explicit(&ring->write_position, write_position + count, memory_order_release);
+    return count;
+}
+
+size_t audio_ring_read(AudioRing *ring, int16_t *out, size_t count) {
+    size_t read_position = atomic_load_explicit(&ring->read_position, memory_order_relaxed);
+    size_t write_position = atomic_load_explicit(&ring->write_position, memory_order_acquire);
+
+    size_t fill = write_position - read_position;
+    if (count > fill) {
+        count = fill;
+    }
+
+    copy_out(ring, read_position, out, count);
+    atomic_store_explicit(&ring->read_position, read_position + count, memory_order_release);
+    return count;
+}
+
+size_t audio_ring_fill(AudioRing *ring) {
+    size_t read_position = atomic_load_explicit(&ring->read_position, memory_order_acquire);
+    size_t write_position = atomic_load_explicit(&ring->write_position, memory_order_acquire);
+    return write_position - read_position;
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// The samples wrap around the end of the buffer at most once
+static void copy_in(AudioRing *ring, size_t position, const int16_t *samples, size_t count) {
+    size_t start = position & (ring->capacity - 1);
+    size_t first = ring->capacity - start < count ? ring->capacity - start : count;
+    memcpy(ring->samples + start, samples, first * sizeof(int16_t));
+    memcpy(ring->samples, samples + first, (count - first) * sizeof(int16_t));
+}
+
+static void copy_out(const AudioRing *ring, size_t position, int16_t *out, size_t count) {
+    size_t start = position & (ring->capacity - 1);
+    size_t first = ring->capacity - start < count ? ring->capacity - start : count;
+    memcpy(out, ring->samples + start, first * sizeof(int16_t));
+    memcpy(out + first, ring->samples, (count - first) * sizeof(int16_t));
+}
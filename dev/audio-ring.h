@@ -0,0 +1,48 @@
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *  Lock-free ring buffer of audio samples with a single producer (the emulation thread) and a single
+ *  consumer (the audio callback). Neither side ever waits for the other: the producer drops the samples
+ *  that don't fit, and the consumer gets fewer samples than it asked for.
+ *
+ *  The positions count all samples ever written and read, so the fill level is their difference.
+ *  Each one is only stored by its own side, with release order, so that the other side sees the
+ *  samples before the position that publishes them.
+ */
+typedef struct AudioRing {
+    int16_t *samples;
+    size_t capacity; // power of two
+    atomic_size_t write_position;
+    atomic_size_t read_position;
+} AudioRing;
+
+/**
+ *  Sets up an empty ring on `samples`. `capacity` has to be a power of two.
+ *
+ */
+void audio_ring_init(AudioRing *ring, int16_t *samples, size_t capacity);
+
+/**
+ *  Appends up to `count` samples. Returns the number of samples written, the rest is dropped.
+ *  Must only be called by the producer.
+ */
+size_t audio_ring_write(AudioRing *ring, const int16_t *samples, size_t count);
+
+/**
+ *  Takes up to `count` samples out of the ring. Returns the number of samples read.
+ *  Must only be called by the consumer.
+ */
+size_t audio_ring_read(AudioRing *ring, int16_t *out, size_t count);
+
+/**
+ *  Returns the number of samples in the ring. Can be called from both sides.
+ *
+ */
+size_t audio_ring_fill(AudioRing *ring);
+
+#endif
@@ -4,15 +4,24 @@
 #include "emulator.h"
 #include "mem.h"
 #include "opcodes.h"
-#include "util.h"
 #include <assert.h>
 
+#ifndef HEADLESS
 extern SDLInstance SDL_INSTANCE;
 extern WindowRegion NES_SCREEN;
 extern WindowRegion DEBUG_SCREEN;
+#endif
 
 #define ADDRESS_MODE_COLUMN_WIDTH 28
 
+// clang-format off
+static const char *opcode_name_lookup[] = {
+#define X(op) #op,
+    OPCODE_LIST(X)
+#undef X
+};
+// clang-format on
+
 static int is_illegal(uint8_t byte) {
     Instruction instruction = instruction_lookup[byte];
     return (instruction.opcode >= 56) ||                  // Illegal operand
@@ -155,9 +164,9 @@ static void log_address_mode_info(const CPU *cpu, Instruction instruction) {
     }
 }
 
-void debug_log_instruction(const CPU *cpu) {
+// Prints the address, bytes, name and operand of the instruction at cpu->pc
+static void log_disassembly(const CPU *cpu) {
     const MEM *mem = &cpu->emulator->mem;
-    const PPU *ppu = &cpu->emulator->ppu;
     uint8_t byte0 = mem_const_read_8(mem, cpu->pc);
     uint8_t byte1 = mem_const_read_8(mem, cpu->pc + 1);
     uint8_t byte2 = mem_const_read_8(mem, cpu->pc + 2);
@@ -190,6 +199,24 @@ void debug_log_instruction(const CPU *cpu) {
     printf("%s ", opcode_name_lookup[instruction.opcode]);
 
     log_address_mode_info(cpu, instruction);
+}
+
+#ifdef HOTSPOT_PROFILER
+// Executed instructions and consumed cycles per address
+static uint32_t hotspot_instructions[0x10000];
+static uint64_t hotspot_cycles[0x10000];
+
+static int compare_hotspots(const void *a, const void *b) {
+    uint64_t cycles_a = hotspot_cycles[*(const uint32_t *)a];
+    uint64_t cycles_b = hotspot_cycles[*(const uint32_t *)b];
+    return (cycles_a < cycles_b) - (cycles_a > cycles_b); // descending
+}
+#endif
+
+void debug_log_instruction(const CPU *cpu) {
+    const PPU *ppu = &cpu->emulator->ppu;
+
+    log_disassembly(cpu);
 
     // Print the state of the CPU before the instruction is executed
     printf("A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3li,%3li CYC:%lu", cpu->ac, cpu->x, cpu->y, cpu->sr, cpu->sp,
@@ -200,6 +227,46 @@ void debug_log_instruction(const CPU *cpu) {
     printf("\n");
 }
 
+#ifdef HOTSPOT_PROFILER
+void debug_hotspot_record(uint16_t pc, size_t instructions, size_t cycles) {
+    hotspot_instructions[pc] += instructions;
+    hotspot_cycles[pc] += cycles;
+}
+
+void debug_hotspot_report(const CPU *cpu) {
+    static uint32_t addresses[0x10000];
+    uint32_t address_count = 0;
+    uint64_t total_cycles = 0;
+    for (uint32_t pc = 0; pc < 0x10000; pc++) {
+        if (hotspot_instructions[pc] > 0) {
+            addresses[address_count++] = pc;
+            total_cycles += hotspot_cycles[pc];
+        }
+    }
+    if (total_cycles == 0)
+        return;
+    qsort(addresses, address_count, sizeof(addresses[0]), compare_hotspots);
+
+    printf("\nHOTSPOTS (%u addresses, %llu cycles)\n", address_count, (unsigned long long)total_cycles);
+    printf("  CYCLES      %%   CUM%%  INSTRUCTIONS  INSTRUCTION\n");
+
+    // The operands are disassembled with the CPU state at the time of the report,
+    // so indexed addresses and the values at them are the current ones
+    CPU snapshot = *cpu;
+    uint64_t cumulative_cycles = 0;
+    for (uint32_t i = 0; i < address_count && i < HOTSPOT_REPORT_LINES; i++) {
+        uint16_t pc = addresses[i];
+        cumulative_cycles += hotspot_cycles[pc];
+        printf("%8llu %6.2f %6.2f  %12u  ", (unsigned long long)hotspot_cycles[pc],
+               100.0 * hotspot_cycles[pc] / total_cycles, 100.0 * cumulative_cycles / total_cycles,
+               hotspot_instructions[pc]);
+        snapshot.pc = pc;
+        log_disassembly(&snapshot);
+        printf("\n");
+    }
+}
+#endif
+
 void debug_memory_dump(const MEM *mem, uint16_t start, uint16_t len) {
     for (int i = 0; i < len; i++) {
         if (i % 8 == 0) {
@@ -237,6 +304,7 @@ void debug_memory_dump_ascii(const MEM *mem, uint16_t start, uint16_t len) {
     printf("\n");
 }
 
+#ifndef HEADLESS
 static uint32_t get_color(uint8_t color_index) {
     switch (color_index) {
     case 1: return 0x555555;
@@ -246,86 +314,209 @@ static uint32_t get_color(uint8_t color_index) {
     }
 }
 
-static void draw_tile(const Emulator *emulator, uint16_t base_address, int tile_index, int left_coord, int top_coord) {
-    assert(base_address == 0x0000 || base_address == 0x1000);
-
-    const PPU *ppu = &emulator->ppu;
-
-    // Calculate the address of the tile in VRAM
-    uint16_t tile_address = base_address + (tile_index * TILE_BYTE_SIZE);
-
+// Where the views are on the debug screen
+#define PATTERN_TABLES_TOP 0
+#define NAMETABLES_TOP 128
+#define PALETTE_TOP 608
+#define PALETTE_SWATCH_WIDTH 8
+#define PALETTE_SWATCH_HEIGHT 16
+#define SPRITES_LEFT 128
+#define SPRITES_TOP 608
+#define SPRITES_PER_ROW 16
+#define SPRITE_CELL_HEIGHT 16 // room for 8x16 sprites
+
+// What the debug screen shows right now. Every draw only redraws what differs from it.
+static DebugSnapshot drawn;
+static int drawn_valid = FALSE;
+
+// Tiles whose pattern differs from `drawn`, so that everything showing them is redrawn
+static uint8_t tile_changed[DEBUG_TILE_COUNT];
+
+static void draw_tile(const DebugSnapshot *snapshot, int pattern_table, int tile_index, int left_coord,
+                      int top_coord) {
+    assert(pattern_table == 0 || pattern_table == 1);
+
+    const int TILES_PER_TABLE = PATTERN_TABLE_WIDTH * PATTERN_TABLE_HEIGHT;
+    const uint16_t *rows = snapshot->pattern_rows[pattern_table * TILES_PER_TABLE + tile_index];
     for (int y = 0; y < TILE_HEIGHT; y++) {
-        uint8_t low_byte = ppu_const_read_vram_data(ppu, tile_address + y);
-        uint8_t high_byte = ppu_const_read_vram_data(ppu, tile_address + y + 8);
-        for (int x = 0; x < TILE_HEIGHT; x++) {
-            uint8_t low_bit = (low_byte >> (7 - x)) & 0x1;
-            uint8_t high_bit = (high_byte >> (7 - x)) & 0x1;
-            uint8_t color_index = (high_bit << 1) | low_bit;
+        uint16_t row = rows[y];
+        for (int x = 0; x < TILE_WIDTH; x++) {
+            uint8_t color_index = (row >> (14 - 2 * x)) & 0x3;
             uint32_t rgb_color = get_color(color_index);
             sdl_put_pixel_region(&DEBUG_SCREEN, left_coord + x, top_coord + y, rgb_color);
         }
     }
 }
 
-static void draw_pattern_table(const Emulator *emulator, uint16_t base_address, int left_coord, int top_coord) {
+static void draw_pattern_table(const DebugSnapshot *snapshot, int pattern_table, int left_coord, int top_coord,
+                               int redraw_all) {
     const int TILE_COUNT = PATTERN_TABLE_WIDTH * PATTERN_TABLE_HEIGHT;
     for (int tile_index = 0; tile_index < TILE_COUNT; tile_index++) {
+        if (!redraw_all && !tile_changed[pattern_table * TILE_COUNT + tile_index])
+            continue;
+
         int tile_x = tile_index % PATTERN_TABLE_WIDTH;
         int tile_y = tile_index / PATTERN_TABLE_WIDTH;
         int tile_left_coord = left_coord + tile_x * TILE_WIDTH;
         int tile_top_coord = top_coord + tile_y * TILE_HEIGHT;
-        draw_tile(emulator, base_address, tile_index, tile_left_coord, tile_top_coord);
+        draw_tile(snapshot, pattern_table, tile_index, tile_left_coord, tile_top_coord);
     }
 }
 
-static void draw_nametable(const Emulator *emulator, uint16_t base_address, int left_coord, int top_coord) {
-    assert(base_address == 0x2000 || base_address == 0x2400 || base_address == 0x2800 || base_address == 0x2C00);
+static void draw_nametable(const DebugSnapshot *snapshot, int nametable, int left_coord, int top_coord,
+                           int redraw_all) {
+    assert(nametable == 0 || nametable == 1);
 
-    const PPU *ppu = &emulator->ppu;
-    const uint16_t PATTERN_TABLE_BG_BASE_ADDRESS = ppu->ctrl.pattern_background ? 0x1000 : 0x0000;
+    // exclude the attribute table
+    const int TILE_COUNT = NAMETABLE_BYTE_SIZE - ATTRIBUTE_TABLE_BYTE_SIZE;
+    const int TILES_PER_TABLE = PATTERN_TABLE_WIDTH * PATTERN_TABLE_HEIGHT;
+    const uint8_t *tiles = snapshot->nametables[nametable];
+    const uint8_t *drawn_tiles = drawn.nametables[nametable];
 
-    // calculate end_address, exclude the attribute table
-    uint16_t end_address = base_address + NAMETABLE_BYTE_SIZE - ATTRIBUTE_TABLE_BYTE_SIZE;
+    for (int nametable_index = 0; nametable_index < TILE_COUNT; nametable_index++) {
+        // the nametable says what tile to draw
+        uint8_t tile_index = tiles[nametable_index];
+        if (!redraw_all && tile_index == drawn_tiles[nametable_index] &&
+            !tile_changed[snapshot->pattern_background * TILES_PER_TABLE + tile_index])
+            continue;
 
-    for (uint16_t address = base_address; address < end_address; address++) {
-        int nametable_index = address - base_address;
         int tile_x = nametable_index % NAMETABLE_WIDTH;
         int tile_y = nametable_index / NAMETABLE_WIDTH;
         int tile_left_coord = left_coord + tile_x * TILE_WIDTH;
         int tile_top_coord = top_coord + tile_y * TILE_HEIGHT;
 
-        // read VRAM to get what tile to draw
-        uint8_t tile_index = ppu_const_read_vram_data(ppu, address);
-
         // draw that tile
-        draw_tile(emulator, PATTERN_TABLE_BG_BASE_ADDRESS, tile_index, tile_left_coord, tile_top_coord);
+        draw_tile(snapshot, snapshot->pattern_background, tile_index, tile_left_coord, tile_top_coord);
+    }
+}
+
+// Palette memory as two rows of 16 swatches, the background palettes on top of the sprite palettes
+static void draw_palette(const DebugSnapshot *snapshot, int left_coord, int top_coord, int redraw_all) {
+    for (int i = 0; i < DEBUG_PALETTE_SIZE; i++) {
+        if (!redraw_all && snapshot->palette[i] == drawn.palette[i])
+            continue;
+
+        int swatch_left_coord = left_coord + (i % 16) * PALETTE_SWATCH_WIDTH;
+        int swatch_top_coord = top_coord + (i / 16) * PALETTE_SWATCH_HEIGHT;
+        for (int y = 0; y < PALETTE_SWATCH_HEIGHT; y++) {
+            for (int x = 0; x < PALETTE_SWATCH_WIDTH; x++) {
+                sdl_put_pixel_region(&DEBUG_SCREEN, swatch_left_coord + x, swatch_top_coord + y, snapshot->palette[i]);
+            }
+        }
+    }
+}
+
+// Returns the index in pattern_rows of the top (half 0) or bottom (half 1) tile of an 8x16 sprite,
+// or of the tile of an 8x8 sprite
+static int sprite_tile(const DebugSnapshot *snapshot, uint8_t tile_index, int half) {
+    const int TILES_PER_TABLE = PATTERN_TABLE_WIDTH * PATTERN_TABLE_HEIGHT;
+    if (snapshot->sprite_height == TILE_HEIGHT)
+        return snapshot->pattern_sprite * TILES_PER_TABLE + tile_index;
+    return (tile_index & 0x01) * TILES_PER_TABLE + (tile_index & 0xFE) + half;
+}
+
+// Draws a sprite of OAM with its palette and flips, pixel value 0 is drawn black
+static void draw_sprite(const DebugSnapshot *snapshot, int sprite, int left_coord, int top_coord) {
+    const uint8_t *entry = &snapshot->oam[sprite * 4];
+    uint8_t tile_index = entry[1];
+    uint8_t attributes = entry[2];
+    const uint32_t *colors = &snapshot->palette[0x10 + 4 * (attributes & 0x03)];
+    int height = snapshot->sprite_height;
+
+    for (int y = 0; y < SPRITE_CELL_HEIGHT; y++) {
+        int sprite_y = attributes & 0x80 ? height - 1 - y : y;
+        uint16_t row = 0;
+        if (y < height) {
+            int tile = sprite_tile(snapshot, tile_index, sprite_y / TILE_HEIGHT);
+            row = snapshot->pattern_rows[tile][sprite_y % TILE_HEIGHT];
+        }
+
+        for (int x = 0; x < TILE_WIDTH; x++) {
+            int sprite_x = attributes & 0x40 ? TILE_WIDTH - 1 - x : x;
+            uint8_t pixel = (row >> (14 - 2 * sprite_x)) & 0x3;
+            sdl_put_pixel_region(&DEBUG_SCREEN, left_coord + x, top_coord + y, pixel ? colors[pixel] : 0x000000);
+        }
+    }
+}
+
+// All 64 sprites of OAM in OAM order, SPRITES_PER_ROW to a row
+static void draw_sprites(const DebugSnapshot *snapshot, int left_coord, int top_coord, int redraw_all) {
+    // The sprite size, pattern table and palettes apply to all sprites
+    redraw_all = redraw_all || snapshot->sprite_height != drawn.sprite_height ||
+                 snapshot->pattern_sprite != drawn.pattern_sprite ||
+                 memcmp(&snapshot->palette[0x10], &drawn.palette[0x10], 0x10 * sizeof(uint32_t)) != 0;
+
+    for (int sprite = 0; sprite < DEBUG_SPRITE_COUNT; sprite++) {
+        uint8_t tile_index = snapshot->oam[sprite * 4 + 1];
+        int changed = redraw_all || memcmp(&snapshot->oam[sprite * 4], &drawn.oam[sprite * 4], 4) != 0 ||
+                      tile_changed[sprite_tile(snapshot, tile_index, 0)] ||
+                      (snapshot->sprite_height > TILE_HEIGHT && tile_changed[sprite_tile(snapshot, tile_index, 1)]);
+        if (!changed)
+            continue;
+
+        int cell_left_coord = left_coord + (sprite % SPRITES_PER_ROW) * TILE_WIDTH;
+        int cell_top_coord = top_coord + (sprite / SPRITES_PER_ROW) * SPRITE_CELL_HEIGHT;
+        draw_sprite(snapshot, sprite, cell_left_coord, cell_top_coord);
     }
 }
 
-void debug_draw_screen(const Emulator *emulator) {
-    const Mapper *mapper = &emulator->mapper;
+void debug_take_snapshot(const Emulator *emulator, DebugSnapshot *snapshot) {
+    const PPU *ppu = &emulator->ppu;
+
+    // The tile cache is filled lazily, which is the only thing that changes here
+    Mapper *mapper = (Mapper *)&emulator->mapper;
+    for (int tile_index = 0; tile_index < DEBUG_TILE_COUNT; tile_index++) {
+        const ChrTile *tile = mapper_get_tile(mapper, tile_index * TILE_BYTE_SIZE);
+        memcpy(snapshot->pattern_rows[tile_index], tile->rows, sizeof(snapshot->pattern_rows[tile_index]));
+    }
 
-    // for (int i = 0; i < NES_SCREEN_WIDTH; i++)
-    //     for (int j = 0; j < NES_SCREEN_HEIGHT; j++)
-    //         sdl_put_pixel_region(&NES_SCREEN, i, j, 0xFFFFFF);
+    // The first nametable, and the one next to it in the direction the game scrolls
+    uint16_t nametable_base_address_2 = mapper->mirroring == HORIZONTAL ? 0x2800 : 0x2400;
+    for (int i = 0; i < NAMETABLE_BYTE_SIZE; i++) {
+        snapshot->nametables[0][i] = ppu_const_read_vram_data(ppu, 0x2000 + i);
+        snapshot->nametables[1][i] = ppu_const_read_vram_data(ppu, nametable_base_address_2 + i);
+    }
 
-    draw_pattern_table(emulator, 0x0000, 0, 0);
-    draw_pattern_table(emulator, 0x1000, 128, 0);
-    draw_nametable(emulator, 0x2000, 0, 128);
+    snapshot->pattern_background = ppu->ctrl.pattern_background ? 1 : 0;
+    snapshot->pattern_sprite = ppu->ctrl.pattern_sprite ? 1 : 0;
+    snapshot->sprite_height = ppu->ctrl.sprite_size ? 2 * TILE_HEIGHT : TILE_HEIGHT;
+    memcpy(snapshot->oam, ppu->oam, sizeof(snapshot->oam));
 
-    uint16_t nametable_base_address_1 = 0x2000;
-    uint16_t nametable_base_address_2 = 0x2400;
-    if (mapper->mirroring == HORIZONTAL)
-        nametable_base_address_2 = 0x2800;
+    // The colors as they are drawn, with grayscale and the color emphasis applied
+    uint32_t rgb_palette[0x40];
+    ppu_build_rgb_palette(ppu, rgb_palette);
+    for (int i = 0; i < DEBUG_PALETTE_SIZE; i++) {
+        snapshot->palette[i] = rgb_palette[ppu->palette_colors[i]];
+    }
+}
 
-    draw_nametable(emulator, nametable_base_address_1, 0, 128);
-    draw_nametable(emulator, nametable_base_address_2, 0, 368);
+void debug_draw_screen(const DebugSnapshot *snapshot) {
+    int redraw_all = !drawn_valid;
+    for (int tile_index = 0; tile_index < DEBUG_TILE_COUNT; tile_index++) {
+        tile_changed[tile_index] = memcmp(snapshot->pattern_rows[tile_index], drawn.pattern_rows[tile_index],
+                                          sizeof(drawn.pattern_rows[0])) != 0;
+    }
+    // Switching the pattern table of the background changes every tile of the nametables
+    int redraw_nametables = redraw_all || snapshot->pattern_background != drawn.pattern_background;
+
+    draw_pattern_table(snapshot, 0, 0, PATTERN_TABLES_TOP, redraw_all);
+    draw_pattern_table(snapshot, 1, 128, PATTERN_TABLES_TOP, redraw_all);
+    draw_nametable(snapshot, 0, 0, NAMETABLES_TOP, redraw_nametables);
+    draw_nametable(snapshot, 1, 0, NAMETABLES_TOP + NAMETABLE_HEIGHT * TILE_HEIGHT, redraw_nametables);
+    draw_palette(snapshot, 0, PALETTE_TOP, redraw_all);
+    draw_sprites(snapshot, SPRITES_LEFT, SPRITES_TOP, redraw_all);
+
+    drawn = *snapshot;
+    drawn_valid = TRUE;
 }
 
 void debug_pause_screen(Emulator *emulator) {
+    static DebugSnapshot snapshot;
+    debug_take_snapshot(emulator, &snapshot);
     while (1) {
         sdl_draw_frame();
-        debug_draw_screen(emulator);
+        debug_draw_screen(&snapshot);
         SDL_Delay(100);
     }
-}
\ No newline at end of file
+}
+#endif // HEADLESS
@@ -1,7 +1,9 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#ifndef HEADLESS
 #include "sdl-instance.h"
+#endif
 
 // forward declarations
 typedef struct Emulator Emulator;
@@ -17,6 +19,25 @@ typedef struct MEM MEM;
  */
 void debug_log_instruction(const CPU *cpu);
 
+#ifdef HOTSPOT_PROFILER
+#define HOTSPOT_REPORT_LINES 100
+
+/**
+ *  Counts `instructions` executed instructions at `pc` that consumed `cycles` cycles,
+ *  including the interrupt and OAM DMA cycles that were spent before or after them.
+ *  Skipped idle loops are counted as a whole at the start of the loop.
+ *
+ */
+void debug_hotspot_record(uint16_t pc, size_t instructions, size_t cycles);
+
+/**
+ *  Prints the HOTSPOT_REPORT_LINES addresses that consumed the most cycles, with their
+ *  share of all cycles, their instruction counts and their disassembly.
+ *
+ */
+void debug_hotspot_report(const CPU *cpu);
+#endif
+
 /**
  *  Dumps a region of cpu memory to the console.
  *
@@ -29,16 +50,43 @@ void debug_memory_dump(const MEM *mem, uint16_t start, uint16_t len);
  */
 void debug_memory_dump_ascii(const MEM *mem, uint16_t start, uint16_t len);
 
+#ifndef HEADLESS
+#define DEBUG_TILE_COUNT (0x2000 / TILE_BYTE_SIZE) // tiles in both pattern tables
+#define DEBUG_PALETTE_SIZE 0x20                    // entries of palette memory
+#define DEBUG_SPRITE_COUNT 64                      // sprites in OAM
+
+/**
+ *  What the debug screen shows, copied out of the emulator at the end of a frame, so that the
+ *  render thread can draw it while the emulation runs on.
+ */
+typedef struct DebugSnapshot {
+    uint16_t pattern_rows[DEBUG_TILE_COUNT][TILE_HEIGHT]; // both pattern tables, packed like ChrTile.rows
+    uint8_t nametables[2][NAMETABLE_BYTE_SIZE];            // the two that are shown, see debug_take_snapshot
+    uint8_t pattern_background;                            // the pattern table of the background, 0 or 1
+    uint8_t pattern_sprite;                                // the pattern table of 8x8 sprites, 0 or 1
+    uint8_t sprite_height;                                 // 8 or 16
+    uint8_t oam[4 * DEBUG_SPRITE_COUNT];
+    uint32_t palette[DEBUG_PALETTE_SIZE]; // RGB color of every entry of palette memory, as it is drawn
+} DebugSnapshot;
+
 /**
- *  Draws the DEBUG_SCREEN window region to the SDL window.
+ *  Copies what the debug screen shows into `snapshot`. Has to be called on the emulation thread.
  *
  */
-void debug_draw_screen(const Emulator *emulator);
+void debug_take_snapshot(const Emulator *emulator, DebugSnapshot *snapshot);
+
+/**
+ *  Draws the DEBUG_SCREEN window region of the SDL window from a snapshot: the pattern tables, two
+ *  nametables, palette memory and the sprites of OAM. Only the tiles, swatches and sprites that changed
+ *  since the last snapshot it drew are redrawn, so it is cheap enough to call every frame.
+ */
+void debug_draw_screen(const DebugSnapshot *snapshot);
 
 /**
  *  Freezes the frame, so that you can inspect the rendering at that point.
- *
+ *  Only works on the thread that owns the window.
  */
 void debug_pause_screen(Emulator *emulator);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "render-thread.h"
+
+#define EVENT_POLL_INTERVAL_MS 5 // the events are polled at least this often while no frames come in
+
+typedef struct RenderThread {
+    TripleBuffer buffer;
+    RenderFrame frames[3];
+    SDL_sem *frame_published; // posted by the emulation thread for every frame
+    SDL_sem *frame_presented; // posted by the render thread for every frame, only wakes the emulation thread up
+    atomic_uint presented;    // number of the last frame presented
+    uint32_t published;       // number of the last frame published, only touched by the emulation thread
+    atomic_int emulation_done;
+
+    SDL_ThreadFunction emulate;
+    void *emulate_data;
+} RenderThread;
+
+static RenderThread render_thread;
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static int run_emulation(void *data);
+static void present_frame(const RenderFrame *frame);
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+int render_thread_run(SDL_ThreadFunction emulate, void *data) {
+    triple_buffer_init(&render_thread.buffer);
+    atomic_init(&render_thread.emulation_done, 0);
+    atomic_init(&render_thread.presented, 0);
+    render_thread.published = 0;
+    render_thread.emulate = emulate;
+    render_thread.emulate_data = data;
+    render_thread.frame_published = SDL_CreateSemaphore(0);
+    render_thread.frame_presented = SDL_CreateSemaphore(0);
+    if (render_thread.frame_published == NULL || render_thread.frame_presented == NULL) {
+        printf("Fatal Error: Failed to create the render semaphores! SDL_Error: %s\n", SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
+
+    SDL_Thread *thread = SDL_CreateThread(run_emulation, "emulation", NULL);
+    if (thread == NULL) {
+        printf("Fatal Error: Failed to start the emulation thread! SDL_Error: %s\n", SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
+
+    char title[RENDER_TITLE_SIZE] = SDL_WINDOW_TITLE;
+    while (!atomic_load(&render_thread.emulation_done)) {
+        sdl_poll_events();
+        SDL_SemWaitTimeout(render_thread.frame_published, EVENT_POLL_INTERVAL_MS);
+        if (!triple_buffer_acquire(&render_thread.buffer))
+            continue;
+
+        const RenderFrame *frame = &render_thread.frames[triple_buffer_front(&render_thread.buffer)];
+        if (strcmp(title, frame->title) != 0) {
+            strcpy(title, frame->title);
+            sdl_set_window_title(title);
+        }
+        present_frame(frame);
+        atomic_store(&render_thread.presented, frame->number);
+        SDL_SemPost(render_thread.frame_presented);
+    }
+
+    int result;
+    SDL_WaitThread(thread, &result);
+    SDL_DestroySemaphore(render_thread.frame_published);
+    SDL_DestroySemaphore(render_thread.frame_presented);
+    return result;
+}
+
+RenderFrame *render_thread_back_frame() { return &render_thread.frames[triple_buffer_back(&render_thread.buffer)]; }
+
+void render_thread_publish() {
+    render_thread_back_frame()->number = ++render_thread.published;
+    triple_buffer_publish(&render_thread.buffer);
+    SDL_SemPost(render_thread.frame_published);
+}
+
+// The semaphore can hold posts for frames that weren't waited for (e.g. while fast-forwarding, or after a
+// timeout), so only the number of the presented frame counts. Dropped frames are never presented, newer ones are.
+int render_thread_wait_presented(uint32_t timeout_ms) {
+    uint32_t deadline = SDL_GetTicks() + timeout_ms;
+    while ((int32_t)(atomic_load(&render_thread.presented) - render_thread.published) < 0) {
+        int32_t remaining_ms = (int32_t)(deadline - SDL_GetTicks());
+        if (remaining_ms <= 0 || SDL_SemWaitTimeout(render_thread.frame_presented, (uint32_t)remaining_ms) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+static int run_emulation(void *data) {
+    (void)data;
+    int result = render_thread.emulate(render_thread.emulate_data);
+
+    // Wakes the render thread up, so it doesn't wait for another frame
+    atomic_store(&render_thread.emulation_done, 1);
+    SDL_SemPost(render_thread.frame_published);
+    return result;
+}
+
+static void present_frame(const RenderFrame *frame) {
+    debug_draw_screen(&frame->debug);
+    sdl_put_nes_frame(frame->framebuffer, frame->palette);
+    sdl_draw_frame();
+}
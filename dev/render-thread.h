@@ -0,0 +1,44 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include "common.h"
+#include "debug.h"
+#include "sdl-instance.h"
+#include "triple-buffer.h"
+
+#define RENDER_TITLE_SIZE 256
+
+/**
+ *  Everything the render thread needs to show one emulated frame, so it never has to look at the emulator.
+ *
+ */
+typedef struct RenderFrame {
+    uint8_t framebuffer[NES_SCREEN_WIDTH * NES_SCREEN_HEIGHT]; // NES color indices, see sdl_put_nes_frame()
+    uint32_t palette[0x40];
+    DebugSnapshot debug;
+    char title[RENDER_TITLE_SIZE]; // of the window
+    uint32_t number;               // counts the published frames, set by render_thread_publish()
+} RenderFrame;
+
+/**
+ *  Splits the SDL build into an emulation thread and a render thread, so that the emulation never waits
+ *  for the GPU driver or the vertical blank.
+ *
+ *  The render thread is the main thread, since it owns the window: it polls the events, takes the newest
+ *  frame the emulation published, converts and uploads it, updates the debug screen from the snapshot in it,
+ *  and presents, which blocks on vsync if that is on. The frames go through a triple buffer (see
+ *  triple-buffer.h), so publishing one is a copy and an atomic exchange, and frames that come faster than
+ *  the display shows them are dropped.
+ *
+ *  render_thread_run() starts `emulate` on the emulation thread and renders until it returns, and returns
+ *  what it returned. The functions below are for the emulation thread: render_thread_back_frame() returns
+ *  the frame to fill, render_thread_publish() hands it to the render thread. render_thread_wait_presented()
+ *  waits until the render thread presented the frame published last (or a newer one), which is how vsync
+ *  paces the emulation. It returns 0 after `timeout_ms` without it, e.g. when the window is hidden.
+ */
+int render_thread_run(SDL_ThreadFunction emulate, void *data);
+RenderFrame *render_thread_back_frame();
+void render_thread_publish();
+int render_thread_wait_presented(uint32_t timeout_ms);
+
+#endif
@@ -12,6 +12,9 @@ SDLInstance SDL_INSTANCE;
 #define DEBUG_SCREEN_WIDTH 256
 #define DEBUG_SCREEN_HEIGHT SDL_WINDOW_HEIGHT
 
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void audio_callback(void *userdata, uint8_t *stream, int length);
+
 WindowRegion NES_SCREEN = {
     .top_coord = 0,
     .left_coord = 0,
@@ -28,7 +31,7 @@ WindowRegion DEBUG_SCREEN = {
     .scale_factor = DEBUG_SCREEN_SCALE_FACTOR,
 };
 
-int sdl_instance_init() {
+int sdl_instance_init(int vsync) {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
         return -1;
@@ -41,7 +44,8 @@ int sdl_instance_init() {
         return -1;
     }
 
-    SDL_INSTANCE.renderer = SDL_CreateRenderer(SDL_INSTANCE.window, -1, SDL_RENDERER_ACCELERATED);
+    uint32_t renderer_flags = SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+    SDL_INSTANCE.renderer = SDL_CreateRenderer(SDL_INSTANCE.window, -1, renderer_flags);
     if (!SDL_INSTANCE.renderer) {
         printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
         SDL_DestroyWindow(SDL_INSTANCE.window);
@@ -51,6 +55,9 @@ int sdl_instance_init() {
     SDL_INSTANCE.texture = SDL_CreateTexture(SDL_INSTANCE.renderer, SDL_PIXELFORMAT_ARGB8888,
                                              SDL_TEXTUREACCESS_STREAMING, SDL_WINDOW_WIDTH, SDL_WINDOW_HEIGHT);
 
+    SDL_INSTANCE.nes_texture = SDL_CreateTexture(SDL_INSTANCE.renderer, SDL_PIXELFORMAT_ARGB8888,
+                                                 SDL_TEXTUREACCESS_STREAMING, NES_SCREEN_WIDTH, NES_SCREEN_HEIGHT);
+
     SDL_INSTANCE.title = SDL_WINDOW_TITLE;
     SDL_INSTANCE.pixel_buffer = (uint32_t *)malloc(SDL_WINDOW_WIDTH * SDL_WINDOW_HEIGHT * sizeof(uint32_t));
     SDL_INSTANCE.width = SDL_WINDOW_WIDTH;
@@ -71,10 +78,34 @@ void sdl_put_pixel(uint32_t x, uint32_t y, uint32_t color) {
     }
 }
 
+// The framebuffer has one NES color index per pixel, and is NES_SCREEN_WIDTH pixels wide.
+// Only the top NES_SCREEN_HEIGHT lines are shown.
+void sdl_put_nes_frame(const uint8_t *framebuffer, const uint32_t *palette) {
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(SDL_INSTANCE.nes_texture, NULL, &pixels, &pitch) < 0) {
+        printf("NES texture could not be locked! SDL_Error: %s\n", SDL_GetError());
+        return;
+    }
+
+    for (int y = 0; y < NES_SCREEN_HEIGHT; y++) {
+        uint32_t *row = (uint32_t *)((uint8_t *)pixels + y * pitch);
+        const uint8_t *indices = framebuffer + y * NES_SCREEN_WIDTH;
+        for (int x = 0; x < NES_SCREEN_WIDTH; x++) {
+            row[x] = palette[indices[x]];
+        }
+    }
+
+    SDL_UnlockTexture(SDL_INSTANCE.nes_texture);
+}
+
 void sdl_draw_frame() {
+    SDL_Rect nes_screen_rect = {NES_SCREEN.left_coord, NES_SCREEN.top_coord, NES_SCREEN.width, NES_SCREEN.height};
+
     SDL_UpdateTexture(SDL_INSTANCE.texture, NULL, SDL_INSTANCE.pixel_buffer, SDL_INSTANCE.width * sizeof(uint32_t));
     SDL_RenderClear(SDL_INSTANCE.renderer);
     SDL_RenderCopy(SDL_INSTANCE.renderer, SDL_INSTANCE.texture, NULL, NULL);
+    SDL_RenderCopy(SDL_INSTANCE.renderer, SDL_INSTANCE.nes_texture, NULL, &nes_screen_rect);
     SDL_RenderPresent(SDL_INSTANCE.renderer);
 }
 
@@ -94,6 +125,9 @@ uint8_t sdl_poll_events() {
     uint8_t event = 0;
 
     while (SDL_PollEvent(&sdl_event)) {
+        if (sdl_event.type == SDL_QUIT) {
+            atomic_store(&SDL_INSTANCE.quit_requested, 1);
+        }
     }
 
     const uint8_t *state = SDL_GetKeyboardState(NULL);
@@ -121,25 +155,77 @@ uint8_t sdl_poll_events() {
     if (state[SDL_SCANCODE_RIGHT]) {
         event |= NES_DPAD_RIGHT;
     }
+    atomic_store(&SDL_INSTANCE.rewind_held, state[SDL_SCANCODE_BACKSPACE]);
+    atomic_store(&SDL_INSTANCE.fast_forward_held, state[SDL_SCANCODE_TAB]);
+    atomic_store(&SDL_INSTANCE.buttons, event);
 
     return event;
 }
-void sdl_set_window_title(const char *title) { SDL_SetWindowTitle(SDL_INSTANCE.window, title); }
 
-int sdl_window_quit() {
-    SDL_Event sdl_event;
+uint8_t sdl_buttons() { return atomic_load(&SDL_INSTANCE.buttons); }
 
-    while (SDL_PollEvent(&sdl_event)) {
-        if (sdl_event.type == SDL_QUIT) {
-            return 1;
-        }
+int sdl_rewind_held() { return atomic_load(&SDL_INSTANCE.rewind_held); }
+
+int sdl_fast_forward_held() { return atomic_load(&SDL_INSTANCE.fast_forward_held); }
+
+int sdl_audio_init(int sample_rate) {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        printf("Error: SDL audio could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return -1;
     }
-    return 0;
+
+    audio_ring_init(&SDL_INSTANCE.audio_ring, SDL_INSTANCE.audio_samples, SDL_AUDIO_RING_SIZE);
+    SDL_INSTANCE.last_sample = 0;
+
+    SDL_AudioSpec desired = {0}, obtained;
+    desired.freq = sample_rate;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = SDL_AUDIO_CALLBACK_SAMPLES;
+    desired.callback = audio_callback;
+
+    // Only the sample rate may differ, the APU synthesizes at whatever rate the device plays at
+    SDL_INSTANCE.audio_device =
+        SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (SDL_INSTANCE.audio_device == 0) {
+        printf("Error: Audio device could not be opened! SDL_Error: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    SDL_PauseAudioDevice(SDL_INSTANCE.audio_device, 0);
+    return obtained.freq;
 }
 
+void sdl_queue_audio(const int16_t *samples, size_t count) {
+    if (SDL_INSTANCE.audio_device == 0)
+        return;
+    audio_ring_write(&SDL_INSTANCE.audio_ring, samples, count);
+}
+
+size_t sdl_audio_buffered() {
+    if (SDL_INSTANCE.audio_device == 0)
+        return 0;
+    return audio_ring_fill(&SDL_INSTANCE.audio_ring);
+}
+
+int sdl_display_refresh_rate() {
+    SDL_DisplayMode mode;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(SDL_INSTANCE.window), &mode) < 0)
+        return 0;
+    return mode.refresh_rate;
+}
+
+void sdl_set_window_title(const char *title) { SDL_SetWindowTitle(SDL_INSTANCE.window, title); }
+
+int sdl_window_quit() { return atomic_load(&SDL_INSTANCE.quit_requested); }
+
 void sdl_instance_destroy() {
+    if (SDL_INSTANCE.audio_device)
+        SDL_CloseAudioDevice(SDL_INSTANCE.audio_device);
     if (SDL_INSTANCE.pixel_buffer)
         free(SDL_INSTANCE.pixel_buffer);
+    if (SDL_INSTANCE.nes_texture)
+        SDL_DestroyTexture(SDL_INSTANCE.nes_texture);
     if (SDL_INSTANCE.texture)
         SDL_DestroyTexture(SDL_INSTANCE.texture);
     if (SDL_INSTANCE.renderer)
@@ -167,4 +253,18 @@ void sdl_put_pixel_region(WindowRegion *window_region, int relative_x, int relat
     }
 }
 
-void sdl_put_pixel_nes_screen(int x, int y, uint32_t color) { sdl_put_pixel_region(&NES_SCREEN, x, y, color); }
+// Runs on the audio thread. When the emulation falls behind, the last sample is held instead of
+// playing silence, which would click.
+static void audio_callback(void *userdata, uint8_t *stream, int length) {
+    (void)userdata;
+    int16_t *out = (int16_t *)stream;
+    size_t count = length / sizeof(int16_t);
+
+    size_t read = audio_ring_read(&SDL_INSTANCE.audio_ring, out, count);
+    if (read > 0) {
+        SDL_INSTANCE.last_sample = out[read - 1];
+    }
+    for (size_t i = read; i < count; i++) {
+        out[i] = SDL_INSTANCE.last_sample;
+    }
+}
@@ -1,7 +1,9 @@
 #ifndef SDL_INSTANCE_H
 #define SDL_INSTANCE_H
 
+#include "audio-ring.h"
 #include <SDL2/SDL.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
 // SDL window properties
@@ -9,31 +11,66 @@
 #define SDL_WINDOW_HEIGHT 672
 #define SDL_WINDOW_TITLE "NES Emulator"
 
+// SDL audio properties
+#define SDL_AUDIO_SAMPLE_RATE 44100
+#define SDL_AUDIO_CALLBACK_SAMPLES 512 // samples the callback asks for at a time
+#define SDL_AUDIO_RING_SIZE 8192       // samples, power of two, a little under 0.2 s at 44.1 kHz
+
 typedef struct SDLInstance {
     SDL_Window *window;
     SDL_Renderer *renderer;
     SDL_Texture *texture;
+    SDL_Texture *nes_texture; // NES screen at native resolution, scaled by the renderer
     uint32_t *pixel_buffer;
     int width;
     int height;
     const char *title;
+
+    // Updated by sdl_poll_events() on the thread that owns the window, read by the emulation thread
+    atomic_uchar buttons;
+    atomic_uchar rewind_held;
+    atomic_uchar fast_forward_held;
+    atomic_uchar quit_requested;
+
+    SDL_AudioDeviceID audio_device; // 0 if audio couldn't be opened
+    AudioRing audio_ring;           // samples from the emulation thread to the audio callback
+    int16_t audio_samples[SDL_AUDIO_RING_SIZE];
+    int16_t last_sample; // repeated by the callback when the ring runs dry, only touched by the callback
 } SDLInstance;
 
 /**
  *  sdl_instance_init() has to be called before any other function.
- *     It sets up the window, renderer, texture and pixel_buffer.
+ *     It sets up the window, renderer, texture and pixel_buffer. With `vsync` set,
+ *     sdl_draw_frame() waits for the vertical blank of the display.
  *  sdl_clear_screen() sets all values in pixel_buffer to 0x00000000.
  *  sdl_put_pixel() can be used to set the value of a single pixel in
- *  pixel_buffer. sdl_draw_frame() renders the pixel_buffer to the window using
- *  the GPU. sdl_poll_events() checks if the user has pressed a key or requested
- *  to quit the window. sdl_instance_destroy() needs to be called when quitting
- *  the window, to avoid memory leaks.
+ *  pixel_buffer. sdl_put_nes_frame() converts a frame from the PPU into the
+ *  NES screen texture. sdl_draw_frame() renders the pixel_buffer and the NES
+ *  screen to the window using the GPU. sdl_poll_events() checks if the user has pressed a key or requested
+ *  to quit the window, and returns the NES buttons held. It has to be called on the thread that created the
+ *  window, the getters for what it saw can be called from any thread: sdl_buttons() returns the NES buttons
+ *  held, sdl_rewind_held() if the rewind key (backspace) was held, sdl_fast_forward_held() the same for the
+ *  fast-forward key (tab), and sdl_window_quit() if the window was closed. sdl_audio_init() opens the audio
+ *  device and returns the sample rate it plays at,
+ *  or -1 if there is no audio. sdl_queue_audio() hands samples to the audio callback without ever
+ *  blocking, samples that don't fit in the ring are dropped. sdl_audio_buffered() returns the number of
+ *  samples that are queued but not yet played. sdl_display_refresh_rate() returns the refresh rate of the
+ *  display the window is on, or 0 if it is unknown. sdl_instance_destroy() needs to be called
+ *  when quitting the window, to avoid memory leaks.
  */
-int sdl_instance_init();
+int sdl_instance_init(int vsync);
 void sdl_clear_screen();
 void sdl_put_pixel(uint32_t x, uint32_t y, uint32_t color);
+void sdl_put_nes_frame(const uint8_t *framebuffer, const uint32_t *palette);
 void sdl_draw_frame();
 uint8_t sdl_poll_events();
+uint8_t sdl_buttons();
+int sdl_rewind_held();
+int sdl_fast_forward_held();
+int sdl_audio_init(int sample_rate);
+void sdl_queue_audio(const int16_t *samples, size_t count);
+size_t sdl_audio_buffered();
+int sdl_display_refresh_rate();
 void sdl_set_window_title(const char *title);
 int sdl_window_quit();
 void sdl_instance_destroy();
@@ -77,10 +114,4 @@ typedef struct WindowRegion {
  */
 void sdl_put_pixel_region(WindowRegion *window_region, int relative_x, int relative_y, uint32_t color);
 
-/**
- *  Puts a pixel in the NES_SCREEN window region. Is called by the PPU
- *
- */
-void sdl_put_pixel_nes_screen(int x, int y, uint32_t color);
-
 #endif
@@ -0,0 +1,32 @@
+#include "triple-buffer.h"
+
+#define SLOT_MASK 0x3
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+void triple_buffer_init(TripleBuffer *buffer) {
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+unsigned triple_buffer_back(const TripleBuffer *buffer) { return buffer->back; }
+
+// Release, so that the reader sees the contents of the slot; acquire, so that the reader is done with the one
+// that comes back
+void triple_buffer_publish(TripleBuffer *buffer) {
+    unsigned middle = atomic_exchange_explicit(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH,
+                                               memory_order_acq_rel);
+    buffer->back = middle & SLOT_MASK;
+}
+
+int triple_buffer_acquire(TripleBuffer *buffer) {
+    // Only the reader clears the flag, so it can't disappear between the check and the exchange
+    if (!(atomic_load_explicit(&buffer->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH))
+        return 0;
+
+    unsigned middle = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+    buffer->front = middle & SLOT_MASK;
+    return 1;
+}
+
+unsigned triple_buffer_front(const TripleBuffer *buffer) { return buffer->front; }
@@ -0,0 +1,56 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <stdatomic.h>
+
+/**
+ *  Lock-free hand-off of the newest of a stream of values from one writer thread to one reader thread,
+ *  through three slots that are allocated by the user and indexed 0 - 2.
+ *
+ *  The writer fills its back slot and publishes it, the reader takes the newest published slot as its front
+ *  slot. The third slot is in the middle, between the two. Publishing and taking each swap a slot with the
+ *  middle one in a single atomic exchange, so neither side ever waits for the other: the writer can publish
+ *  as often as it likes, and values the reader didn't get to in time are overwritten.
+ *
+ *  `middle` holds the index of the middle slot, plus TRIPLE_BUFFER_FRESH while it has been published but not
+ *  taken yet. `back` is only touched by the writer, `front` only by the reader.
+ */
+typedef struct TripleBuffer {
+    atomic_uint middle;
+    unsigned back;
+    unsigned front;
+} TripleBuffer;
+
+#define TRIPLE_BUFFER_FRESH 0x4
+
+/**
+ *  Sets up the slots, with nothing published yet.
+ *
+ */
+void triple_buffer_init(TripleBuffer *buffer);
+
+/**
+ *  Returns the index of the slot the writer fills next. Must only be called by the writer.
+ *
+ */
+unsigned triple_buffer_back(const TripleBuffer *buffer);
+
+/**
+ *  Hands the back slot to the reader and takes a new one. Must only be called by the writer.
+ *
+ */
+void triple_buffer_publish(TripleBuffer *buffer);
+
+/**
+ *  Takes the newest published slot as the front slot, if one was published since the last call.
+ *  Returns 1 if the front slot changed, 0 otherwise. Must only be called by the reader.
+ */
+int triple_buffer_acquire(TripleBuffer *buffer);
+
+/**
+ *  Returns the index of the slot the reader took last. Must only be called by the reader.
+ *
+ */
+unsigned triple_buffer_front(const TripleBuffer *buffer);
+
+#endif
@@ -17,3 +17,18 @@ void vga_screen_put_pixel(uint32_t x, uint32_t y, uint8_t c) {
     uint32_t i = y * VGA_SCREEN_WIDTH + x;
     VGA[i] = c;
 }
+
+void vga_screen_draw_frame(const uint8_t *frame, uint32_t width, uint32_t height, const uint8_t *palette) {
+    if (width > VGA_SCREEN_WIDTH)
+        width = VGA_SCREEN_WIDTH;
+    if (height > VGA_SCREEN_HEIGHT)
+        height = VGA_SCREEN_HEIGHT;
+
+    for (uint32_t y = 0; y < height; y++) {
+        volatile uint8_t *row = VGA + y * VGA_SCREEN_WIDTH;
+        const uint8_t *indices = frame + y * width;
+        for (uint32_t x = 0; x < width; x++) {
+            row[x] = palette[indices[x]];
+        }
+    }
+}
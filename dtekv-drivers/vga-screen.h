@@ -11,4 +11,8 @@ void vga_screen_clear();
 
 void vga_screen_put_pixel(uint32_t x, uint32_t y, uint8_t c);
 
+// Ritar en hel bild (t.ex. PPU:ns framebuffer) i övre vänstra hörnet.
+// Varje pixel är ett index i `palette`.
+void vga_screen_draw_frame(const uint8_t *frame, uint32_t width, uint32_t height, const uint8_t *palette);
+
 #endif
\ No newline at end of file
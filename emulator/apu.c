@@ -0,0 +1,735 @@
+#include "apu.h"
+#include "emulator.h"
+#include "savestate.h"
+
+// Weights of the channels in the mix, the linear approximation of the mixer
+// src: https://www.nesdev.org/wiki/APU_Mixer
+#define PULSE_WEIGHT 271    // 0.00752
+#define TRIANGLE_WEIGHT 306 // 0.00851
+#define NOISE_WEIGHT 178    // 0.00494
+#define DMC_WEIGHT 121      // 0.00335
+
+#define CHANNEL_DMC 0x10 // bit of the DMC in the status register, the others are 0x01 << channel
+
+// clang-format off
+static const uint8_t length_table[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const uint8_t duty_table[4][8] = {
+    {0, 1, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0},
+    {1, 0, 0, 1, 1, 1, 1, 1},
+};
+
+static const uint8_t triangle_sequence[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+// In CPU cycles (NTSC)
+static const uint16_t noise_periods[16] = {4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068};
+static const uint16_t dmc_periods[16] = {428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54};
+
+// CPU cycles of the frame counter steps from the start of the sequence, followed by the length of the sequence
+static const uint16_t frame_steps[2][6] = {
+    {7457, 14913, 22371, 29829, 29830},        // 4-step
+    {7457, 14913, 22371, 29829, 37281, 37282}, // 5-step
+};
+// clang-format on
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void run(APU *apu, size_t end);
+static void run_pulse(APU *apu, Pulse *pulse, size_t end);
+static void run_triangle(APU *apu, size_t end);
+static void run_noise(APU *apu, size_t end);
+static void run_dmc(APU *apu, size_t end);
+static void fetch_dmc_sample(APU *apu);
+static void restart_dmc_sample(DMC *dmc);
+static void update_output(APU *apu, int32_t *output, int32_t amplitude, size_t cycle);
+static void clock_frame_counter(APU *apu);
+static void clock_quarter_frame(APU *apu);
+static void clock_half_frame(APU *apu);
+static void clock_envelope(Envelope *envelope);
+static void clock_sweep(Pulse *pulse, uint8_t ones_complement);
+static uint16_t sweep_target(const Pulse *pulse, uint8_t ones_complement);
+static uint8_t pulse_volume(const Pulse *pulse, uint8_t ones_complement);
+static uint8_t envelope_volume(const Envelope *envelope);
+static void write_envelope(Envelope *envelope, uint8_t value);
+static void load_length(APU *apu, uint8_t *length, uint8_t channel, uint8_t value);
+static void set_frame_irq(APU *apu, uint8_t value);
+static void set_dmc_irq(APU *apu, uint8_t value);
+static void schedule_irq(APU *apu);
+static void save_envelope(const Envelope *envelope, StateWriter *writer);
+static void load_envelope(Envelope *envelope, StateReader *reader);
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+void apu_init(Emulator *emulator) {
+    APU *apu = &emulator->apu;
+    memset(apu, 0, sizeof(*apu));
+    apu->emulator = emulator;
+
+    for (int i = 0; i < 2; i++) {
+        apu->pulse[i].timer = 2;
+    }
+    apu->triangle.timer = 1;
+    apu->noise.shift_register = 1;
+    apu->noise.timer = noise_periods[0];
+    apu->dmc.timer = dmc_periods[0];
+    apu->dmc.bits_remaining = 8;
+    apu->dmc.silence = TRUE;
+
+    // The frame counter starts as if 0x00 was written to 0x4017
+    apu->next_frame_cycle = frame_steps[0][0];
+    schedule_irq(apu);
+}
+
+void apu_catch_up(APU *apu) {
+    run(apu, apu->emulator->cpu.total_cycles);
+    schedule_irq(apu);
+}
+
+void apu_write_register(APU *apu, uint16_t address, uint8_t value) {
+    run(apu, apu->emulator->cpu.total_cycles);
+
+    Pulse *pulse = &apu->pulse[(address >> 2) & 0x01];
+    Triangle *triangle = &apu->triangle;
+    Noise *noise = &apu->noise;
+    DMC *dmc = &apu->dmc;
+
+    switch (address) {
+    // Pulse 1 and 2
+    case 0x4000:
+    case 0x4004:
+        pulse->duty = value >> 6;
+        write_envelope(&pulse->envelope, value);
+        break;
+    case 0x4001:
+    case 0x4005:
+        pulse->sweep_enabled = (value & 0x80) ? 1 : 0;
+        pulse->sweep_period = (value >> 4) & 0x07;
+        pulse->sweep_negate = (value & 0x08) ? 1 : 0;
+        pulse->sweep_shift = value & 0x07;
+        pulse->sweep_reload = TRUE;
+        break;
+    case 0x4002:
+    case 0x4006: pulse->period = (pulse->period & 0x0700) | value; break;
+    case 0x4003:
+    case 0x4007:
+        pulse->period = (pulse->period & 0x00FF) | ((value & 0x07) << 8);
+        load_length(apu, &pulse->length, (address >> 2) & 0x01, value);
+        pulse->phase = 0;
+        pulse->envelope.start = TRUE;
+        break;
+
+    // Triangle
+    case 0x4008:
+        triangle->control = (value & 0x80) ? 1 : 0;
+        triangle->linear_reload_value = value & 0x7F;
+        break;
+    case 0x400A: triangle->period = (triangle->period & 0x0700) | value; break;
+    case 0x400B:
+        triangle->period = (triangle->period & 0x00FF) | ((value & 0x07) << 8);
+        load_length(apu, &triangle->length, 2, value);
+        triangle->linear_reload = TRUE;
+        break;
+
+    // Noise
+    case 0x400C: write_envelope(&noise->envelope, value); break;
+    case 0x400E:
+        noise->mode = (value & 0x80) ? 1 : 0;
+        noise->period_index = value & 0x0F;
+        break;
+    case 0x400F:
+        load_length(apu, &noise->length, 3, value);
+        noise->envelope.start = TRUE;
+        break;
+
+    // DMC
+    case 0x4010:
+        dmc->irq_enabled = (value & 0x80) ? 1 : 0;
+        dmc->loop = (value & 0x40) ? 1 : 0;
+        dmc->rate_index = value & 0x0F;
+        if (!dmc->irq_enabled) {
+            set_dmc_irq(apu, FALSE);
+        }
+        break;
+    case 0x4011: dmc->level = value & 0x7F; break;
+    case 0x4012: dmc->sample_address = 0xC000 | (value << 6); break;
+    case 0x4013: dmc->sample_length = (value << 4) + 1; break;
+
+    // Status
+    case 0x4015:
+        apu->enabled = value & 0x1F;
+        apu->pulse[0].length = (value & 0x01) ? apu->pulse[0].length : 0;
+        apu->pulse[1].length = (value & 0x02) ? apu->pulse[1].length : 0;
+        triangle->length = (value & 0x04) ? triangle->length : 0;
+        noise->length = (value & 0x08) ? noise->length : 0;
+        if (!(value & CHANNEL_DMC)) {
+            dmc->bytes_remaining = 0;
+        } else if (dmc->bytes_remaining == 0) {
+            restart_dmc_sample(dmc);
+            fetch_dmc_sample(apu);
+        }
+        set_dmc_irq(apu, FALSE);
+        break;
+
+    // Frame counter, restarts the sequence
+    case 0x4017:
+        apu->frame_mode = (value & 0x80) ? 1 : 0;
+        apu->frame_irq_inhibit = (value & 0x40) ? 1 : 0;
+        if (apu->frame_irq_inhibit) {
+            set_frame_irq(apu, FALSE);
+        }
+        apu->frame_step = 0;
+        apu->frame_sequence_start = apu->cycle;
+        apu->next_frame_cycle = apu->cycle + frame_steps[apu->frame_mode][0];
+        if (apu->frame_mode) {
+            clock_quarter_frame(apu);
+            clock_half_frame(apu);
+        }
+        break;
+    }
+
+    schedule_irq(apu);
+}
+
+uint8_t apu_read_status(APU *apu) {
+    run(apu, apu->emulator->cpu.total_cycles);
+
+    uint8_t status = (apu->pulse[0].length > 0) | (apu->pulse[1].length > 0) << 1 |
+                     (apu->triangle.length > 0) << 2 | (apu->noise.length > 0) << 3 |
+                     (apu->dmc.bytes_remaining > 0) << 4 | apu->frame_irq << 6 | apu->dmc_irq << 7;
+    set_frame_irq(apu, FALSE);
+
+    schedule_irq(apu);
+    return status;
+}
+
+void apu_end_frame(APU *apu) {
+    apu_catch_up(apu);
+#ifndef RISC_V
+    if (apu->sample_rate) {
+        blip_end_frame(&apu->blip, apu->cycle - apu->frame_start);
+    }
+#endif
+    apu->frame_start = apu->cycle;
+}
+
+void apu_save_state(const APU *apu, StateWriter *writer) {
+    for (int i = 0; i < 2; i++) {
+        const Pulse *pulse = &apu->pulse[i];
+        state_write_8(writer, pulse->duty);
+        state_write_8(writer, pulse->phase);
+        state_write_16(writer, pulse->period);
+        state_write_32(writer, pulse->timer);
+        state_write_8(writer, pulse->length);
+        save_envelope(&pulse->envelope, writer);
+        state_write_8(writer, pulse->sweep_enabled);
+        state_write_8(writer, pulse->sweep_period);
+        state_write_8(writer, pulse->sweep_negate);
+        state_write_8(writer, pulse->sweep_shift);
+        state_write_8(writer, pulse->sweep_divider);
+        state_write_8(writer, pulse->sweep_reload);
+    }
+
+    const Triangle *triangle = &apu->triangle;
+    state_write_8(writer, triangle->phase);
+    state_write_16(writer, triangle->period);
+    state_write_32(writer, triangle->timer);
+    state_write_8(writer, triangle->length);
+    state_write_8(writer, triangle->control);
+    state_write_8(writer, triangle->linear_reload_value);
+    state_write_8(writer, triangle->linear_counter);
+    state_write_8(writer, triangle->linear_reload);
+
+    const Noise *noise = &apu->noise;
+    state_write_16(writer, noise->shift_register);
+    state_write_8(writer, noise->mode);
+    state_write_8(writer, noise->period_index);
+    state_write_32(writer, noise->timer);
+    state_write_8(writer, noise->length);
+    save_envelope(&noise->envelope, writer);
+
+    const DMC *dmc = &apu->dmc;
+    state_write_8(writer, dmc->irq_enabled);
+    state_write_8(writer, dmc->loop);
+    state_write_8(writer, dmc->rate_index);
+    state_write_32(writer, dmc->timer);
+    state_write_8(writer, dmc->level);
+    state_write_16(writer, dmc->sample_address);
+    state_write_16(writer, dmc->sample_length);
+    state_write_16(writer, dmc->address);
+    state_write_16(writer, dmc->bytes_remaining);
+    state_write_8(writer, dmc->buffer);
+    state_write_8(writer, dmc->buffer_full);
+    state_write_8(writer, dmc->shift_register);
+    state_write_8(writer, dmc->bits_remaining);
+    state_write_8(writer, dmc->silence);
+
+    state_write_8(writer, apu->enabled);
+    state_write_8(writer, apu->frame_mode);
+    state_write_8(writer, apu->frame_irq_inhibit);
+    state_write_8(writer, apu->frame_irq);
+    state_write_8(writer, apu->dmc_irq);
+    state_write_8(writer, apu->frame_step);
+    state_write_size(writer, apu->frame_sequence_start);
+    state_write_size(writer, apu->next_frame_cycle);
+    state_write_size(writer, apu->cycle);
+}
+
+void apu_load_state(APU *apu, StateReader *reader) {
+    for (int i = 0; i < 2; i++) {
+        Pulse *pulse = &apu->pulse[i];
+        pulse->duty = state_read_8(reader);
+        pulse->phase = state_read_8(reader);
+        pulse->period = state_read_16(reader);
+        pulse->timer = state_read_32(reader);
+        pulse->length = state_read_8(reader);
+        load_envelope(&pulse->envelope, reader);
+        pulse->sweep_enabled = state_read_8(reader);
+        pulse->sweep_period = state_read_8(reader);
+        pulse->sweep_negate = state_read_8(reader);
+        pulse->sweep_shift = state_read_8(reader);
+        pulse->sweep_divider = state_read_8(reader);
+        pulse->sweep_reload = state_read_8(reader);
+    }
+
+    Triangle *triangle = &apu->triangle;
+    triangle->phase = state_read_8(reader);
+    triangle->period = state_read_16(reader);
+    triangle->timer = state_read_32(reader);
+    triangle->length = state_read_8(reader);
+    triangle->control = state_read_8(reader);
+    triangle->linear_reload_value = state_read_8(reader);
+    triangle->linear_counter = state_read_8(reader);
+    triangle->linear_reload = state_read_8(reader);
+
+    Noise *noise = &apu->noise;
+    noise->shift_register = state_read_16(reader);
+    noise->mode = state_read_8(reader);
+    noise->period_index = state_read_8(reader);
+    noise->timer = state_read_32(reader);
+    noise->length = state_read_8(reader);
+    load_envelope(&noise->envelope, reader);
+
+    DMC *dmc = &apu->dmc;
+    dmc->irq_enabled = state_read_8(reader);
+    dmc->loop = state_read_8(reader);
+    dmc->rate_index = state_read_8(reader);
+    dmc->timer = state_read_32(reader);
+    dmc->level = state_read_8(reader);
+    dmc->sample_address = state_read_16(reader);
+    dmc->sample_length = state_read_16(reader);
+    dmc->address = state_read_16(reader);
+    dmc->bytes_remaining = state_read_16(reader);
+    dmc->buffer = state_read_8(reader);
+    dmc->buffer_full = state_read_8(reader);
+    dmc->shift_register = state_read_8(reader);
+    dmc->bits_remaining = state_read_8(reader);
+    dmc->silence = state_read_8(reader);
+
+    apu->enabled = state_read_8(reader);
+    apu->frame_mode = state_read_8(reader);
+    apu->frame_irq_inhibit = state_read_8(reader);
+    apu->frame_irq = state_read_8(reader);
+    apu->dmc_irq = state_read_8(reader);
+    apu->frame_step = state_read_8(reader);
+    apu->frame_sequence_start = state_read_size(reader);
+    apu->next_frame_cycle = state_read_size(reader);
+    apu->cycle = state_read_size(reader);
+
+    // The synthesis buffer starts over, every channel adds its amplitude again. Without output there is
+    // nothing to start over, and the samples of the frame that was run ahead from are kept (see Emulator).
+    apu->frame_start = apu->cycle;
+#ifndef RISC_V
+    if (apu->sample_rate) {
+        apu->pulse[0].output = apu->pulse[1].output = apu->triangle.output = apu->noise.output = apu->dmc.output = 0;
+        blip_clear(&apu->blip);
+    }
+#endif
+    schedule_irq(apu);
+}
+
+#ifndef RISC_V
+void apu_set_output(APU *apu, uint32_t sample_rate) {
+    apu->sample_rate = sample_rate;
+    apu->pulse[0].output = apu->pulse[1].output = apu->triangle.output = apu->noise.output = apu->dmc.output = 0;
+    if (sample_rate) {
+        blip_init(&apu->blip, APU_CLOCK_RATE, sample_rate);
+    }
+}
+
+void apu_set_rate_adjustment(APU *apu, double ratio) {
+    if (apu->sample_rate) {
+        blip_set_rates(&apu->blip, APU_CLOCK_RATE, (uint32_t)(apu->sample_rate * ratio + 0.5));
+    }
+}
+
+size_t apu_read_samples(APU *apu, int16_t *out, size_t count) { return blip_read_samples(&apu->blip, out, count); }
+#endif
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// Runs the channels up to CPU cycle `end`, stopping at every step of the frame counter on the way
+static void run(APU *apu, size_t end) {
+    while (apu->cycle < end) {
+        size_t until = end < apu->next_frame_cycle ? end : apu->next_frame_cycle;
+
+        // Only the DMC has an effect on the CPU (IRQ, status), the others are only run when they are heard
+        if (apu->sample_rate) {
+            run_pulse(apu, &apu->pulse[0], until);
+            run_pulse(apu, &apu->pulse[1], until);
+            run_triangle(apu, until);
+            run_noise(apu, until);
+        }
+        run_dmc(apu, until);
+        apu->cycle = until;
+
+        if (until == apu->next_frame_cycle) {
+            clock_frame_counter(apu);
+        }
+    }
+}
+
+// The run_* functions run a channel from apu->cycle up to `end`. A channel's `timer` is the number of
+// cycles from apu->cycle to its next clock.
+
+static void run_pulse(APU *apu, Pulse *pulse, size_t end) {
+    uint8_t ones_complement = pulse == &apu->pulse[0]; // the sweep of pulse 1 negates differently
+    uint8_t volume = pulse_volume(pulse, ones_complement);
+    uint32_t period = (pulse->period + 1) * 2;
+    size_t time = apu->cycle + pulse->timer;
+
+    update_output(apu, &pulse->output, duty_table[pulse->duty][pulse->phase] * volume * PULSE_WEIGHT, apu->cycle);
+    if (time < end) {
+        if (volume == 0) {
+            // Silent, only the position in the duty cycle has to be kept
+            size_t clocks = (end - time - 1) / period + 1;
+            pulse->phase = (pulse->phase + clocks) & 0x07;
+            time += clocks * period;
+        } else {
+            const uint8_t *duty = duty_table[pulse->duty];
+            do {
+                pulse->phase = (pulse->phase + 1) & 0x07;
+                update_output(apu, &pulse->output, duty[pulse->phase] * volume * PULSE_WEIGHT, time);
+                time += period;
+            } while (time < end);
+        }
+    }
+    pulse->timer = time - end;
+}
+
+static void run_triangle(APU *apu, size_t end) {
+    Triangle *triangle = &apu->triangle;
+    uint32_t period = triangle->period + 1;
+    size_t time = apu->cycle + triangle->timer;
+
+    update_output(apu, &triangle->output, triangle_sequence[triangle->phase] * TRIANGLE_WEIGHT, apu->cycle);
+
+    // The sequencer is halted by the counters. Ultrasonic periods (the hardware would produce a ~50 kHz
+    // tone that nobody can hear) are halted too, instead of clocking the sequencer on every other cycle.
+    if (triangle->length == 0 || triangle->linear_counter == 0 || period < 3) {
+        if (time < end) {
+            time += ((end - time - 1) / period + 1) * period;
+        }
+    } else {
+        while (time < end) {
+            triangle->phase = (triangle->phase + 1) & 0x1F;
+            update_output(apu, &triangle->output, triangle_sequence[triangle->phase] * TRIANGLE_WEIGHT, time);
+            time += period;
+        }
+    }
+    triangle->timer = time - end;
+}
+
+static void run_noise(APU *apu, size_t end) {
+    Noise *noise = &apu->noise;
+    uint32_t period = noise_periods[noise->period_index];
+    uint8_t volume = noise->length ? envelope_volume(&noise->envelope) : 0;
+    uint8_t tap = noise->mode ? 6 : 1;
+    size_t time = apu->cycle + noise->timer;
+
+    update_output(apu, &noise->output, (noise->shift_register & 0x01) ? 0 : volume * NOISE_WEIGHT, apu->cycle);
+    if (time < end) {
+        if (volume == 0) {
+            // Silent, the sequence is random anyway so it doesn't have to be stepped
+            time += ((end - time - 1) / period + 1) * period;
+        } else {
+            do {
+                uint16_t shift = noise->shift_register;
+                uint16_t feedback = (shift ^ (shift >> tap)) & 0x01;
+                noise->shift_register = (shift >> 1) | (feedback << 14);
+                update_output(apu, &noise->output, (noise->shift_register & 0x01) ? 0 : volume * NOISE_WEIGHT, time);
+                time += period;
+            } while (time < end);
+        }
+    }
+    noise->timer = time - end;
+}
+
+static void run_dmc(APU *apu, size_t end) {
+    DMC *dmc = &apu->dmc;
+    uint32_t period = dmc_periods[dmc->rate_index];
+    size_t time = apu->cycle + dmc->timer;
+
+    update_output(apu, &dmc->output, dmc->level * DMC_WEIGHT, apu->cycle);
+    if (time >= end) {
+        dmc->timer = time - end;
+        return;
+    }
+
+    if (dmc->silence && !dmc->buffer_full) {
+        // Nothing is played and nothing can be fetched (that happens right away when the sample starts),
+        // only the output cycle has to be kept
+        size_t clocks = (end - time - 1) / period + 1;
+        dmc->bits_remaining = 8 - (8 - dmc->bits_remaining + clocks) % 8;
+        dmc->timer = time + clocks * period - end;
+        return;
+    }
+
+    do {
+        if (!dmc->silence) {
+            if (dmc->shift_register & 0x01) {
+                if (dmc->level <= 125)
+                    dmc->level += 2;
+            } else if (dmc->level >= 2) {
+                dmc->level -= 2;
+            }
+            update_output(apu, &dmc->output, dmc->level * DMC_WEIGHT, time);
+        }
+        dmc->shift_register >>= 1;
+
+        // End of the output cycle, the next byte is taken from the buffer
+        if (--dmc->bits_remaining == 0) {
+            dmc->bits_remaining = 8;
+            dmc->silence = !dmc->buffer_full;
+            if (dmc->buffer_full) {
+                dmc->shift_register = dmc->buffer;
+                dmc->buffer_full = FALSE;
+                fetch_dmc_sample(apu);
+            }
+        }
+        time += period;
+    } while (time < end);
+    dmc->timer = time - end;
+}
+
+// Fills the sample buffer if it is empty. The CPU stall of the fetch is not emulated.
+static void fetch_dmc_sample(APU *apu) {
+    DMC *dmc = &apu->dmc;
+    if (dmc->buffer_full || dmc->bytes_remaining == 0) {
+        return;
+    }
+
+    dmc->buffer = mem_read_8(&apu->emulator->mem, dmc->address);
+    dmc->buffer_full = TRUE;
+    dmc->address = dmc->address == 0xFFFF ? 0x8000 : dmc->address + 1;
+    dmc->bytes_remaining--;
+
+    if (dmc->bytes_remaining == 0) {
+        if (dmc->loop) {
+            restart_dmc_sample(dmc);
+        } else if (dmc->irq_enabled) {
+            set_dmc_irq(apu, TRUE);
+        }
+    }
+}
+
+static void restart_dmc_sample(DMC *dmc) {
+    dmc->address = dmc->sample_address;
+    dmc->bytes_remaining = dmc->sample_length;
+}
+
+// Adds the change of a channel's amplitude at CPU cycle `cycle` to the synthesis buffer
+static void update_output(APU *apu, int32_t *output, int32_t amplitude, size_t cycle) {
+#ifndef RISC_V
+    int32_t delta = amplitude - *output;
+    if (delta != 0 && apu->sample_rate) {
+        *output = amplitude;
+        blip_add_delta(&apu->blip, cycle - apu->frame_start, delta);
+    }
+#endif
+}
+
+// src: https://www.nesdev.org/wiki/APU_Frame_Counter
+static void clock_frame_counter(APU *apu) {
+    uint8_t step = apu->frame_step;
+    if (apu->frame_mode == 0) {
+        clock_quarter_frame(apu);
+        if (step & 0x01) {
+            clock_half_frame(apu);
+        }
+        if (step == 3 && !apu->frame_irq_inhibit) {
+            set_frame_irq(apu, TRUE);
+        }
+    } else {
+        if (step != 3) {
+            clock_quarter_frame(apu);
+        }
+        if (step == 1 || step == 4) {
+            clock_half_frame(apu);
+        }
+    }
+
+    const uint16_t *steps = frame_steps[apu->frame_mode];
+    uint8_t step_count = apu->frame_mode ? 5 : 4;
+    apu->frame_step++;
+    if (apu->frame_step == step_count) {
+        apu->frame_step = 0;
+        apu->frame_sequence_start += steps[step_count];
+    }
+    apu->next_frame_cycle = apu->frame_sequence_start + steps[apu->frame_step];
+}
+
+// Envelopes and the linear counter of the triangle
+static void clock_quarter_frame(APU *apu) {
+    clock_envelope(&apu->pulse[0].envelope);
+    clock_envelope(&apu->pulse[1].envelope);
+    clock_envelope(&apu->noise.envelope);
+
+    Triangle *triangle = &apu->triangle;
+    if (triangle->linear_reload) {
+        triangle->linear_counter = triangle->linear_reload_value;
+    } else if (triangle->linear_counter > 0) {
+        triangle->linear_counter--;
+    }
+    if (!triangle->control) {
+        triangle->linear_reload = FALSE;
+    }
+}
+
+// Length counters and sweeps
+static void clock_half_frame(APU *apu) {
+    for (int i = 0; i < 2; i++) {
+        Pulse *pulse = &apu->pulse[i];
+        if (pulse->length > 0 && !pulse->envelope.loop) {
+            pulse->length--;
+        }
+        clock_sweep(pulse, i == 0);
+    }
+    if (apu->triangle.length > 0 && !apu->triangle.control) {
+        apu->triangle.length--;
+    }
+    if (apu->noise.length > 0 && !apu->noise.envelope.loop) {
+        apu->noise.length--;
+    }
+}
+
+// src: https://www.nesdev.org/wiki/APU_Envelope
+static void clock_envelope(Envelope *envelope) {
+    if (envelope->start) {
+        envelope->start = FALSE;
+        envelope->decay = 15;
+        envelope->divider = envelope->volume;
+    } else if (envelope->divider == 0) {
+        envelope->divider = envelope->volume;
+        if (envelope->decay > 0) {
+            envelope->decay--;
+        } else if (envelope->loop) {
+            envelope->decay = 15;
+        }
+    } else {
+        envelope->divider--;
+    }
+}
+
+// src: https://www.nesdev.org/wiki/APU_Sweep
+static void clock_sweep(Pulse *pulse, uint8_t ones_complement) {
+    uint16_t target = sweep_target(pulse, ones_complement);
+    if (pulse->sweep_divider == 0 && pulse->sweep_enabled && pulse->sweep_shift > 0 && pulse->period >= 8 &&
+        target <= 0x07FF) {
+        pulse->period = target;
+    }
+    if (pulse->sweep_divider == 0 || pulse->sweep_reload) {
+        pulse->sweep_divider = pulse->sweep_period;
+        pulse->sweep_reload = FALSE;
+    } else {
+        pulse->sweep_divider--;
+    }
+}
+
+static uint16_t sweep_target(const Pulse *pulse, uint8_t ones_complement) {
+    uint16_t change = pulse->period >> pulse->sweep_shift;
+    if (!pulse->sweep_negate) {
+        return pulse->period + change;
+    }
+    change += ones_complement;
+    return change > pulse->period ? 0 : pulse->period - change;
+}
+
+// The pulse is muted by its length counter, and by the sweep when the period is out of range
+static uint8_t pulse_volume(const Pulse *pulse, uint8_t ones_complement) {
+    if (pulse->length == 0 || pulse->period < 8 || sweep_target(pulse, ones_complement) > 0x07FF) {
+        return 0;
+    }
+    return envelope_volume(&pulse->envelope);
+}
+
+static uint8_t envelope_volume(const Envelope *envelope) {
+    return envelope->constant ? envelope->volume : envelope->decay;
+}
+
+static void write_envelope(Envelope *envelope, uint8_t value) {
+    envelope->loop = (value & 0x20) ? 1 : 0;
+    envelope->constant = (value & 0x10) ? 1 : 0;
+    envelope->volume = value & 0x0F;
+}
+
+// The length counter is only loaded while the channel is enabled in the status register
+static void load_length(APU *apu, uint8_t *length, uint8_t channel, uint8_t value) {
+    if (apu->enabled & (0x01 << channel)) {
+        *length = length_table[value >> 3];
+    }
+}
+
+static void set_frame_irq(APU *apu, uint8_t value) {
+    apu->frame_irq = value;
+    cpu_set_irq_line(&apu->emulator->cpu, IRQ_SOURCE_FRAME_COUNTER, value);
+}
+
+static void set_dmc_irq(APU *apu, uint8_t value) {
+    apu->dmc_irq = value;
+    cpu_set_irq_line(&apu->emulator->cpu, IRQ_SOURCE_DMC, value);
+}
+
+// Finds the earliest cycle an IRQ can be raised at, so that the CPU knows when to catch the APU up
+static void schedule_irq(APU *apu) {
+    apu->next_irq_cycle = APU_NO_IRQ;
+
+    if (apu->frame_mode == 0 && !apu->frame_irq_inhibit && !apu->frame_irq) {
+        apu->next_irq_cycle = apu->frame_sequence_start + frame_steps[0][3];
+    }
+
+    // The IRQ is raised when the last byte is fetched. A byte is fetched whenever the output cycle
+    // takes the previous one from the buffer, which happens every 8 clocks.
+    const DMC *dmc = &apu->dmc;
+    if (dmc->irq_enabled && !dmc->loop && !apu->dmc_irq && dmc->bytes_remaining > 0 && dmc->buffer_full) {
+        size_t period = dmc_periods[dmc->rate_index];
+        size_t fetch_cycle = apu->cycle + dmc->timer + (dmc->bits_remaining - 1) * period;
+        size_t irq_cycle = fetch_cycle + (dmc->bytes_remaining - 1) * 8 * period;
+        if (irq_cycle < apu->next_irq_cycle) {
+            apu->next_irq_cycle = irq_cycle;
+        }
+    }
+}
+
+static void save_envelope(const Envelope *envelope, StateWriter *writer) {
+    state_write_8(writer, envelope->start);
+    state_write_8(writer, envelope->loop);
+    state_write_8(writer, envelope->constant);
+    state_write_8(writer, envelope->volume);
+    state_write_8(writer, envelope->divider);
+    state_write_8(writer, envelope->decay);
+}
+
+static void load_envelope(Envelope *envelope, StateReader *reader) {
+    envelope->start = state_read_8(reader);
+    envelope->loop = state_read_8(reader);
+    envelope->constant = state_read_8(reader);
+    envelope->volume = state_read_8(reader);
+    envelope->divider = state_read_8(reader);
+    envelope->decay = state_read_8(reader);
+}
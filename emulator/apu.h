@@ -0,0 +1,192 @@
+#ifndef APU_H
+#define APU_H
+
+#include "blip.h"
+#include "common.h"
+
+#define APU_CLOCK_RATE 1789773 // Hz, the APU is clocked by the (NTSC) CPU
+#define APU_NO_IRQ ((size_t)-1)
+
+// Forward declarations
+typedef struct Emulator Emulator;
+typedef struct StateWriter StateWriter;
+typedef struct StateReader StateReader;
+
+// Volume envelope of the pulse and noise channels
+typedef struct Envelope {
+    uint8_t start;
+    uint8_t loop; // also halts the length counter
+    uint8_t constant;
+    uint8_t volume; // the constant volume, or the period of the decay
+    uint8_t divider;
+    uint8_t decay;
+} Envelope;
+
+typedef struct Pulse {
+    uint8_t duty;
+    uint8_t phase;   // position in the duty cycle (0 - 7)
+    uint16_t period; // raw 11-bit timer period
+    uint32_t timer;  // CPU cycles until the next step of the duty cycle
+    uint8_t length;  // length counter, silenced at 0
+    Envelope envelope;
+
+    uint8_t sweep_enabled;
+    uint8_t sweep_period;
+    uint8_t sweep_negate;
+    uint8_t sweep_shift;
+    uint8_t sweep_divider;
+    uint8_t sweep_reload;
+
+    int32_t output; // weighted amplitude that was last added to the synthesis buffer
+} Pulse;
+
+typedef struct Triangle {
+    uint8_t phase; // position in the 32-step sequence
+    uint16_t period;
+    uint32_t timer;
+    uint8_t length;
+    uint8_t control; // halts the length counter and keeps reloading the linear counter
+    uint8_t linear_reload_value;
+    uint8_t linear_counter;
+    uint8_t linear_reload;
+
+    int32_t output;
+} Triangle;
+
+typedef struct Noise {
+    uint16_t shift_register; // 15-bit LFSR
+    uint8_t mode;            // short (93 step) sequence
+    uint8_t period_index;
+    uint32_t timer;
+    uint8_t length;
+    Envelope envelope;
+
+    int32_t output;
+} Noise;
+
+// Delta modulation channel, plays 1-bit delta encoded samples from PRG-ROM
+typedef struct DMC {
+    uint8_t irq_enabled;
+    uint8_t loop;
+    uint8_t rate_index;
+    uint32_t timer;
+    uint8_t level; // 7-bit output level
+
+    uint16_t sample_address;
+    uint16_t sample_length;
+    uint16_t address; // next byte to fetch
+    uint16_t bytes_remaining;
+
+    uint8_t buffer;
+    uint8_t buffer_full;
+    uint8_t shift_register;
+    uint8_t bits_remaining;
+    uint8_t silence;
+
+    int32_t output;
+} DMC;
+
+/**
+ *  Audio processing unit
+ *
+ *  Like the PPU the APU is not stepped alongside the CPU. `cycle` trails cpu->total_cycles, and
+ *  `apu_catch_up` runs the APU up to the CPU when it is needed: on accesses to its registers, at
+ *  the end of every frame, and when an IRQ of the frame counter or the DMC is due (`next_irq_cycle`).
+ *
+ *  Between two frame counter steps the channels are run one after another. A channel only does work
+ *  when its timer is clocked, and when its amplitude changes the difference is added to the band-limited
+ *  synthesis buffer (see Blip). Nothing is synthesized until `apu_set_output` is called, which makes the
+ *  APU almost free in headless runs and on the board, which has no audio output.
+ */
+typedef struct APU {
+    Pulse pulse[2];
+    Triangle triangle;
+    Noise noise;
+    DMC dmc;
+
+    uint8_t enabled;           // channels enabled in the status register, length counters only load while enabled
+    uint8_t frame_mode;        // 0: 4-step sequence, 1: 5-step sequence
+    uint8_t frame_irq_inhibit; // the 4-step sequence raises an IRQ unless this is set
+    uint8_t frame_irq;
+    uint8_t dmc_irq;
+    uint8_t frame_step;          // next step of the frame counter sequence
+    size_t frame_sequence_start; // CPU cycle the current sequence started at
+    size_t next_frame_cycle;     // CPU cycle of the next step
+
+    size_t cycle;          // CPU cycle the APU has been run up to
+    size_t next_irq_cycle; // earliest CPU cycle an IRQ can be raised at, or APU_NO_IRQ
+    size_t frame_start;    // CPU cycle the current frame of the synthesis buffer started at
+
+    uint32_t sample_rate; // 0 while there is no output, and while frames are run ahead (see emulator_run_frame)
+#ifndef RISC_V
+    Blip blip;
+#endif
+
+    Emulator *emulator;
+} APU;
+
+/**
+ *  Initializes the APU. All channels are silent and there is no output until `apu_set_output` is called.
+ *
+ */
+void apu_init(Emulator *emulator);
+
+/**
+ *  Runs the APU up to the current CPU cycle.
+ *
+ *  Called by the CPU when `next_irq_cycle` has passed, and before the registers are accessed.
+ */
+void apu_catch_up(APU *apu);
+
+/**
+ *  Handles a write to the registers 0x4000 - 0x4013, 0x4015 and 0x4017.
+ *
+ */
+void apu_write_register(APU *apu, uint16_t address, uint8_t value);
+
+/**
+ *  Reads the status register (0x4015). Clears the frame counter IRQ.
+ *
+ */
+uint8_t apu_read_status(APU *apu);
+
+/**
+ *  Runs the APU up to the current CPU cycle and ends the frame of the synthesis buffer,
+ *  which makes its samples available. Called at the end of every frame.
+ */
+void apu_end_frame(APU *apu);
+
+/**
+ *  Writes the state of the channels and the frame counter to a save state chunk.
+ *  The synthesis buffer isn't saved.
+ */
+void apu_save_state(const APU *apu, StateWriter *writer);
+
+/**
+ *  Reads a chunk written by `apu_save_state`.
+ *
+ */
+void apu_load_state(APU *apu, StateReader *reader);
+
+#ifndef RISC_V
+/**
+ *  Starts synthesizing `sample_rate` samples per second, or stops if it is 0.
+ *
+ */
+void apu_set_output(APU *apu, uint32_t sample_rate);
+
+/**
+ *  Synthesizes `ratio` times as many samples per emulated second as the output sample rate, without
+ *  clearing the buffer. Keeps the audio ring from draining or filling up when the emulation runs a
+ *  little faster or slower than the audio device. Takes effect at the next frame.
+ */
+void apu_set_rate_adjustment(APU *apu, double ratio);
+
+/**
+ *  Reads up to `count` mono samples into `out`. Returns the number of samples read.
+ *
+ */
+size_t apu_read_samples(APU *apu, int16_t *out, size_t count);
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+#include "blip.h"
+
+#ifndef RISC_V
+
+#define TIME_BITS 32 // fractional bits of positions
+#define PHASE_COUNT (1 << BLIP_PHASE_BITS)
+#define BASS_SHIFT 9 // the high-pass filter that removes the DC offset decays by 1/512 per sample
+
+// Band-limited impulses (Blackman windowed sinc, cut off at 88% of the Nyquist frequency) for steps
+// at every phase of a sample. The step is centered between taps 7 and 8 at phase 0, and moves one
+// tap to the right over the phases.
+// clang-format off
+static const int16_t kernel[PHASE_COUNT][BLIP_KERNEL_WIDTH] = {
+    {5, -43, 102, -72, -329, 1636, -5087, 20172, 20172, -5087, 1636, -329, -72, 102, -43, 5},
+    {4, -38, 83, -22, -428, 1783, -5206, 19188, 21124, -4921, 1469, -222, -125, 122, -48, 5},
+    {3, -33, 64, 26, -518, 1910, -5278, 18175, 22036, -4705, 1282, -109, -179, 142, -54, 6},
+    {3, -28, 46, 70, -601, 2016, -5307, 17139, 22907, -4439, 1076, 11, -235, 162, -59, 7},
+    {2, -23, 29, 112, -674, 2101, -5293, 16082, 23733, -4123, 851, 137, -292, 182, -64, 8},
+    {2, -19, 12, 151, -739, 2167, -5239, 15012, 24506, -3754, 609, 268, -350, 202, -69, 9},
+    {1, -14, -3, 186, -795, 2212, -5147, 13932, 25226, -3333, 351, 403, -408, 222, -74, 9},
+    {1, -10, -17, 217, -841, 2238, -5021, 12847, 25890, -2860, 77, 541, -466, 240, -78, 10},
+    {1, -7, -30, 245, -879, 2246, -4862, 11761, 26493, -2335, -210, 681, -523, 258, -82, 11},
+    {0, -3, -41, 269, -908, 2235, -4673, 10681, 27030, -1758, -509, 823, -579, 275, -85, 11},
+    {0, -1, -52, 290, -928, 2208, -4457, 9609, 27502, -1132, -818, 965, -633, 291, -88, 12},
+    {0, 2, -61, 307, -940, 2164, -4218, 8551, 27907, -455, -1135, 1105, -685, 304, -90, 12},
+    {0, 4, -69, 321, -943, 2106, -3957, 7510, 28239, 269, -1458, 1243, -733, 316, -92, 12},
+    {0, 6, -76, 331, -939, 2034, -3678, 6491, 28501, 1039, -1785, 1377, -778, 326, -93, 12},
+    {0, 8, -81, 338, -928, 1949, -3384, 5498, 28685, 1853, -2113, 1507, -818, 334, -92, 12},
+    {0, 9, -86, 341, -910, 1852, -3078, 4535, 28800, 2709, -2439, 1630, -854, 339, -91, 11},
+    {0, 11, -89, 341, -885, 1745, -2762, 3604, 28838, 3604, -2762, 1745, -885, 341, -89, 11},
+    {0, 11, -91, 339, -854, 1630, -2439, 2709, 28800, 4535, -3078, 1852, -910, 341, -86, 9},
+    {0, 12, -92, 334, -818, 1507, -2113, 1853, 28685, 5498, -3384, 1949, -928, 338, -81, 8},
+    {0, 12, -93, 326, -778, 1377, -1785, 1039, 28501, 6491, -3678, 2034, -939, 331, -76, 6},
+    {0, 12, -92, 316, -733, 1243, -1458, 269, 28239, 7510, -3957, 2106, -943, 321, -69, 4},
+    {0, 12, -90, 304, -685, 1105, -1135, -455, 27907, 8551, -4218, 2164, -940, 307, -61, 2},
+    {0, 12, -88, 291, -633, 965, -818, -1132, 27503, 9609, -4458, 2208, -928, 290, -52, -1},
+    {0, 11, -85, 275, -579, 823, -509, -1758, 27030, 10681, -4673, 2235, -908, 269, -41, -3},
+    {0, 11, -82, 258, -523, 681, -210, -2335, 26493, 11762, -4862, 2246, -879, 245, -30, -7},
+    {0, 10, -78, 240, -466, 541, 77, -2860, 25891, 12847, -5021, 2238, -841, 217, -17, -10},
+    {0, 9, -74, 222, -408, 403, 351, -3333, 25228, 13932, -5148, 2212, -795, 186, -3, -14},
+    {0, 9, -69, 202, -350, 268, 609, -3754, 24507, 15013, -5239, 2167, -739, 151, 12, -19},
+    {0, 8, -64, 182, -292, 137, 851, -4123, 23733, 16083, -5293, 2102, -674, 112, 29, -23},
+    {0, 7, -59, 162, -235, 11, 1076, -4440, 22910, 17140, -5307, 2016, -601, 70, 46, -28},
+    {0, 6, -54, 142, -179, -109, 1282, -4706, 22039, 18177, -5279, 1910, -518, 26, 64, -33},
+    {0, 5, -48, 122, -125, -222, 1469, -4921, 21125, 19190, -5206, 1784, -428, -22, 83, -38},
+};
+// clang-format on
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+void blip_init(Blip *blip, uint32_t clock_rate, uint32_t sample_rate) {
+    blip_set_rates(blip, clock_rate, sample_rate);
+    blip_clear(blip);
+}
+
+void blip_set_rates(Blip *blip, uint32_t clock_rate, uint32_t sample_rate) {
+    blip->factor = ((uint64_t)sample_rate << TIME_BITS) / clock_rate;
+}
+
+void blip_clear(Blip *blip) {
+    blip->offset = 0;
+    blip->integrator = 0;
+    memset(blip->buffer, 0, sizeof(blip->buffer));
+}
+
+void blip_add_delta(Blip *blip, uint32_t time, int32_t delta) {
+    uint64_t position = time * blip->factor + blip->offset;
+    size_t index = position >> TIME_BITS;
+    if (index >= BLIP_BUFFER_SIZE) {
+        return; // the frame is far too long, nothing can be read from it anyway
+    }
+
+    const int16_t *impulse = kernel[(position >> (TIME_BITS - BLIP_PHASE_BITS)) & (PHASE_COUNT - 1)];
+    int32_t *out = blip->buffer + index;
+    for (int i = 0; i < BLIP_KERNEL_WIDTH; i++) {
+        out[i] += impulse[i] * delta;
+    }
+}
+
+void blip_end_frame(Blip *blip, uint32_t time) {
+    blip->offset += time * blip->factor;
+
+    // Nobody is reading, drop the oldest samples to make room for the next frame
+    size_t avail = blip_samples_avail(blip);
+    if (avail > BLIP_BUFFER_SIZE / 2) {
+        blip_read_samples(blip, NULL, avail - BLIP_BUFFER_SIZE / 2);
+    }
+}
+
+size_t blip_samples_avail(const Blip *blip) { return blip->offset >> TIME_BITS; }
+
+size_t blip_read_samples(Blip *blip, int16_t *out, size_t count) {
+    size_t avail = blip_samples_avail(blip);
+    if (count > avail) {
+        count = avail;
+    }
+
+    int32_t sum = blip->integrator;
+    for (size_t i = 0; i < count; i++) {
+        int32_t sample = sum >> BLIP_KERNEL_BITS;
+        sum += blip->buffer[i];
+        if (sample > INT16_MAX) {
+            sample = INT16_MAX;
+        } else if (sample < INT16_MIN) {
+            sample = INT16_MIN;
+        }
+        if (out) {
+            out[i] = sample;
+        }
+        sum -= sample << (BLIP_KERNEL_BITS - BASS_SHIFT);
+    }
+    blip->integrator = sum;
+
+    // Move the samples that are still being added to, to the front
+    size_t remaining = avail - count + BLIP_KERNEL_WIDTH;
+    memmove(blip->buffer, blip->buffer + count, remaining * sizeof(blip->buffer[0]));
+    memset(blip->buffer + remaining, 0, count * sizeof(blip->buffer[0]));
+    blip->offset -= (uint64_t)count << TIME_BITS;
+    return count;
+}
+
+#endif // RISC_V
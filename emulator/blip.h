@@ -0,0 +1,78 @@
+#ifndef BLIP_H
+#define BLIP_H
+
+#include "common.h"
+
+#ifndef RISC_V
+#define BLIP_BUFFER_SIZE 8192 // samples, several frames
+#define BLIP_KERNEL_WIDTH 16  // samples a step is spread over
+#define BLIP_PHASE_BITS 5     // resolution of the step position within a sample
+#define BLIP_KERNEL_BITS 15   // the taps of each kernel phase sum up to 1 << BLIP_KERNEL_BITS
+
+/**
+ *  Band-limited synthesis buffer
+ *
+ *  Instead of rendering a channel at the clock rate and decimating, only the changes of its
+ *  amplitude are added, at the clock cycle they happen at. Each change is added as a band-limited
+ *  step (a windowed sinc impulse, picked from a table by the position of the change within the
+ *  output sample), so the buffer is filled at the output sample rate directly and square waves
+ *  don't alias. Reading integrates the impulses back into the amplitude and removes the DC offset.
+ *
+ *  Time is counted in clock cycles from the start of the current frame, see `blip_end_frame`.
+ *  Only built for the host, the board has no audio output.
+ */
+typedef struct Blip {
+    uint64_t factor; // output samples per clock cycle, 32.32 fixed point
+    uint64_t offset; // position of the start of the frame, 32.32 fixed point, includes the available samples
+    int32_t integrator;
+    int32_t buffer[BLIP_BUFFER_SIZE + BLIP_KERNEL_WIDTH];
+} Blip;
+
+/**
+ *  Clears the buffer and sets the ratio of the clock rate to the output sample rate.
+ *
+ */
+void blip_init(Blip *blip, uint32_t clock_rate, uint32_t sample_rate);
+
+/**
+ *  Changes the ratio of the clock rate to the output sample rate, without clearing the buffer.
+ *  Takes effect at the start of the next frame.
+ *
+ */
+void blip_set_rates(Blip *blip, uint32_t clock_rate, uint32_t sample_rate);
+
+/**
+ *  Removes all samples and resets the amplitude to 0.
+ *
+ */
+void blip_clear(Blip *blip);
+
+/**
+ *  Adds a change of `delta` to the amplitude at clock cycle `time` of the current frame.
+ *
+ */
+void blip_add_delta(Blip *blip, uint32_t time, int32_t delta);
+
+/**
+ *  Ends the current frame after `time` clock cycles. The samples before it become available,
+ *  the next frame starts at cycle 0.
+ *
+ */
+void blip_end_frame(Blip *blip, uint32_t time);
+
+/**
+ *  Returns the number of samples that can be read.
+ *
+ */
+size_t blip_samples_avail(const Blip *blip);
+
+/**
+ *  Reads up to `count` samples into `out` and removes them from the buffer. Passing NULL drops them.
+ *
+ *  Returns the number of samples read.
+ */
+size_t blip_read_samples(Blip *blip, int16_t *out, size_t count);
+
+#endif // RISC_V
+
+#endif
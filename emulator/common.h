@@ -49,7 +49,10 @@ void exit(int code);
 #include <time.h>
 
 #include "debug.h"
+#ifndef HEADLESS // The headless build doesn't link against SDL
+#include "render-thread.h"
 #include "sdl-instance.h"
+#endif
 
 #endif // RISC_V
 #endif // COMMON_H
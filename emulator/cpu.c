@@ -3,6 +3,7 @@
 #include "opcodes.h"
 
 #include "emulator.h"
+#include "savestate.h"
 
 // CPU init values
 #define SR_INIT_VALUE 0x24
@@ -25,9 +26,15 @@ static uint8_t shift_left(CPU *cpu, uint8_t val);
 static uint8_t shift_right(CPU *cpu, uint8_t val);
 static uint8_t rotate_left(CPU *cpu, uint8_t val);
 static uint8_t rotate_right(CPU *cpu, uint8_t val);
+#ifdef CPU_SWITCH_DISPATCH
 static void execute_instruction(CPU *cpu, Instruction instruction);
 static void set_address(CPU *cpu, Instruction instruction);
+#else
+static void (*const handler_lookup[256])(CPU *cpu);
+#endif
 static void handle_nes_interrupt(CPU *cpu);
+static void skip_idle_loop(CPU *cpu, uint16_t branch_pc);
+static uint8_t check_idle_loop(const CPU *cpu, uint16_t branch_pc, uint8_t *reads_ppu_status);
 
 // --------------- PUBLIC FUNCTIONS --------------------------- //
 void cpu_init(Emulator *emulator) {
@@ -36,50 +43,120 @@ void cpu_init(Emulator *emulator) {
 
     cpu->ac = cpu->x = cpu->y = 0x00;
     cpu->total_cycles = 0;
+    cpu->total_instructions = 0;
     cpu->cycles = 0;
     cpu->dma_cycles = 0;
     cpu->sr = SR_INIT_VALUE;
     cpu->sp = SP_INIT_VALUE;
     cpu->pending_interrupt = NONE;
+    cpu->irq_lines = 0;
     cpu->pc = mem_read_16(&emulator->mem, RESET_VECTOR_OFFSET);
 
+    cpu->skip_idle_loops = TRUE;
+    memset(&cpu->idle_loop, 0, sizeof(cpu->idle_loop));
+
     cpu->is_logging = 0;
 }
 
-void cpu_run_cycle(CPU *cpu) {
+void cpu_run_instruction(CPU *cpu) {
     MEM *mem = &cpu->emulator->mem;
+    PPU *ppu = &cpu->emulator->ppu;
 
-    // If currently in OAM DMA
-    if (cpu->dma_cycles > 0) {
-        cpu->dma_cycles--;
-        return;
-    }
+    // The PPU runs one CPU cycle ahead of the instruction.
+    // This also delivers an NMI that is due before the instruction starts.
+    ppu_advance(ppu, 1);
 
-    if (cpu->cycles == 0) {
-        if (cpu->pending_interrupt != NONE) {
-            handle_nes_interrupt(cpu); // might add 7 cycles
-        }
+    cpu->cycles = 0;
+    if (cpu->pending_interrupt != NONE) {
+        handle_nes_interrupt(cpu); // might add 7 cycles
+    }
+    uint16_t instruction_pc = cpu->pc;
 
 #ifndef RISC_V
-        if (cpu->is_logging)
-            debug_log_instruction(cpu);
+    if (cpu->is_logging) {
+        ppu_catch_up(ppu); // The log shows the current PPU dot
+        debug_log_instruction(cpu);
+    }
 #endif // RISC_V
 
-        uint8_t byte = mem_read_8(mem, cpu->pc++);
-        cpu->cycles += cycle_lookup[byte];
-        set_flag(cpu, UNUSED, TRUE);
-        Instruction instruction = instruction_lookup[byte];
-        set_address(cpu, instruction);         // might add 1 cycle
-        execute_instruction(cpu, instruction); // might add 1 cycle
+    uint8_t byte = mem_read_8(mem, cpu->pc++);
+    set_flag(cpu, UNUSED, TRUE);
+#ifdef CPU_SWITCH_DISPATCH
+    cpu->cycles += cycle_lookup[byte];
+    Instruction instruction = instruction_lookup[byte];
+    set_address(cpu, instruction);         // might add 1 cycle
+    execute_instruction(cpu, instruction); // might add 1 cycle
+#else
+    handler_lookup[byte](cpu); // might add 1-2 cycles on top of the base cycles
+#endif
 
-        cpu->total_cycles += cpu->cycles;
+    // The remaining cycles of the instruction, and the OAM DMA stall if it started one
+    size_t elapsed_cycles = cpu->cycles + cpu->dma_cycles;
+    cpu->total_cycles += elapsed_cycles;
+    cpu->total_instructions++;
+    cpu->dma_cycles = 0;
+#ifdef HOTSPOT_PROFILER
+    debug_hotspot_record(instruction_pc, 1, elapsed_cycles);
+#endif
+    ppu_advance(ppu, elapsed_cycles - 1);
+
+    // The APU is also run lazily, but has to raise its IRQs on time
+    if (cpu->total_cycles > cpu->emulator->apu.next_irq_cycle) {
+        apu_catch_up(&cpu->emulator->apu);
     }
 
-    cpu->cycles--;
+    // Jumped backwards, this might be an idle loop
+    if (cpu->pc <= instruction_pc && cpu->skip_idle_loops && !cpu->is_logging) {
+        skip_idle_loop(cpu, instruction_pc);
+    }
 }
 
 void cpu_set_interrupt(CPU *cpu, Interrupt interrupt) { cpu->pending_interrupt = interrupt; }
 
+void cpu_set_irq_line(CPU *cpu, IRQSource source, int active) {
+    if (active) {
+        cpu->irq_lines |= source;
+    } else {
+        cpu->irq_lines &= ~source;
+    }
+
+    // A pending NMI is taken first, the IRQ is picked up again after it
+    if (cpu->pending_interrupt != NMI) {
+        cpu->pending_interrupt = cpu->irq_lines ? IRQ : NONE;
+    }
+}
+
+void cpu_save_state(const CPU *cpu, StateWriter *writer) {
+    state_write_16(writer, cpu->pc);
+    state_write_8(writer, cpu->ac);
+    state_write_8(writer, cpu->x);
+    state_write_8(writer, cpu->y);
+    state_write_8(writer, cpu->sr);
+    state_write_8(writer, cpu->sp);
+    state_write_8(writer, cpu->pending_interrupt);
+    state_write_8(writer, cpu->irq_lines);
+    state_write_size(writer, cpu->total_cycles);
+    state_write_size(writer, cpu->total_instructions);
+}
+
+void cpu_load_state(CPU *cpu, StateReader *reader) {
+    cpu->pc = state_read_16(reader);
+    cpu->ac = state_read_8(reader);
+    cpu->x = state_read_8(reader);
+    cpu->y = state_read_8(reader);
+    cpu->sr = state_read_8(reader);
+    cpu->sp = state_read_8(reader);
+    cpu->pending_interrupt = (Interrupt)state_read_8(reader);
+    cpu->irq_lines = state_read_8(reader);
+    cpu->total_cycles = state_read_size(reader);
+    cpu->total_instructions = state_read_size(reader);
+
+    // States are saved between instructions
+    cpu->cycles = 0;
+    cpu->dma_cycles = 0;
+    memset(&cpu->idle_loop, 0, sizeof(cpu->idle_loop));
+}
+
 // --------------- STATIC FUNCTIONS --------------------------- //
 static int get_flag(CPU *cpu, CPUFlag flag) { return (cpu->sr & flag) ? 1 : 0; }
 
@@ -162,502 +239,645 @@ static void branch_if(CPU *cpu, int predicate) {
     }
 }
 
-void execute_instruction(CPU *cpu, Instruction instruction) {
+// --------------- ADDRESSING MODES --------------------------- //
+// Each of these sets up the cpu->address variable for one addressing mode.
+// The indexed modes also add a cycle if they cross a page boundary.
+
+static inline void addr_ACC(CPU *cpu, Opcode opcode) {} // Accumulator
+
+static inline void addr_ABS(CPU *cpu, Opcode opcode) { // Absolute
     MEM *mem = &cpu->emulator->mem;
+    cpu->address = mem_read_16(mem, cpu->pc);
+    cpu->pc += 2;
+}
 
-    switch (instruction.opcode) {
-    case ADC: {
-        uint16_t A = cpu->ac;
-        uint16_t M = mem_read_8(mem, cpu->address);
-        uint16_t R = A + M + get_flag(cpu, CARRY);
-        cpu->ac = R & 0xFF;
-        set_flag(cpu, CARRY, R > 0xFF);
-        set_flag(cpu, OVERFLW, ((~(A ^ M) & (A ^ R) & 0x80) != 0));
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case AND: {
-        cpu->ac &= mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case ASL: {
-        if (instruction.address_mode == ACC) {
-            cpu->ac = shift_left(cpu, cpu->ac);
-        } else {
-            uint8_t m = mem_read_8(mem, cpu->address);
-            mem_write_8(mem, cpu->address, m); // Dummy
-            mem_write_8(mem, cpu->address, shift_left(cpu, m));
-        }
-        break;
-    }
-    case BCC: {
-        // Branch if Carry Clear (C flag = 0)
-        branch_if(cpu, !get_flag(cpu, CARRY));
-        break;
-    }
-    case BCS: {
-        // Branch if Carry Set (C flag = 1)
-        branch_if(cpu, get_flag(cpu, CARRY));
-        break;
-    }
-    case BEQ: {
-        // Branch if Zero Set (Z flag = 1)
-        branch_if(cpu, get_flag(cpu, ZERO));
-        break;
-    }
-    case BIT: {
-        uint8_t op = mem_read_8(mem, cpu->address);
-        set_flag(cpu, ZERO, (cpu->ac & op) == 0);
-        set_flag(cpu, NEGATIVE, op & 0x80);
-        set_flag(cpu, OVERFLW, op & 0x40);
-        break;
-    }
-    case BMI: {
-        // Branch if Negative Set (N flag = 1)
-        branch_if(cpu, get_flag(cpu, NEGATIVE));
-        break;
-    }
-    case BNE: {
-        // Branch if Zero Clear (Z flag = 0)
-        branch_if(cpu, !get_flag(cpu, ZERO));
-        break;
-    }
-    case BPL: {
-        // Branch if Negative Clear (N flag = 0)
-        branch_if(cpu, !get_flag(cpu, NEGATIVE));
-        break;
-    }
-    case BRK: {
-        cpu->pc++;
-        mem_push_stack_16(cpu, cpu->pc);
-        mem_push_stack_8(cpu, cpu->sr | BREAK | UNUSED);
-        cpu->pc = mem_read_16(mem, IRQ_VECTOR_OFFSET);
-        set_flag(cpu, INTERRUPT, TRUE);
-        break;
-    }
-    case BVC: {
-        // Branch if Overflow Clear (V flag = 0)
-        branch_if(cpu, !get_flag(cpu, OVERFLW));
-        break;
-    }
-    case BVS: {
-        // Branch if Overflow Set (V flag = 1)
-        branch_if(cpu, get_flag(cpu, OVERFLW));
-        break;
-    }
-    case CLC: {
-        set_flag(cpu, CARRY, FALSE);
-        break;
-    }
-    case CLD: {
-        set_flag(cpu, DECIMAL, FALSE);
-        break;
-    }
-    case CLI: {
-        set_flag(cpu, INTERRUPT, FALSE);
-        break;
-    }
-    case CLV: {
-        set_flag(cpu, OVERFLW, FALSE);
-        break;
-    }
-    case CMP: {
-        uint16_t a = cpu->ac;
-        uint16_t m = mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, (a - m) & 0xFF);
-        set_flag(cpu, CARRY, a >= m);
-        break;
-    }
-    case CPX: {
-        uint16_t x = cpu->x;
-        uint16_t m = mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, (x - m) & 0xFF);
-        set_flag(cpu, CARRY, x >= m);
-        break;
-    }
-    case CPY: {
-        uint16_t y = cpu->y;
-        uint16_t m = mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, (y - m) & 0xFF);
-        set_flag(cpu, CARRY, y >= m);
-        break;
-    }
-    case DEC: {
-        uint8_t decremented = mem_read_8(mem, cpu->address) - 1;
-        mem_write_8(mem, cpu->address, decremented);
-        set_ZN_flags(cpu, decremented);
-        break;
-    }
-    case DEX: {
-        cpu->x--;
-        set_ZN_flags(cpu, cpu->x);
-        break;
-    }
-    case DEY: {
-        cpu->y--;
-        set_ZN_flags(cpu, cpu->y);
-        break;
-    }
-    case EOR: {
-        cpu->ac ^= mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case INC: {
-        uint8_t incremented = mem_read_8(mem, cpu->address) + 1;
-        mem_write_8(mem, cpu->address, incremented);
-        set_ZN_flags(cpu, incremented);
-        break;
-    }
-    case INX: {
-        cpu->x++;
-        set_ZN_flags(cpu, cpu->x);
-        break;
-    }
-    case INY: {
-        cpu->y++;
-        set_ZN_flags(cpu, cpu->y);
-        break;
-    }
-    case JMP: {
-        cpu->pc = cpu->address;
-        break;
-    }
-    case JSR: {
-        // The return address should be (pc - 1) since the CPU will resume
-        // execution in the address immediately after the return address
-        mem_push_stack_16(cpu, cpu->pc - 1);
-        cpu->pc = cpu->address;
-        break;
-    }
-    case LDA: {
-        cpu->ac = mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case LDX: {
-        cpu->x = mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, cpu->x);
-        break;
-    }
-    case LDY: {
-        cpu->y = mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, cpu->y);
-        break;
-    }
-    case LSR: {
-        if (instruction.address_mode == ACC)
-            cpu->ac = shift_right(cpu, cpu->ac);
-        else {
-            uint8_t m = mem_read_8(mem, cpu->address);
-            mem_write_8(mem, cpu->address, shift_right(cpu, m));
-        }
-        break;
-    }
-    case NOP: {
-        // Do nothing
-        break;
-    }
-    case ORA: {
-        cpu->ac |= mem_read_8(mem, cpu->address);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case PHA: {
-        mem_push_stack_8(cpu, cpu->ac);
-        break;
-    }
-    case PHP: {
-        // BREAK and UNUSED should be set to 1 when pushed
-        // src: https://www.masswerk.at/6502/6502_instruction_set.html#PHP
-        mem_push_stack_8(cpu, cpu->sr | BREAK | UNUSED);
-        break;
-    }
-    case PLA: {
-        cpu->ac = mem_pop_stack_8(cpu);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case PLP: {
-        // Pop all flags from the stack
-        // Except for BREAK and UNUSED as these should not be modified by the
-        // pop operation src:
-        // https://www.masswerk.at/6502/6502_instruction_set.html#PLP
-        cpu->sr = (cpu->sr & (BREAK | UNUSED)) | (mem_pop_stack_8(cpu) & ~(BREAK | UNUSED));
-        break;
-    }
-    case ROL: {
-        if (instruction.address_mode == ACC)
-            cpu->ac = rotate_left(cpu, cpu->ac);
-        else {
-            uint8_t m = mem_read_8(mem, cpu->address);
-            mem_write_8(mem, cpu->address, rotate_left(cpu, m));
-        }
-        break;
-    }
-    case ROR: {
-        if (instruction.address_mode == ACC)
-            cpu->ac = rotate_right(cpu, cpu->ac);
-        else {
-            uint8_t m = mem_read_8(mem, cpu->address);
-            mem_write_8(mem, cpu->address, rotate_right(cpu, m));
-        }
-        break;
-    }
-    case RTI: {
-        cpu->sr = (cpu->sr & (BREAK | UNUSED)) | (mem_pop_stack_8(cpu) & ~(BREAK | UNUSED));
-        cpu->pc = pop_stack_16(cpu);
-        break;
-    }
-    case RTS: {
-        // return the stored address and continue execution from the address
-        // after it
-        cpu->pc = pop_stack_16(cpu) + 1;
-        break;
-    }
-    case SBC: {
-        // Subtraction is addition of the two's complement of M
-        uint16_t A = cpu->ac;
-        uint16_t M = mem_read_8(mem, cpu->address);
-        uint16_t R = A + (M ^ 0xFF) + get_flag(cpu, CARRY);
-        cpu->ac = R & 0xFF;
-        set_flag(cpu, CARRY, R > 0xFF);
-        set_flag(cpu, OVERFLW, ((A ^ R) & (A ^ M) & 0x80) != 0);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case SEC: {
-        set_flag(cpu, CARRY, TRUE);
-        break;
-    }
-    case SED: {
-        set_flag(cpu, DECIMAL, TRUE);
-        break;
-    }
-    case SEI: {
-        set_flag(cpu, INTERRUPT, TRUE);
-        break;
-    }
-    case STA: {
-        mem_write_8(mem, cpu->address, cpu->ac);
-        break;
-    }
-    case STX: {
-        mem_write_8(mem, cpu->address, cpu->x);
-        break;
-    }
-    case STY: {
-        mem_write_8(mem, cpu->address, cpu->y);
-        break;
-    }
-    case TAX: {
-        cpu->x = cpu->ac;
-        set_ZN_flags(cpu, cpu->x);
-        break;
-    }
-    case TAY: {
-        cpu->y = cpu->ac;
-        set_ZN_flags(cpu, cpu->y);
-        break;
-    }
-    case TSX: {
-        cpu->x = cpu->sp;
-        set_ZN_flags(cpu, cpu->x);
-        break;
-    }
-    case TXA: {
-        cpu->ac = cpu->x;
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case TXS: {
-        cpu->sp = cpu->x;
-        break;
-    }
-    case TYA: {
-        cpu->ac = cpu->y;
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
+static inline void addr_ABX(CPU *cpu, Opcode opcode) { // Absolute, X-indexed
+    MEM *mem = &cpu->emulator->mem;
+    uint16_t base_address = mem_read_16(mem, cpu->pc);
+    cpu->address = base_address + cpu->x;
+    cpu->pc += 2;
 
-        // Illegal opcodes
-    case ALR: { // Illegal
-        // Perform AND
-        cpu->ac &= mem_read_8(mem, cpu->address);
-        cpu->ac = shift_right(cpu, cpu->ac);
-        break;
-    }
-    case ANC: { // Illegal
-        // Perform AND
-        uint8_t m = mem_read_8(mem, cpu->address);
-        cpu->ac &= m;
-        set_ZN_flags(cpu, cpu->ac);
-        set_flag(cpu, CARRY, cpu->ac & 0x80);
-        break;
-    }
-    case AN2: { // Illegal
-        // todo: implement AN2
-        printf("AN2");
-        exit(EXIT_FAILURE);
-        break;
-    }
-    case ANE: { // Illegal
-        // todo: implement ANE
-        printf("ANE");
-        exit(EXIT_FAILURE);
-        break;
-    }
-    case ARR: { // Illegal
-        uint8_t x = cpu->ac & mem_read_8(mem, cpu->address);
-        uint8_t rotated = rotate_right(cpu, x);
-        set_flag(cpu, CARRY, rotated & 0x40);
-        set_flag(cpu, OVERFLW, ((rotated & 0x40) >> 1) ^ (rotated & 0x20));
-        cpu->ac = rotated;
-        break;
-    }
-    case DCP: { // Illegal
-        // Perform DEC
-        uint8_t m = mem_read_8(mem, cpu->address);
-        m = (m - 1) & 0xFF;
-        mem_write_8(mem, cpu->address, m);
-        // Perform CMP
-        uint8_t a = cpu->ac;
-        set_flag(cpu, CARRY, a >= m);
-        set_ZN_flags(cpu, a - m);
-        break;
-    }
-    case ISB: { // Illegal
-        // Perform INC
-        uint8_t A = cpu->ac;
-        uint8_t M = mem_read_8(mem, cpu->address) + 1;
-        mem_write_8(mem, cpu->address, M);
-
-        // Perform SBC
-        uint16_t R = A + (M ^ 0xFF) + get_flag(cpu, CARRY);
-        cpu->ac = R & 0xFF;
-        set_flag(cpu, CARRY, R > 0xFF);
-        set_flag(cpu, OVERFLW, ((A ^ R) & (A ^ M) & 0x80) != 0);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
+    // If we cross page boundaries, we increment cur_cycle by 1.
+    if (crosses_page_borders_(base_address, cpu->address, opcode))
+        cpu->cycles++;
+}
 
-    case LAS: { // Illegal
-        // todo: implement LAS
-        printf("LAS");
-        exit(EXIT_FAILURE);
-        break;
-    }
-    case LAX: {                                  // Illegal
-        cpu->ac = mem_read_8(mem, cpu->address); // Perform LDA
-        cpu->x = cpu->ac;                        // Perform LDX
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case LXA: { // Illegal
-        // todo: implement LXA
-        printf("LXA");
-        exit(EXIT_FAILURE);
-        break;
-    }
-    case RLA: { // Illegal
-        // Perform ROL
+static inline void addr_ABY(CPU *cpu, Opcode opcode) { // Absolute, Y-indexed
+    MEM *mem = &cpu->emulator->mem;
+    uint16_t base_address = mem_read_16(mem, cpu->pc);
+    cpu->address = base_address + cpu->y;
+    cpu->pc += 2;
+
+    // If we cross page boundaries, we increment cur_cycle by 1.
+    if (crosses_page_borders_(base_address, cpu->address, opcode))
+        cpu->cycles++;
+}
+
+static inline void addr_IMM(CPU *cpu, Opcode opcode) { // Immediate
+    cpu->address = cpu->pc;
+    cpu->pc++;
+}
+
+static inline void addr_IMP(CPU *cpu, Opcode opcode) {} // Implied
+
+static inline void addr_IND(CPU *cpu, Opcode opcode) { // Indirect
+    MEM *mem = &cpu->emulator->mem;
+    uint16_t temp = mem_read_16(mem, cpu->pc);
+    uint16_t indirect_address = mem_read_8(mem, temp) | (mem_read_8(mem, (temp & 0xFF00) | ((temp + 1) & 0xFF)) << 8);
+    cpu->address = indirect_address;
+    cpu->pc += 2;
+}
+
+static inline void addr_XIN(CPU *cpu, Opcode opcode) { // X-indexed, Indirect (Pre-Indexed Indirect)
+    MEM *mem = &cpu->emulator->mem;
+    const uint8_t zp_address = (mem_read_8(mem, cpu->pc) + cpu->x) & 0xFF;
+    uint16_t base_address = mem_read_8(mem, zp_address) | (mem_read_8(mem, (zp_address + 1) & 0xFF) << 8);
+    cpu->address = base_address;
+    cpu->pc++;
+}
+
+static inline void addr_YIN(CPU *cpu, Opcode opcode) { // Indirect, Y-indexed (Post-Indexed Indirect)
+    MEM *mem = &cpu->emulator->mem;
+    const uint8_t zp_address = mem_read_8(mem, cpu->pc);
+    uint16_t base_address = mem_read_8(mem, zp_address) | (mem_read_8(mem, (zp_address + 1) & 0xFF) << 8);
+    cpu->address = base_address + cpu->y;
+    cpu->pc++;
+
+    // If we cross page boundaries, we increment cur_cycle by 1.
+    if (crosses_page_borders_(base_address, cpu->address, opcode))
+        cpu->cycles++;
+}
+
+static inline void addr_REL(CPU *cpu, Opcode opcode) { // Relative
+    MEM *mem = &cpu->emulator->mem;
+    int8_t offset = (int8_t)mem_read_8(mem, cpu->pc);
+    cpu->pc++;
+    cpu->address = cpu->pc + offset;
+}
+
+static inline void addr_ZP0(CPU *cpu, Opcode opcode) { // Zeropage
+    MEM *mem = &cpu->emulator->mem;
+    cpu->address = (uint16_t)mem_read_8(mem, cpu->pc);
+    cpu->pc++;
+}
+
+static inline void addr_ZPX(CPU *cpu, Opcode opcode) { // Zeropage, X-indexed
+    MEM *mem = &cpu->emulator->mem;
+    cpu->address = ((uint16_t)(mem_read_8(mem, cpu->pc) + cpu->x)) & 0xFF;
+    cpu->pc++;
+}
+
+static inline void addr_ZPY(CPU *cpu, Opcode opcode) { // Zeropage, Y-indexed
+    MEM *mem = &cpu->emulator->mem;
+    cpu->address = ((uint16_t)(mem_read_8(mem, cpu->pc) + cpu->y)) & 0xFF;
+    cpu->pc++;
+}
+
+static inline void addr_UNK(CPU *cpu, Opcode opcode) { // Unkown/Illegal
+    // printf("Unknown Addressing Mode at PC: 0x%04X\n", cpu->pc);
+    // exit(EXIT_FAILURE);
+}
+
+// --------------- OPERATIONS --------------------------------- //
+// Each of these executes one operation on the already resolved cpu->address.
+
+static inline void op_ADC(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    uint16_t A = cpu->ac;
+    uint16_t M = mem_read_8(mem, cpu->address);
+    uint16_t R = A + M + get_flag(cpu, CARRY);
+    cpu->ac = R & 0xFF;
+    set_flag(cpu, CARRY, R > 0xFF);
+    set_flag(cpu, OVERFLW, ((~(A ^ M) & (A ^ R) & 0x80) != 0));
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_AND(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    cpu->ac &= mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_ASL(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    if (mode == ACC) {
+        cpu->ac = shift_left(cpu, cpu->ac);
+    } else {
         uint8_t m = mem_read_8(mem, cpu->address);
-        uint8_t rotated = (m << 1) | get_flag(cpu, CARRY);
-        set_flag(cpu, CARRY, m & 0x80);
-        mem_write_8(mem, cpu->address, rotated);
-        // Perform AND
-        cpu->ac &= rotated;
-        set_ZN_flags(cpu, cpu->ac);
-        break;
+        mem_write_8(mem, cpu->address, m); // Dummy
+        mem_write_8(mem, cpu->address, shift_left(cpu, m));
     }
-    case RRA: { // Illegal
-        // Perform ROR
+}
+
+static inline void op_BCC(CPU *cpu, AddressMode mode) {
+    // Branch if Carry Clear (C flag = 0)
+    branch_if(cpu, !get_flag(cpu, CARRY));
+}
+
+static inline void op_BCS(CPU *cpu, AddressMode mode) {
+    // Branch if Carry Set (C flag = 1)
+    branch_if(cpu, get_flag(cpu, CARRY));
+}
+
+static inline void op_BEQ(CPU *cpu, AddressMode mode) {
+    // Branch if Zero Set (Z flag = 1)
+    branch_if(cpu, get_flag(cpu, ZERO));
+}
+
+static inline void op_BIT(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    uint8_t op = mem_read_8(mem, cpu->address);
+    set_flag(cpu, ZERO, (cpu->ac & op) == 0);
+    set_flag(cpu, NEGATIVE, op & 0x80);
+    set_flag(cpu, OVERFLW, op & 0x40);
+}
+
+static inline void op_BMI(CPU *cpu, AddressMode mode) {
+    // Branch if Negative Set (N flag = 1)
+    branch_if(cpu, get_flag(cpu, NEGATIVE));
+}
+
+static inline void op_BNE(CPU *cpu, AddressMode mode) {
+    // Branch if Zero Clear (Z flag = 0)
+    branch_if(cpu, !get_flag(cpu, ZERO));
+}
+
+static inline void op_BPL(CPU *cpu, AddressMode mode) {
+    // Branch if Negative Clear (N flag = 0)
+    branch_if(cpu, !get_flag(cpu, NEGATIVE));
+}
+
+static inline void op_BRK(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    cpu->pc++;
+    mem_push_stack_16(cpu, cpu->pc);
+    mem_push_stack_8(cpu, cpu->sr | BREAK | UNUSED);
+    cpu->pc = mem_read_16(mem, IRQ_VECTOR_OFFSET);
+    set_flag(cpu, INTERRUPT, TRUE);
+}
+
+static inline void op_BVC(CPU *cpu, AddressMode mode) {
+    // Branch if Overflow Clear (V flag = 0)
+    branch_if(cpu, !get_flag(cpu, OVERFLW));
+}
+
+static inline void op_BVS(CPU *cpu, AddressMode mode) {
+    // Branch if Overflow Set (V flag = 1)
+    branch_if(cpu, get_flag(cpu, OVERFLW));
+}
+
+static inline void op_CLC(CPU *cpu, AddressMode mode) {
+    set_flag(cpu, CARRY, FALSE);
+}
+
+static inline void op_CLD(CPU *cpu, AddressMode mode) {
+    set_flag(cpu, DECIMAL, FALSE);
+}
+
+static inline void op_CLI(CPU *cpu, AddressMode mode) {
+    set_flag(cpu, INTERRUPT, FALSE);
+}
+
+static inline void op_CLV(CPU *cpu, AddressMode mode) {
+    set_flag(cpu, OVERFLW, FALSE);
+}
+
+static inline void op_CMP(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    uint16_t a = cpu->ac;
+    uint16_t m = mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, (a - m) & 0xFF);
+    set_flag(cpu, CARRY, a >= m);
+}
+
+static inline void op_CPX(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    uint16_t x = cpu->x;
+    uint16_t m = mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, (x - m) & 0xFF);
+    set_flag(cpu, CARRY, x >= m);
+}
+
+static inline void op_CPY(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    uint16_t y = cpu->y;
+    uint16_t m = mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, (y - m) & 0xFF);
+    set_flag(cpu, CARRY, y >= m);
+}
+
+static inline void op_DEC(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    uint8_t decremented = mem_read_8(mem, cpu->address) - 1;
+    mem_write_8(mem, cpu->address, decremented);
+    set_ZN_flags(cpu, decremented);
+}
+
+static inline void op_DEX(CPU *cpu, AddressMode mode) {
+    cpu->x--;
+    set_ZN_flags(cpu, cpu->x);
+}
+
+static inline void op_DEY(CPU *cpu, AddressMode mode) {
+    cpu->y--;
+    set_ZN_flags(cpu, cpu->y);
+}
+
+static inline void op_EOR(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    cpu->ac ^= mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_INC(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    uint8_t incremented = mem_read_8(mem, cpu->address) + 1;
+    mem_write_8(mem, cpu->address, incremented);
+    set_ZN_flags(cpu, incremented);
+}
+
+static inline void op_INX(CPU *cpu, AddressMode mode) {
+    cpu->x++;
+    set_ZN_flags(cpu, cpu->x);
+}
+
+static inline void op_INY(CPU *cpu, AddressMode mode) {
+    cpu->y++;
+    set_ZN_flags(cpu, cpu->y);
+}
+
+static inline void op_JMP(CPU *cpu, AddressMode mode) {
+    cpu->pc = cpu->address;
+}
+
+static inline void op_JSR(CPU *cpu, AddressMode mode) {
+    // The return address should be (pc - 1) since the CPU will resume
+    // execution in the address immediately after the return address
+    mem_push_stack_16(cpu, cpu->pc - 1);
+    cpu->pc = cpu->address;
+}
+
+static inline void op_LDA(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    cpu->ac = mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_LDX(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    cpu->x = mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, cpu->x);
+}
+
+static inline void op_LDY(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    cpu->y = mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, cpu->y);
+}
+
+static inline void op_LSR(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    if (mode == ACC)
+        cpu->ac = shift_right(cpu, cpu->ac);
+    else {
         uint8_t m = mem_read_8(mem, cpu->address);
-        uint8_t rotated = (get_flag(cpu, CARRY) << 7) | (m >> 1);
-        mem_write_8(mem, cpu->address, rotated);
-        set_flag(cpu, CARRY, m & 0x01);
-        // Perform ADC
-        uint16_t a = cpu->ac;
-        uint16_t r = a + rotated + get_flag(cpu, CARRY);
-        cpu->ac = r & 0xFF;
-        set_flag(cpu, CARRY, r >= 0x100);
-        set_flag(cpu, OVERFLW, (~(a ^ rotated) & (a ^ r) & 0x80) != 0);
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case SAX: { // Illegal
-        mem_write_8(mem, cpu->address, cpu->ac & cpu->x);
-        break;
-    }
-    case SBX: { // Illegal
-        uint8_t operand = mem_read_8(mem, cpu->address);
-        uint16_t result = (cpu->ac & cpu->x) - operand;
-        cpu->x = result;
-        set_ZN_flags(cpu, cpu->x);
-        set_flag(cpu, CARRY, !(result & 0xFF00));
-        break;
-    }
-    case SHA: { // Illegal
-        // todo: implement SHA
-        printf("SHA");
-        exit(EXIT_FAILURE);
-        break;
-    }
-    case SHX: { // Illegal
-        uint8_t hi = cpu->address >> 8;
-        uint8_t lo = cpu->address & 0xff;
-        uint8_t temp = cpu->x & (hi + 1);
-        mem_write_8(mem, (temp << 8 | lo), temp);
-        break;
+        mem_write_8(mem, cpu->address, shift_right(cpu, m));
     }
-    case SHY: { // Illegal
-        uint8_t hi = cpu->address >> 8;
-        uint8_t lo = cpu->address & 0xff;
-        uint8_t temp = cpu->y & (hi + 1);
-        mem_write_8(mem, (temp << 8 | lo), temp);
-        break;
-    }
-    case SLO: { // Illegal
-        // Perform ASL
+}
+
+static inline void op_NOP(CPU *cpu, AddressMode mode) {
+    // Do nothing
+}
+
+static inline void op_ORA(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    cpu->ac |= mem_read_8(mem, cpu->address);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_PHA(CPU *cpu, AddressMode mode) {
+    mem_push_stack_8(cpu, cpu->ac);
+}
+
+static inline void op_PHP(CPU *cpu, AddressMode mode) {
+    // BREAK and UNUSED should be set to 1 when pushed
+    // src: https://www.masswerk.at/6502/6502_instruction_set.html#PHP
+    mem_push_stack_8(cpu, cpu->sr | BREAK | UNUSED);
+}
+
+static inline void op_PLA(CPU *cpu, AddressMode mode) {
+    cpu->ac = mem_pop_stack_8(cpu);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_PLP(CPU *cpu, AddressMode mode) {
+    // Pop all flags from the stack
+    // Except for BREAK and UNUSED as these should not be modified by the
+    // pop operation src:
+    // https://www.masswerk.at/6502/6502_instruction_set.html#PLP
+    cpu->sr = (cpu->sr & (BREAK | UNUSED)) | (mem_pop_stack_8(cpu) & ~(BREAK | UNUSED));
+}
+
+static inline void op_ROL(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    if (mode == ACC)
+        cpu->ac = rotate_left(cpu, cpu->ac);
+    else {
         uint8_t m = mem_read_8(mem, cpu->address);
-        set_flag(cpu, CARRY, m & 0x80);
-        uint8_t shifted = m << 1;
-        mem_write_8(mem, cpu->address, shifted);
-        // Perform ORA
-        cpu->ac |= shifted;
-        set_ZN_flags(cpu, cpu->ac);
-        break;
+        mem_write_8(mem, cpu->address, rotate_left(cpu, m));
     }
-    case SRE: { // Illegal
-        // Perform LSR
+}
+
+static inline void op_ROR(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    if (mode == ACC)
+        cpu->ac = rotate_right(cpu, cpu->ac);
+    else {
         uint8_t m = mem_read_8(mem, cpu->address);
-        set_flag(cpu, CARRY, m & 0x1);
-        uint8_t shifted = m >> 1;
-        mem_write_8(mem, cpu->address, shifted);
-        // Perform EOR
-        cpu->ac ^= shifted;
-        set_ZN_flags(cpu, cpu->ac);
-        break;
-    }
-    case TAS: { // Illegal
-        // todo: implement TAS
-        printf("TAS");
-        exit(EXIT_FAILURE);
-        break;
-    }
-    case UBC: { // Illegal
-        // todo: implement UBC
-        printf("UBC");
-        exit(EXIT_FAILURE);
-        break;
-    }
-    case JAM: { // Illegal
-        // todo: implement JAM
-        printf("JAM");
-        exit(EXIT_FAILURE);
-        break;
+        mem_write_8(mem, cpu->address, rotate_right(cpu, m));
     }
+}
+
+static inline void op_RTI(CPU *cpu, AddressMode mode) {
+    cpu->sr = (cpu->sr & (BREAK | UNUSED)) | (mem_pop_stack_8(cpu) & ~(BREAK | UNUSED));
+    cpu->pc = pop_stack_16(cpu);
+}
+
+static inline void op_RTS(CPU *cpu, AddressMode mode) {
+    // return the stored address and continue execution from the address
+    // after it
+    cpu->pc = pop_stack_16(cpu) + 1;
+}
+
+static inline void op_SBC(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    // Subtraction is addition of the two's complement of M
+    uint16_t A = cpu->ac;
+    uint16_t M = mem_read_8(mem, cpu->address);
+    uint16_t R = A + (M ^ 0xFF) + get_flag(cpu, CARRY);
+    cpu->ac = R & 0xFF;
+    set_flag(cpu, CARRY, R > 0xFF);
+    set_flag(cpu, OVERFLW, ((A ^ R) & (A ^ M) & 0x80) != 0);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_SEC(CPU *cpu, AddressMode mode) {
+    set_flag(cpu, CARRY, TRUE);
+}
+
+static inline void op_SED(CPU *cpu, AddressMode mode) {
+    set_flag(cpu, DECIMAL, TRUE);
+}
+
+static inline void op_SEI(CPU *cpu, AddressMode mode) {
+    set_flag(cpu, INTERRUPT, TRUE);
+}
+
+static inline void op_STA(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    mem_write_8(mem, cpu->address, cpu->ac);
+}
+
+static inline void op_STX(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    mem_write_8(mem, cpu->address, cpu->x);
+}
+
+static inline void op_STY(CPU *cpu, AddressMode mode) {
+    MEM *mem = &cpu->emulator->mem;
+    mem_write_8(mem, cpu->address, cpu->y);
+}
+
+static inline void op_TAX(CPU *cpu, AddressMode mode) {
+    cpu->x = cpu->ac;
+    set_ZN_flags(cpu, cpu->x);
+}
+
+static inline void op_TAY(CPU *cpu, AddressMode mode) {
+    cpu->y = cpu->ac;
+    set_ZN_flags(cpu, cpu->y);
+}
+
+static inline void op_TSX(CPU *cpu, AddressMode mode) {
+    cpu->x = cpu->sp;
+    set_ZN_flags(cpu, cpu->x);
+}
+
+static inline void op_TXA(CPU *cpu, AddressMode mode) {
+    cpu->ac = cpu->x;
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_TXS(CPU *cpu, AddressMode mode) {
+    cpu->sp = cpu->x;
+}
+
+static inline void op_TYA(CPU *cpu, AddressMode mode) {
+    cpu->ac = cpu->y;
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+// Illegal opcodes
+static inline void op_ALR(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform AND
+    cpu->ac &= mem_read_8(mem, cpu->address);
+    cpu->ac = shift_right(cpu, cpu->ac);
+}
+
+static inline void op_ANC(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform AND
+    uint8_t m = mem_read_8(mem, cpu->address);
+    cpu->ac &= m;
+    set_ZN_flags(cpu, cpu->ac);
+    set_flag(cpu, CARRY, cpu->ac & 0x80);
+}
+
+static inline void op_AN2(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement AN2
+    printf("AN2");
+    exit(EXIT_FAILURE);
+}
+
+static inline void op_ANE(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement ANE
+    printf("ANE");
+    exit(EXIT_FAILURE);
+}
+
+static inline void op_ARR(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    uint8_t x = cpu->ac & mem_read_8(mem, cpu->address);
+    uint8_t rotated = rotate_right(cpu, x);
+    set_flag(cpu, CARRY, rotated & 0x40);
+    set_flag(cpu, OVERFLW, ((rotated & 0x40) >> 1) ^ (rotated & 0x20));
+    cpu->ac = rotated;
+}
+
+static inline void op_DCP(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform DEC
+    uint8_t m = mem_read_8(mem, cpu->address);
+    m = (m - 1) & 0xFF;
+    mem_write_8(mem, cpu->address, m);
+    // Perform CMP
+    uint8_t a = cpu->ac;
+    set_flag(cpu, CARRY, a >= m);
+    set_ZN_flags(cpu, a - m);
+}
+
+static inline void op_ISB(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform INC
+    uint8_t A = cpu->ac;
+    uint8_t M = mem_read_8(mem, cpu->address) + 1;
+    mem_write_8(mem, cpu->address, M);
+
+    // Perform SBC
+    uint16_t R = A + (M ^ 0xFF) + get_flag(cpu, CARRY);
+    cpu->ac = R & 0xFF;
+    set_flag(cpu, CARRY, R > 0xFF);
+    set_flag(cpu, OVERFLW, ((A ^ R) & (A ^ M) & 0x80) != 0);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_LAS(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement LAS
+    printf("LAS");
+    exit(EXIT_FAILURE);
+}
+
+static inline void op_LAX(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    cpu->ac = mem_read_8(mem, cpu->address); // Perform LDA
+    cpu->x = cpu->ac;                        // Perform LDX
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_LXA(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement LXA
+    printf("LXA");
+    exit(EXIT_FAILURE);
+}
+
+static inline void op_RLA(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform ROL
+    uint8_t m = mem_read_8(mem, cpu->address);
+    uint8_t rotated = (m << 1) | get_flag(cpu, CARRY);
+    set_flag(cpu, CARRY, m & 0x80);
+    mem_write_8(mem, cpu->address, rotated);
+    // Perform AND
+    cpu->ac &= rotated;
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_RRA(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform ROR
+    uint8_t m = mem_read_8(mem, cpu->address);
+    uint8_t rotated = (get_flag(cpu, CARRY) << 7) | (m >> 1);
+    mem_write_8(mem, cpu->address, rotated);
+    set_flag(cpu, CARRY, m & 0x01);
+    // Perform ADC
+    uint16_t a = cpu->ac;
+    uint16_t r = a + rotated + get_flag(cpu, CARRY);
+    cpu->ac = r & 0xFF;
+    set_flag(cpu, CARRY, r >= 0x100);
+    set_flag(cpu, OVERFLW, (~(a ^ rotated) & (a ^ r) & 0x80) != 0);
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_SAX(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    mem_write_8(mem, cpu->address, cpu->ac & cpu->x);
+}
+
+static inline void op_SBX(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    uint8_t operand = mem_read_8(mem, cpu->address);
+    uint16_t result = (cpu->ac & cpu->x) - operand;
+    cpu->x = result;
+    set_ZN_flags(cpu, cpu->x);
+    set_flag(cpu, CARRY, !(result & 0xFF00));
+}
+
+static inline void op_SHA(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement SHA
+    printf("SHA");
+    exit(EXIT_FAILURE);
+}
+
+static inline void op_SHX(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    uint8_t hi = cpu->address >> 8;
+    uint8_t lo = cpu->address & 0xff;
+    uint8_t temp = cpu->x & (hi + 1);
+    mem_write_8(mem, (temp << 8 | lo), temp);
+}
+
+static inline void op_SHY(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    uint8_t hi = cpu->address >> 8;
+    uint8_t lo = cpu->address & 0xff;
+    uint8_t temp = cpu->y & (hi + 1);
+    mem_write_8(mem, (temp << 8 | lo), temp);
+}
+
+static inline void op_SLO(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform ASL
+    uint8_t m = mem_read_8(mem, cpu->address);
+    set_flag(cpu, CARRY, m & 0x80);
+    uint8_t shifted = m << 1;
+    mem_write_8(mem, cpu->address, shifted);
+    // Perform ORA
+    cpu->ac |= shifted;
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_SRE(CPU *cpu, AddressMode mode) { // Illegal
+    MEM *mem = &cpu->emulator->mem;
+    // Perform LSR
+    uint8_t m = mem_read_8(mem, cpu->address);
+    set_flag(cpu, CARRY, m & 0x1);
+    uint8_t shifted = m >> 1;
+    mem_write_8(mem, cpu->address, shifted);
+    // Perform EOR
+    cpu->ac ^= shifted;
+    set_ZN_flags(cpu, cpu->ac);
+}
+
+static inline void op_TAS(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement TAS
+    printf("TAS");
+    exit(EXIT_FAILURE);
+}
+
+static inline void op_UBC(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement UBC
+    printf("UBC");
+    exit(EXIT_FAILURE);
+}
+
+static inline void op_JAM(CPU *cpu, AddressMode mode) { // Illegal
+    // todo: implement JAM
+    printf("JAM");
+    exit(EXIT_FAILURE);
+}
+
+// --------------- DISPATCH ----------------------------------- //
+
+#ifdef CPU_SWITCH_DISPATCH
+
+// Legacy two-level dispatch: one switch on the opcode and one on the addressing mode
+static void execute_instruction(CPU *cpu, Instruction instruction) {
+    switch (instruction.opcode) {
+#define X(op)                                                                                                          \
+    case op: op_##op(cpu, instruction.address_mode); break;
+        OPCODE_LIST(X)
+#undef X
     }
 }
 
@@ -665,106 +885,53 @@ void execute_instruction(CPU *cpu, Instruction instruction) {
 // mode It also updates cpu->cur_cycle if an indirect addressing mode crosses a
 // page boundary
 static void set_address(CPU *cpu, Instruction instruction) {
-    MEM *mem = &cpu->emulator->mem;
-
     switch (instruction.address_mode) {
-    case ACC: { // Accumulator
-        break;
-    }
-    case ABS: { // Absolute
-        cpu->address = mem_read_16(mem, cpu->pc);
-        cpu->pc += 2;
-        break;
-    }
-    case ABX: { // Absolute, X-indexed
-        uint16_t base_address = mem_read_16(mem, cpu->pc);
-        cpu->address = base_address + cpu->x;
-        cpu->pc += 2;
-
-        // If we cross page boundaries, we increment cur_cycle by 1.
-        if (crosses_page_borders_(base_address, cpu->address, instruction.opcode))
-            cpu->cycles++;
-        break;
-    }
-    case ABY: { // Absolute, Y-indexed
-        uint16_t base_address = mem_read_16(mem, cpu->pc);
-        cpu->address = base_address + cpu->y;
-        cpu->pc += 2;
-
-        // If we cross page boundaries, we increment cur_cycle by 1.
-        if (crosses_page_borders_(base_address, cpu->address, instruction.opcode))
-            cpu->cycles++;
-        break;
-    }
-    case IMM: { // Immediate
-        cpu->address = cpu->pc;
-        cpu->pc++;
-        break;
-    }
-    case IMP: { // Implied
-        break;
-    }
-    case IND: { // Indirect
-        uint16_t temp = mem_read_16(mem, cpu->pc);
-        uint16_t indirect_address = mem_read_8(mem, temp) |
-                                    (mem_read_8(mem, (temp & 0xFF00) | ((temp + 1) & 0xFF)) << 8);
-        cpu->address = indirect_address;
-        cpu->pc += 2;
-        break;
-    }
-    case XIN: { // X-indexed, Indirect (Pre-Indexed Indirect)
-        const uint8_t zp_address = (mem_read_8(mem, cpu->pc) + cpu->x) & 0xFF;
-        uint16_t base_address = mem_read_8(mem, zp_address) | (mem_read_8(mem, (zp_address + 1) & 0xFF) << 8);
-        cpu->address = base_address;
-        cpu->pc++;
-        break;
-    }
-    case YIN: { // Indirect, Y-indexed (Post-Indexed Indirect)
-        const uint8_t zp_address = mem_read_8(mem, cpu->pc);
-        uint16_t base_address = mem_read_8(mem, zp_address) | (mem_read_8(mem, (zp_address + 1) & 0xFF) << 8);
-        cpu->address = base_address + cpu->y;
-        cpu->pc++;
-
-        // If we cross page boundaries, we increment cur_cycle by 1.
-        if (crosses_page_borders_(base_address, cpu->address, instruction.opcode))
-            cpu->cycles++;
-        break;
-    }
-    case REL: { // Relative
-        int8_t offset = (int8_t)mem_read_8(mem, cpu->pc);
-        cpu->pc++;
-        cpu->address = cpu->pc + offset;
-        break;
-    }
-    case ZP0: { // Zeropage
-        cpu->address = (uint16_t)mem_read_8(mem, cpu->pc);
-        cpu->pc++;
-        break;
-    }
-    case ZPX: { // Zeropage, X-indexed
-        cpu->address = ((uint16_t)(mem_read_8(mem, cpu->pc) + cpu->x)) & 0xFF;
-        cpu->pc++;
-        break;
-    }
-    case ZPY: { // Zeropage, Y-indexed
-        cpu->address = ((uint16_t)(mem_read_8(mem, cpu->pc) + cpu->y)) & 0xFF;
-        cpu->pc++;
-        break;
-    }
+    case ACC: addr_ACC(cpu, instruction.opcode); break;
+    case ABS: addr_ABS(cpu, instruction.opcode); break;
+    case ABX: addr_ABX(cpu, instruction.opcode); break;
+    case ABY: addr_ABY(cpu, instruction.opcode); break;
+    case IMM: addr_IMM(cpu, instruction.opcode); break;
+    case IMP: addr_IMP(cpu, instruction.opcode); break;
+    case IND: addr_IND(cpu, instruction.opcode); break;
+    case XIN: addr_XIN(cpu, instruction.opcode); break;
+    case YIN: addr_YIN(cpu, instruction.opcode); break;
+    case REL: addr_REL(cpu, instruction.opcode); break;
+    case ZP0: addr_ZP0(cpu, instruction.opcode); break;
+    case ZPX: addr_ZPX(cpu, instruction.opcode); break;
+    case ZPY: addr_ZPY(cpu, instruction.opcode); break;
     case UNK:
-    default: // Unkown/Illegal
-        // printf("Unknown Addressing Mode at PC: 0x%04X, Mode: %d\n", cpu->pc, instruction.address_mode);
-        // exit(EXIT_FAILURE);
-        break;
+    default: addr_UNK(cpu, instruction.opcode); break;
     }
 }
 
+#else
+
+// Pre-decoded dispatch: one handler per opcode byte, with the addressing mode and the operation
+// fused at compile time. The opcode and addressing mode are constants in each handler, so the
+// compiler inlines addr_* and op_* and folds away every branch on them.
+#define X(byte, op, mode, base_cycles)                                                                                 \
+    static void handler_##byte(CPU *cpu) {                                                                             \
+        cpu->cycles += base_cycles;                                                                                    \
+        addr_##mode(cpu, op);                                                                                          \
+        op_##op(cpu, mode);                                                                                            \
+    }
+OPCODE_TABLE(X)
+#undef X
+
+static void (*const handler_lookup[256])(CPU *cpu) = {
+#define X(byte, op, mode, base_cycles) handler_##byte,
+    OPCODE_TABLE(X)
+#undef X
+};
+
+#endif // CPU_SWITCH_DISPATCH
+
 void handle_nes_interrupt(CPU *cpu) {
     if (cpu->pending_interrupt == NONE)
         return;
 
+    // IRQs are level triggered, they stay pending until the interrupt flag is cleared or the devices release the line
     if (get_flag(cpu, INTERRUPT) && cpu->pending_interrupt != NMI) {
-        cpu->pending_interrupt = NONE;
         return;
     }
 
@@ -786,5 +953,122 @@ void handle_nes_interrupt(CPU *cpu) {
     set_flag(cpu, INTERRUPT, TRUE);
     cpu->pc = mem_read_16(mem, address);
     cpu->cycles += 7;
-    cpu->pending_interrupt = NONE;
-}
\ No newline at end of file
+    cpu->pending_interrupt = cpu->irq_lines ? IRQ : NONE; // taken again after RTI if the line is still held
+}
+
+// Longest loop body (in bytes, excluding the branch) that is checked for side effects
+#define IDLE_LOOP_MAX_BYTES 16
+
+// Called after the branch at `branch_pc` jumped back to cpu->pc. Skips the iterations of an idle
+// loop that can't change anything before the next PPU event, see IdleLoop.
+static void skip_idle_loop(CPU *cpu, uint16_t branch_pc) {
+    IdleLoop *loop = &cpu->idle_loop;
+    PPU *ppu = &cpu->emulator->ppu;
+
+    int same_iteration = loop->pc == cpu->pc && loop->branch_pc == branch_pc && loop->ac == cpu->ac &&
+                         loop->x == cpu->x && loop->y == cpu->y && loop->sr == cpu->sr && loop->sp == cpu->sp;
+    size_t cycles = cpu->total_cycles - loop->total_cycles;
+    size_t instructions = cpu->total_instructions - loop->total_instructions;
+
+    loop->pc = cpu->pc;
+    loop->branch_pc = branch_pc;
+    loop->ac = cpu->ac;
+    loop->x = cpu->x;
+    loop->y = cpu->y;
+    loop->sr = cpu->sr;
+    loop->sp = cpu->sp;
+    loop->total_cycles = cpu->total_cycles;
+    loop->total_instructions = cpu->total_instructions;
+
+    // Don't skip past the end of the frame, emulator_run_frame stops at the instruction that completed it
+    if (!same_iteration || cpu->pending_interrupt != NONE || ppu->frame_complete)
+        return;
+
+    // The previous iteration must have run straight through the body, without an interrupt
+    uint8_t reads_ppu_status;
+    if (instructions != check_idle_loop(cpu, branch_pc, &reads_ppu_status))
+        return;
+
+    // Every iteration is now the same until the PPU raises an NMI, completes the frame or changes PPUSTATUS
+    size_t dots_left = ppu->next_event_dots - ppu->pending_dots;
+    if (reads_ppu_status) {
+        // PPUSTATUS must not have changed since the reads of the previous iteration either
+        size_t dots_until_status_change = ppu_dots_until_status_change(ppu, 3 * cycles);
+        if (dots_until_status_change < dots_left)
+            dots_left = dots_until_status_change;
+    }
+    if (dots_left == 0)
+        return;
+
+    size_t iterations = (dots_left - 1) / (3 * cycles);
+
+    // Nor past an IRQ of the APU
+    size_t apu_irq_cycle = cpu->emulator->apu.next_irq_cycle;
+    if (apu_irq_cycle != APU_NO_IRQ) {
+        size_t apu_iterations = apu_irq_cycle > cpu->total_cycles ? (apu_irq_cycle - cpu->total_cycles) / cycles : 0;
+        if (apu_iterations < iterations)
+            iterations = apu_iterations;
+    }
+    if (iterations == 0)
+        return;
+
+    cpu->total_cycles += iterations * cycles;
+    cpu->total_instructions += iterations * instructions;
+    loop->total_cycles = cpu->total_cycles;
+    loop->total_instructions = cpu->total_instructions;
+#ifdef HOTSPOT_PROFILER
+    debug_hotspot_record(cpu->pc, iterations * instructions, iterations * cycles);
+#endif
+    ppu_advance(ppu, iterations * cycles); // stays below the next event, so the PPU isn't run yet
+}
+
+// Returns the number of instructions of the loop from cpu->pc to the branch at `branch_pc`,
+// or 0 if its body can have side effects. Only loads, compares and logic operations on
+// immediates, the zeropage and absolute addresses without side effects are allowed.
+static uint8_t check_idle_loop(const CPU *cpu, uint16_t branch_pc, uint8_t *reads_ppu_status) {
+    const MEM *mem = &cpu->emulator->mem;
+    uint16_t pc = cpu->pc;
+    uint8_t instruction_count = 1; // the branch
+    *reads_ppu_status = FALSE;
+
+    if (branch_pc - pc > IDLE_LOOP_MAX_BYTES)
+        return 0;
+
+    while (pc < branch_pc) {
+        Instruction instruction = instruction_lookup[mem_const_read_8(mem, pc)];
+        // clang-format off
+        switch (instruction.opcode) {
+        case LDA: case LDX: case LDY: case BIT: case CMP: case CPX: case CPY: case AND: case ORA: case EOR:
+            break;
+        default:
+            return 0;
+        }
+        // clang-format on
+
+        switch (instruction.address_mode) {
+        case IMM:
+        case ZP0:
+            pc += 2;
+            break;
+        case ABS: {
+            uint16_t address = (mem_const_read_8(mem, pc + 2) << 8) | mem_const_read_8(mem, pc + 1);
+            if (address >= RAM_MIRROR_END && address < PPU_MIRROR_END && (address & 0x0007) == 0x0002) {
+                *reads_ppu_status = TRUE; // only clears vblank and the write latch, which are already clear
+            } else if (address >= RAM_MIRROR_END && address < APU_IO_REGISTER_END) {
+                return 0; // the other PPU registers and the APU/IO registers have side effects
+            }
+            pc += 3;
+            break;
+        }
+        default:
+            return 0;
+        }
+        instruction_count++;
+    }
+
+    Instruction branch = instruction_lookup[mem_const_read_8(mem, branch_pc)];
+    if (pc != branch_pc || !(branch.address_mode == REL || (branch.opcode == JMP && branch.address_mode == ABS)))
+        return 0;
+
+    return instruction_count;
+}
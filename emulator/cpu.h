@@ -5,6 +5,8 @@
 
 // forward declarations
 typedef struct Emulator Emulator;
+typedef struct StateWriter StateWriter;
+typedef struct StateReader StateReader;
 
 typedef enum Interrupt {
     NONE,
@@ -25,8 +27,31 @@ typedef enum CPUFlag {
     OVERFLW    = (1 << 6),
     NEGATIVE   = (1 << 7),
 } CPUFlag;
+
+// Devices that can hold the IRQ line, see `cpu_set_irq_line`
+typedef enum IRQSource {
+    IRQ_SOURCE_FRAME_COUNTER = (1 << 0), // APU frame counter
+    IRQ_SOURCE_DMC           = (1 << 1), // APU DMC channel, end of sample
+    IRQ_SOURCE_MAPPER        = (1 << 2), // e.g. the MMC3 scanline counter
+} IRQSource;
 // clang-format on
 
+/**
+ *  The loop the CPU jumped back to most recently, used to detect idle loops.
+ *
+ *  An idle loop is a short loop that only reads RAM, ROM or PPUSTATUS and ends with a
+ *  backward branch (or a JMP to itself), e.g. LDA $2002 / BPL or JMP *. If an iteration
+ *  leaves the registers unchanged, every following iteration will do exactly the same
+ *  until an interrupt or a PPU status change, so they can be skipped.
+ */
+typedef struct IdleLoop {
+    uint16_t pc;        // first instruction of the loop
+    uint16_t branch_pc; // the branch that jumps back to `pc`
+    uint8_t ac, x, y, sr, sp;  // registers at the start of the previous iteration
+    size_t total_cycles;       // cpu->total_cycles at the start of the previous iteration
+    size_t total_instructions; // cpu->total_instructions at the start of the previous iteration
+} IdleLoop;
+
 typedef struct CPU {
     uint16_t pc;      // program counter
     uint16_t address; // addressing mode address (set before executing each instruction)
@@ -35,10 +60,15 @@ typedef struct CPU {
     uint8_t y;        // y register
     uint8_t sr;       // status register [NV-BDIZC]
     uint8_t sp;       // stack pointer (wraps)
-    size_t total_cycles;
-    size_t cycles;
-    size_t dma_cycles;
+    size_t total_cycles; // cycles since power on (including DMA stalls)
+    size_t total_instructions;
+    size_t cycles;       // cycles of the instruction currently being executed
+    size_t dma_cycles;   // OAM DMA stall cycles added by the current instruction
     Interrupt pending_interrupt;
+    uint8_t irq_lines; // IRQSource bits of the devices that currently hold the IRQ line
+
+    uint8_t skip_idle_loops; // fast-forwards idle loops to the next PPU event, see IdleLoop
+    IdleLoop idle_loop;
 
     // References to other devices
     Emulator *emulator;
@@ -54,12 +84,14 @@ typedef struct CPU {
 void cpu_init(Emulator *emulator);
 
 /**
- *  Executes a single CPU cycle.
+ *  Executes a single CPU instruction, including any pending interrupt.
  *
- *  In this emulator, full instruction execution occurs in the first cycle,
- *  as it is not cycle-accurate. The remaining cycles for the instruction are idle.
+ *  The instruction is executed in one go, as this emulator is not cycle-accurate.
+ *  The PPU is not stepped alongside the CPU. Instead the elapsed cycles are handed
+ *  to the PPU scheduler (see `ppu_advance`), which only catches the PPU up when the
+ *  CPU touches a PPU register or when a PPU event (vblank/NMI, end of frame) is due.
  */
-void cpu_run_cycle(CPU *cpu);
+void cpu_run_instruction(CPU *cpu);
 
 /**
  *  Signals to the CPU to interrupt execution.
@@ -71,12 +103,32 @@ void cpu_run_cycle(CPU *cpu);
  *
  *  1. NMI (non maskable interrupt) - sent by the PPU at the start of vBlank.
  *       Can not be ignored by the CPU.
- *  2. IRQ (interrupt request) - sent by external devices.
- *       Can be ignored by the CPU if the status register has the INTERRUPT flag set to 1.
+ *  2. IRQ (interrupt request) - sent by external devices through `cpu_set_irq_line`.
+ *       Is held back while the status register has the INTERRUPT flag set to 1.
  *  3. RSI (reset interrupt) - resets the system.
  */
 void cpu_set_interrupt(CPU *cpu, Interrupt interrupt);
 
+/**
+ *  Raises (`active` = 1) or releases the IRQ line of `source`.
+ *
+ *  The IRQ is level triggered: it stays pending, and is taken again after RTI, as long as any
+ *  device holds the line. A device acknowledges its IRQ by releasing its line.
+ */
+void cpu_set_irq_line(CPU *cpu, IRQSource source, int active);
+
+/**
+ *  Writes the registers, cycle counters and pending interrupt to a save state chunk.
+ *
+ */
+void cpu_save_state(const CPU *cpu, StateWriter *writer);
+
+/**
+ *  Reads a chunk written by `cpu_save_state`.
+ *
+ */
+void cpu_load_state(CPU *cpu, StateReader *reader);
+
 #undef CPU_MEM_SIZE
 
 #endif
@@ -1,16 +1,35 @@
 #include "emulator.h"
 #include "timer.h"
+#include "profiler.h"
+#include "savestate.h"
 
 #define NTSC_FRAME_RATE 60
 #define NTSC_CPU_CYCLES_PER_FRAME 29780
+#define FNV_OFFSET_BASIS 2166136261u
+#define AUDIO_TARGET_LATENCY_US 40000   // audio queued in the ring between two frames
+#define AUDIO_MAX_RATE_ADJUSTMENT 0.005 // inaudible, but a lot more than the drift between the clocks
+#define MAX_LAG_US (4 * NTSC_FRAME_DURATION) // longer stalls (e.g. moving the window) aren't made up for
+#define LATE_FRAME_TOLERANCE_US 1000         // vsync and the audio callback don't return on the microsecond
+#define FAST_FORWARD_INTERVAL 4              // frames per frame shown while fast-forwarding
 
 // --------------- STATIC FORWARD DECLARATIONS ---------------- //
 static void synchronize_frames(Emulator *emulator);
+static void update_frame_skip(Emulator *emulator, int behind);
+#if !defined(RISC_V) && !defined(HEADLESS)
+void handle_sdl(Emulator *emulator);
 static uint32_t calculate_unsynced_fps(Emulator *emulator);
 static uint32_t calculate_synced_fps(Emulator *emulator);
+static void wait_for_audio(Emulator *emulator, size_t target);
+static void adjust_audio_rate(Emulator *emulator, size_t target);
+static int fast_forwarding(const Emulator *emulator);
+#endif
+static void run_frame(Emulator *emulator);
 #ifndef RISC_V
-void handle_sdl(Emulator *emulator);
+static void run_ahead(Emulator *emulator);
+static size_t save_rollback_state(Emulator *emulator);
+static void load_rollback_state(Emulator *emulator, size_t size);
 #endif
+static uint32_t fnv1a(const uint8_t *data, size_t size, uint32_t hash);
 
 // --------------- PUBLIC FUNCTIONS ---------- ---------------- //
 void emulator_init(Emulator *emulator, uint8_t *rom) {
@@ -19,46 +38,104 @@ void emulator_init(Emulator *emulator, uint8_t *rom) {
 
     // Set the internal state
     emulator->event = 0;
+    emulator->controller_input = 0;
     emulator->is_running = FALSE;
     emulator->cur_frame = 0;
     emulator->time_point_start = 0;
+    emulator->rewind = NULL;
+    emulator->pacing = PACING_TIMER;
+    emulator->skip_output = FALSE;
+    emulator->max_frame_skip = 0;
+    emulator->frames_skipped = 0;
+    emulator->lag_us = 0;
+#ifndef RISC_V
+    emulator->input = NULL;
+    emulator->hash_log = NULL;
+    emulator->run_ahead = 0;
+    emulator->run_ahead_state = NULL;
+#endif
+    emulator->audio_fill_average = 0;
     memset(emulator->frame_times, 0, sizeof(emulator->frame_times));
 
     // Initialize components.
     ppu_init(emulator);
+    apu_init(emulator);
     init_cpu_mem(emulator);
     mapper_init(emulator);
     cpu_init(emulator);
+
+    Mapper *mapper = &emulator->mapper;
+    emulator->rom_checksum = fnv1a(mapper->prg_rom, mapper->prg_rom_size * 0x4000, FNV_OFFSET_BASIS);
+    if (mapper->chr_rom_size > 0) {
+        emulator->rom_checksum = fnv1a(mapper->chr_rom, mapper->chr_rom_size * 0x2000, emulator->rom_checksum);
+    }
 }
 
 void emulator_run(Emulator *emulator) {
     emulator->is_running = TRUE;
-    CPU *cpu = &emulator->cpu;
-    PPU *ppu = &emulator->ppu;
 
     // Frame loop
     while (emulator->is_running) {
 
         emulator->time_point_start = get_time_point();
 
-        do {
-            ppu_run_cycle(ppu);
-            ppu_run_cycle(ppu);
-            ppu_run_cycle(ppu);
-            cpu_run_cycle(cpu);
-        } while (!ppu->frame_complete);
+#if !defined(RISC_V) && !defined(HEADLESS)
+        // The framebuffer isn't part of the snapshots, the frame after it redraws it
+        int rewinding = emulator->rewind && sdl_rewind_held();
+        if (rewinding) {
+            rewind_step_back(emulator->rewind, emulator);
+        }
+#endif
+
+        emulator_run_frame(emulator);
 
-        ppu->frame_complete = 0;
-        cpu->total_cycles = 0;
+#if !defined(RISC_V) && !defined(HEADLESS)
+        if (emulator->rewind && !rewinding) {
+            rewind_record_frame(emulator->rewind, emulator);
+        }
+#endif
 
-#ifndef RISC_V
+#ifdef RISC_V
+        if (!emulator->skip_output) {
+            PROFILE_BEGIN(PROFILE_PRESENT);
+            uint8_t palette[0x40];
+            ppu_build_8bit_palette(&emulator->ppu, palette);
+            vga_screen_draw_frame(emulator->ppu.framebuffer, NES_SCREEN_WIDTH, VISIBLE_SCANLINES, palette);
+            PROFILE_END(PROFILE_PRESENT);
+        }
+#elif !defined(HEADLESS)
         handle_sdl(emulator);
 #endif
 
+#ifdef PROFILER
+        profiler_end_frame();
+#endif
+
         synchronize_frames(emulator);
     }
 }
 
+void emulator_run_frame(Emulator *emulator) {
+    emulator->ppu.skip_rendering = emulator->skip_output;
+#ifdef RISC_V
+    run_frame(emulator);
+#else
+    if (emulator->input) {
+        emulator->controller_input = emulator->input->read(emulator->input);
+    }
+
+    if (emulator->run_ahead > 0 && emulator->run_ahead_state) {
+        run_ahead(emulator);
+    } else {
+        run_frame(emulator);
+    }
+
+    if (emulator->hash_log) {
+        frame_hash_log_add(emulator->hash_log, emulator_frame_hash(emulator));
+    }
+#endif
+}
+
 #define NESTEST_MAX_CYCLES 26554
 #define NESTEST_START_CYCLE 7
 
@@ -70,6 +147,7 @@ void emulator_nestest(Emulator *emulator) {
     MEM *mem = &emulator->mem;
     cpu->pc = 0xC000;
     ppu->cur_dot = 18;
+    ppu_catch_up(ppu); // Reschedules the next PPU event for the new dot
 
     // These APU registers needs to be set to 0xFF at the start in order for
     // nestest to complete
@@ -80,37 +158,180 @@ void emulator_nestest(Emulator *emulator) {
     mem_write_8(mem, 0x4015, 0xFF);
 
     do {
-        ppu_run_cycle(ppu);
-        ppu_run_cycle(ppu);
-        ppu_run_cycle(ppu);
-        cpu_run_cycle(cpu);
+        cpu_run_instruction(cpu);
     } while (cpu->total_cycles <= NESTEST_MAX_CYCLES);
 }
 
+#ifndef RISC_V
+void emulator_run_headless(Emulator *emulator, uint32_t frame_count) {
+    CPU *cpu = &emulator->cpu;
+    size_t start_cycles = cpu->total_cycles;
+    size_t start_instructions = cpu->total_instructions;
+    uint32_t time_point_start = get_time_point();
+
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+        emulator_run_frame(emulator);
+#ifdef PROFILER
+        profiler_end_frame();
+#endif
+
+        emulator->cur_frame++;
+        if (emulator->cur_frame == NTSC_FRAME_RATE) {
+            emulator->cur_frame = 0;
+        }
+    }
+
+    double seconds = get_elapsed_us(time_point_start, get_time_point()) / 1e6;
+    double instructions = cpu->total_instructions - start_instructions;
+    double dots = 3.0 * (cpu->total_cycles - start_cycles); // the PPU runs 3 dots per CPU cycle
+
+    printf("Frames:                      %u\n", frame_count);
+    printf("Wall time:                   %.3f s\n", seconds);
+    printf("Frames per second:           %.1f\n", frame_count / seconds);
+    printf("Time per frame:              %.1f us", seconds * 1e6 / frame_count);
+    if (emulator->run_ahead > 0 && emulator->run_ahead_state) {
+        printf(" (run-ahead: %u)", emulator->run_ahead);
+    }
+    printf("\n");
+    printf("CPU instructions per second: %.0f\n", instructions / seconds);
+    printf("PPU dots per second:         %.0f\n", dots / seconds);
+}
+
+uint32_t emulator_frame_hash(const Emulator *emulator) {
+    return fnv1a(emulator->ppu.framebuffer, sizeof(emulator->ppu.framebuffer), FNV_OFFSET_BASIS);
+}
+
+int emulator_compare_renderers(uint8_t *rom, uint32_t frame_count) {
+    static Emulator dot_emulator, scanline_emulator;
+    emulator_init(&dot_emulator, rom);
+    emulator_init(&scanline_emulator, rom);
+    dot_emulator.ppu.scanline_renderer = FALSE;
+    scanline_emulator.ppu.scanline_renderer = TRUE;
+
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+        emulator_run_frame(&dot_emulator);
+        emulator_run_frame(&scanline_emulator);
+        uint32_t dot_hash = emulator_frame_hash(&dot_emulator);
+        uint32_t scanline_hash = emulator_frame_hash(&scanline_emulator);
+
+        if (dot_hash != scanline_hash) {
+            printf("Frame %u differs: dot renderer %08X, scanline renderer %08X\n", frame, dot_hash, scanline_hash);
+            return -1;
+        }
+        // Catches IRQs of the mapper (A12 clocks) that arrive at another time
+        if (dot_emulator.cpu.total_cycles != scanline_emulator.cpu.total_cycles) {
+            printf("Frame %u differs: dot renderer ends at CPU cycle %zu, scanline renderer at %zu\n", frame,
+                   dot_emulator.cpu.total_cycles, scanline_emulator.cpu.total_cycles);
+            return -1;
+        }
+
+        dot_emulator.cur_frame = scanline_emulator.cur_frame = (frame + 1) % NTSC_FRAME_RATE;
+    }
+
+    printf("%u frames identical\n", frame_count);
+    return 0;
+}
+#endif
+
 // --------------- STATIC FUNCTIONS --------------------------- //
 
+static void run_frame(Emulator *emulator) {
+    CPU *cpu = &emulator->cpu;
+    PPU *ppu = &emulator->ppu;
+
+    // The PPU is run lazily by the CPU, see `ppu_advance`
+    PROFILE_BEGIN(PROFILE_CPU);
+    do {
+        cpu_run_instruction(cpu);
+    } while (!ppu->frame_complete);
+    PROFILE_END(PROFILE_CPU);
+
+    apu_end_frame(&emulator->apu);
+    ppu->frame_complete = 0;
+}
+
 #ifndef RISC_V
-void handle_sdl(Emulator *emulator) {
-    // emulator->controller_input = sdl_poll_events();
+// See emulator_run_frame. The frames ahead synthesize no audio, the APU keeps the samples of the real frame
+// when the state is loaded with its output off, and the framebuffer isn't part of the saved state.
+static void run_ahead(Emulator *emulator) {
+    PPU *ppu = &emulator->ppu;
+    APU *apu = &emulator->apu;
 
-    sdl_draw_frame();
-    if (sdl_window_quit())
-        emulator->is_running = FALSE;
+    ppu->skip_rendering = TRUE;
+    run_frame(emulator);
+    size_t state_size = save_rollback_state(emulator);
 
-    // Clear screen and draw debug info only every 10th frame.
-    // Otherwise the rendering gets too intensive
-    if (emulator->cur_frame % 10 == 0) {
-        sdl_clear_screen();
-        debug_draw_screen(emulator);
+    uint32_t sample_rate = apu->sample_rate;
+    uint32_t cur_frame = emulator->cur_frame;
+    apu->sample_rate = 0;
+    for (uint8_t frame = 1; frame <= emulator->run_ahead; frame++) {
+        // The frame loop counts the frames after emulator_run_frame, the PPU needs it for the odd frames
+        emulator->cur_frame = (cur_frame + frame) % NTSC_FRAME_RATE;
+        ppu->skip_rendering = frame < emulator->run_ahead || emulator->skip_output;
+        run_frame(emulator);
     }
 
+    load_rollback_state(emulator, state_size); // also restores cur_frame
+    apu->sample_rate = sample_rate;
+}
+
+static size_t save_rollback_state(Emulator *emulator) {
+    PROFILE_BEGIN(PROFILE_ROLLBACK);
+    size_t size = emulator_save_state_without_frame(emulator, emulator->run_ahead_state, SAVE_STATE_MAX_SIZE);
+    PROFILE_END(PROFILE_ROLLBACK);
+    if (size == 0) {
+        printf("Fatal Error: The state doesn't fit into the run-ahead buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    return size;
+}
+
+static void load_rollback_state(Emulator *emulator, size_t size) {
+    PROFILE_BEGIN(PROFILE_ROLLBACK);
+    int result = emulator_load_state(emulator, emulator->run_ahead_state, size);
+    PROFILE_END(PROFILE_ROLLBACK);
+    if (result != 0) {
+        printf("Fatal Error: Failed to roll back after running ahead\n");
+        exit(EXIT_FAILURE);
+    }
+}
+#endif
+
+#if !defined(RISC_V) && !defined(HEADLESS)
+void handle_sdl(Emulator *emulator) {
+    // Fast-forwarded audio would only overflow the ring, it is dropped instead
+    static int16_t samples[BLIP_BUFFER_SIZE];
+    size_t sample_count = apu_read_samples(&emulator->apu, samples, BLIP_BUFFER_SIZE);
+    if (!fast_forwarding(emulator)) {
+        sdl_queue_audio(samples, sample_count);
+    }
+
+    // The FPS are calculated once a second, every frame carries the latest to the window title
+    static char title[RENDER_TITLE_SIZE] = SDL_WINDOW_TITLE;
     if (emulator->cur_frame == 0) {
         uint32_t fps_synced = calculate_synced_fps(emulator);
         uint32_t fps_unsynced = calculate_unsynced_fps(emulator);
-        char title[256];
         snprintf(title, sizeof(title), "NES Emulator - FPS: %u - UNSYNCED FPS: %u", fps_synced, fps_unsynced);
-        sdl_set_window_title(title);
     }
+
+    // The frame is copied for the render thread, which draws and presents it while the next one is emulated
+    if (!emulator->skip_output) {
+        RenderFrame *frame = render_thread_back_frame();
+
+        // The render thread only redraws what changed in the debug screen, so it is kept up to date every frame
+        PROFILE_BEGIN(PROFILE_DEBUG_SCREEN);
+        debug_take_snapshot(emulator, &frame->debug);
+        PROFILE_END(PROFILE_DEBUG_SCREEN);
+
+        PROFILE_BEGIN(PROFILE_PRESENT);
+        memcpy(frame->framebuffer, emulator->ppu.framebuffer, sizeof(frame->framebuffer));
+        ppu_build_rgb_palette(&emulator->ppu, frame->palette);
+        memcpy(frame->title, title, sizeof(frame->title));
+        render_thread_publish();
+        PROFILE_END(PROFILE_PRESENT);
+    }
+    if (sdl_window_quit())
+        emulator->is_running = FALSE;
 }
 #endif
 
@@ -124,14 +345,96 @@ void synchronize_frames(Emulator *emulator) {
         emulator->cur_frame = 0;
     }
 
-    // Sleep if the frame finished early
-    if (elapsed_us < NTSC_FRAME_DURATION) {
-        sleep_us(NTSC_FRAME_DURATION - elapsed_us);
+#if !defined(RISC_V) && !defined(HEADLESS)
+    if (fast_forwarding(emulator)) {
+        emulator->skip_output = emulator->cur_frame % FAST_FORWARD_INTERVAL != 0;
+        emulator->frames_skipped = 0;
+        emulator->lag_us = 0;
+        return;
+    }
+
+    uint32_t sample_rate = emulator->apu.sample_rate;
+    size_t target = (size_t)sample_rate * AUDIO_TARGET_LATENCY_US / 1000000;
+    if (emulator->pacing == PACING_AUDIO && sample_rate) {
+        wait_for_audio(emulator, target);
+    }
+    if (sample_rate) {
+        adjust_audio_rate(emulator, target);
+    }
+    // Paced by the audio device or the display instead. Behind means the ring is running dry, or vblank was missed.
+    if (emulator->pacing == PACING_AUDIO) {
+        update_frame_skip(emulator, sdl_audio_buffered() < target / 2);
+        return;
+    }
+    // The render thread presents one frame per vblank, the next frame is emulated while it is on the screen.
+    // Skipped frames aren't presented, so they aren't waited for.
+    if (emulator->pacing == PACING_VSYNC) {
+        if (!emulator->skip_output) {
+            render_thread_wait_presented(4 * NTSC_FRAME_DURATION / 1000);
+        }
+        uint32_t frame_period_us = get_elapsed_us(emulator->time_point_start, get_time_point());
+        update_frame_skip(emulator, frame_period_us > NTSC_FRAME_DURATION + LATE_FRAME_TOLERANCE_US);
+        return;
+    }
+#endif
+
+    // Sleep if the frame finished early, less by the time earlier frames were late
+    int32_t lag_us = emulator->lag_us + (int32_t)elapsed_us - NTSC_FRAME_DURATION;
+    if (lag_us < 0) {
+        sleep_us((uint32_t)-lag_us);
+        lag_us = 0;
+    }
+    emulator->lag_us = lag_us < MAX_LAG_US ? lag_us : MAX_LAG_US;
+    update_frame_skip(emulator, emulator->lag_us > LATE_FRAME_TOLERANCE_US);
+}
+
+// Skips the next frame while the emulation is behind, but shows at least every (max_frame_skip + 1)-th frame
+static void update_frame_skip(Emulator *emulator, int behind) {
+    if (behind && emulator->frames_skipped < emulator->max_frame_skip) {
+        emulator->skip_output = TRUE;
+        emulator->frames_skipped++;
     } else {
-        // TODO: Handle lag - consider skipping next frame
+        emulator->skip_output = FALSE;
+        emulator->frames_skipped = 0;
+    }
+}
+
+#if !defined(RISC_V) && !defined(HEADLESS)
+// Sleeps until the audio device has played the samples above `target`. Gives up after a few frames,
+// in case the device stopped pulling samples. The callback takes the samples out in blocks, so the
+// ring can stay above the target for a while after the expected time; that is waited out in steps of
+// at least a millisecond rather than spun on.
+static void wait_for_audio(Emulator *emulator, size_t target) {
+    uint32_t sample_rate = emulator->apu.sample_rate;
+    uint32_t waited_us = 0;
+    size_t fill;
+
+    while ((fill = sdl_audio_buffered()) > target && waited_us < 4 * NTSC_FRAME_DURATION) {
+        uint32_t duration_us = (uint32_t)((uint64_t)(fill - target) * 1000000 / sample_rate);
+        if (duration_us < 1000)
+            duration_us = 1000;
+        sleep_us(duration_us);
+        waited_us += duration_us;
     }
 }
 
+// The frames fast-forwarded over aren't drawn, so there is no fast-forward while frame hashes are logged
+static int fast_forwarding(const Emulator *emulator) { return sdl_fast_forward_held() && !emulator->hash_log; }
+
+// Synthesizes up to AUDIO_MAX_RATE_ADJUSTMENT more samples while the ring is below `target`, and fewer while it
+// is above. The average keeps the adjustment from following the blocks the audio callback takes out at once.
+static void adjust_audio_rate(Emulator *emulator, size_t target) {
+    int32_t fill = (int32_t)sdl_audio_buffered();
+    emulator->audio_fill_average += (fill - emulator->audio_fill_average) / 8;
+
+    double error = (double)((int32_t)target - emulator->audio_fill_average) / (double)target;
+    if (error > 1.0)
+        error = 1.0;
+    if (error < -1.0)
+        error = -1.0;
+    apu_set_rate_adjustment(&emulator->apu, 1.0 + AUDIO_MAX_RATE_ADJUSTMENT * error);
+}
+
 uint32_t calculate_unsynced_fps(Emulator *emulator) {
     double sum = 0;
     for (int i = 0; i < NTSC_FRAME_RATE; i++) {
@@ -144,15 +447,27 @@ uint32_t calculate_unsynced_fps(Emulator *emulator) {
     return (uint32_t)(1 / average_frame_duration);
 }
 
+// Late frames are made up for by the frames after them (see synchronize_frames), so only the average counts
 uint32_t calculate_synced_fps(Emulator *emulator) {
     double sum = 0;
     for (int i = 0; i < NTSC_FRAME_RATE; i++) {
-        uint32_t frame_time = emulator->frame_times[i];
-        sum += frame_time < NTSC_FRAME_DURATION ? NTSC_FRAME_DURATION : frame_time;
+        sum += (double)emulator->frame_times[i];
+    }
+    if (sum < (double)NTSC_FRAME_DURATION * NTSC_FRAME_RATE) {
+        sum = (double)NTSC_FRAME_DURATION * NTSC_FRAME_RATE;
     }
     double average_frame_duration = sum / NTSC_FRAME_RATE / 1e6;
 
     if (average_frame_duration == 0)
         return 0;
     return (uint32_t)(1 / average_frame_duration);
+}
+#endif
+
+// FNV-1a hash, `hash` is FNV_OFFSET_BASIS for a new hash or the result of a previous call to continue it
+static uint32_t fnv1a(const uint8_t *data, size_t size, uint32_t hash) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
 }
\ No newline at end of file
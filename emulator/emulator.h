@@ -1,15 +1,40 @@
 #ifndef EMULATOR_H
 #define EMULATOR_H
 
+#include "apu.h"
 #include "common.h"
 #include "cpu.h"
 #include "mapper.h"
 #include "mem.h"
+#include "movie.h"
 #include "ppu.h"
+#include "rewind.h"
+
+/**
+ *  What the frame loop waits for between two frames.
+ *
+ *  PACING_TIMER sleeps for the rest of the frame duration, which is all the board can do.
+ *  PACING_AUDIO waits until the audio ring has drained to its target fill level, so the audio device
+ *  clocks the emulation and the audio can neither drift nor run dry.
+ *  PACING_VSYNC waits until the render thread presented the frame, which waits for the vertical blank of a
+ *  60 Hz display.
+ *
+ *  Whenever there is audio output, the sample rate is also adjusted slightly by the fill level of the ring.
+ */
+typedef enum PacingMode {
+    PACING_TIMER,
+    PACING_AUDIO,
+    PACING_VSYNC,
+} PacingMode;
 
 /**
  *  This struct is the entire NES emulator
- *  It is the owner of the CPU, PPU, MEM and Mapper devices.
+ *  It is the owner of the CPU, PPU, APU, MEM and Mapper devices.
+ *
+ *  An emulator is self-contained: it renders into its own framebuffer, reads the controller from
+ *  `controller_input` (taken from `input` at the start of each frame, or set by the frontend) and
+ *  allocates nothing, so any number of them can run side by side, on different threads. Only the
+ *  profilers are shared.
  *
  */
 typedef struct Emulator {
@@ -19,15 +44,30 @@ typedef struct Emulator {
     // Devices
     CPU cpu;
     PPU ppu;
+    APU apu;
     MEM mem;
     Mapper mapper;
-    uint8_t controller_input; // Shift register
+    uint8_t controller_input; // Buttons held during the current frame, latched by the strobe at 0x4016
 
     // State
     int is_running;
     uint32_t event;
     uint32_t cur_frame;
     uint32_t time_point_start;
+    uint32_t rom_checksum; // identifies the ROM of a save state
+    Rewind *rewind;        // history to step back through while the rewind key is held, NULL if disabled
+    PacingMode pacing;
+    uint8_t skip_output;    // the next frame isn't shown, so the PPU doesn't draw it (see PPU.skip_rendering)
+    uint8_t max_frame_skip; // frames in a row that are left out while the emulation is behind, 0 to disable
+    uint8_t frames_skipped; // in a row, up to now
+    int32_t lag_us;         // how far the timer pacing is behind, made up for by sleeping less
+#ifndef RISC_V
+    InputSource *input;       // read once per frame, NULL to leave controller_input as it is
+    FrameHashLog *hash_log;   // gets the hash of every frame, NULL if disabled
+    uint8_t run_ahead;        // frames emulated past each frame and shown instead of it, see emulator_run_frame
+    uint8_t *run_ahead_state; // SAVE_STATE_MAX_SIZE bytes to roll back with, owned by the frontend
+#endif
+    int32_t audio_fill_average; // samples in the audio ring, averaged over the last frames
 
     // Calculate framerate based on the last 60 frames
     uint32_t frame_times[60];
@@ -45,9 +85,24 @@ void emulator_init(Emulator *emulator, uint8_t *rom);
  *  It contains the main frame loop that the program will spend
  *  99,9% of its time inside.
  *
+ *  When a frame takes longer than the pacing allows, up to `max_frame_skip` of the frames after it are
+ *  emulated without drawing or showing them, until it has caught up. In the SDL build, holding tab
+ *  fast-forwards: the frames are not paced and only every 4th frame is shown.
  */
 void emulator_run(Emulator *emulator);
 
+/**
+ *  Runs the CPU (and with it the PPU) until the PPU has completed a frame.
+ *  The input is read before and the frame hash is logged after, if they are set. With `skip_output`,
+ *  the frame isn't drawn and the framebuffer keeps the previous one.
+ *
+ *  With `run_ahead` frames of run-ahead, the frame is run without drawing it, the state is saved, and
+ *  `run_ahead` more frames with the same input are run silently. The last of them is left in the
+ *  framebuffer, then the state is rolled back. A game that reacts to input a frame or two late shows it
+ *  that much earlier, while the state, the audio and the frames that follow are the same as without.
+ */
+void emulator_run_frame(Emulator *emulator);
+
 /**
  *  Tests the CPU using the `tests/nestest.nes` rom.
  *
@@ -59,4 +114,31 @@ void emulator_run(Emulator *emulator);
  */
 void emulator_nestest(Emulator *emulator);
 
+#ifndef RISC_V
+/**
+ *  Runs `frame_count` frames as fast as possible, without a window and without
+ *  synchronizing to 60 FPS. Prints a benchmark report when done.
+ *
+ *  The controller is not read, emulator->controller_input is used instead.
+ *
+ */
+void emulator_run_headless(Emulator *emulator, uint32_t frame_count);
+
+/**
+ *  Tests the scanline renderer of the PPU against the dot-by-dot renderer.
+ *
+ *  Runs `rom` on two emulators side by side, one with each renderer, and compares
+ *  a hash of the framebuffer after every frame.
+ *  Returns 0 if all `frame_count` frames are identical, otherwise -1.
+ *
+ */
+int emulator_compare_renderers(uint8_t *rom, uint32_t frame_count);
+
+/**
+ *  Returns a hash (FNV-1a) of the framebuffer, to compare frames without storing them.
+ *
+ */
+uint32_t emulator_frame_hash(const Emulator *emulator);
+#endif
+
 #endif
\ No newline at end of file
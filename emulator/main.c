@@ -1,4 +1,11 @@
 #include "emulator.h"
+#include "profiler.h"
+#include "savestate.h"
+
+#define REWIND_ARENA_SIZE (4 * 1024 * 1024) // bytes, several minutes of history
+#define REWIND_INTERVAL 2                   // frames between snapshots
+#define MAX_RUN_AHEAD 4                     // frames, more than the input lag of any game
+#define DEFAULT_FRAME_SKIP 3                // frames in a row, so at least 15 FPS are shown when the host is slow
 
 /*
  * Loads the ROM in the file specified by `path`
@@ -30,6 +37,34 @@ size_t read_rom_from_file(uint8_t **buffer, const char *path) {
     }
     return actual_size;
 }
+
+/*
+ * Stores the path of the battery RAM file of the ROM at `rom_path` in `path`,
+ * i.e. the ROM path with the extension replaced by .sav
+ */
+void battery_ram_path(char *path, size_t size, const char *rom_path) {
+    const char *extension = strrchr(rom_path, '.');
+    int name_length = extension && !strchr(extension, '/') ? (int)(extension - rom_path) : (int)strlen(rom_path);
+    snprintf(path, size, "%.*s.sav", name_length, rom_path);
+}
+
+#ifndef HEADLESS
+/*
+ * Input source of the SDL build, the buttons the render thread saw at its last poll
+ */
+static uint8_t read_keyboard(InputSource *source) {
+    (void)source;
+    return sdl_buttons();
+}
+
+/*
+ * Runs on the emulation thread, see render-thread.h
+ */
+static int run_emulator(void *data) {
+    emulator_run(data);
+    return 0;
+}
+#endif
 #endif
 
 int main(int argc, char *argv[]) {
@@ -53,15 +88,210 @@ int main(int argc, char *argv[]) {
     Emulator NES;
     emulator_init(&NES, buffer);
 
+    // These options can be combined with the options below
+    const char *load_state_path = NULL;
+    const char *save_state_path = NULL;
+    const char *record_movie_path = NULL;
+    const char *play_movie_path = NULL;
+    const char *hash_log_path = NULL;
+    int verify_hashes = FALSE;
+    int run_ahead = 0;
+#ifndef HEADLESS
+    const char *pacing = "audio"; // only the window is paced, headless runs as fast as it can
+    int frame_skip = DEFAULT_FRAME_SKIP; // and draws every frame
+#endif
+    for (int i = 2; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--load-state") == 0)
+            load_state_path = argv[i + 1];
+        if (strcmp(argv[i], "--save-state") == 0)
+            save_state_path = argv[i + 1];
+        if (strcmp(argv[i], "--record-movie") == 0)
+            record_movie_path = argv[i + 1];
+        if (strcmp(argv[i], "--play-movie") == 0)
+            play_movie_path = argv[i + 1];
+        if (strcmp(argv[i], "--frame-hashes") == 0 || strcmp(argv[i], "--verify-hashes") == 0) {
+            hash_log_path = argv[i + 1];
+            verify_hashes = strcmp(argv[i], "--verify-hashes") == 0;
+        }
+        if (strcmp(argv[i], "--run-ahead") == 0)
+            run_ahead = atoi(argv[i + 1]);
+#ifndef HEADLESS
+        if (strcmp(argv[i], "--pacing") == 0)
+            pacing = argv[i + 1];
+        if (strcmp(argv[i], "--frame-skip") == 0)
+            frame_skip = atoi(argv[i + 1]);
+#endif
+#ifdef PROFILER
+        if (strcmp(argv[i], "--profile-csv") == 0)
+            profiler_open_csv(argv[i + 1]);
+#endif
+    }
+
+    // A movie starts at power-on with empty cartridge RAM, nothing else may change the state before it
+    int movie_active = record_movie_path || play_movie_path;
+    if (movie_active && (load_state_path || (record_movie_path && play_movie_path))) {
+        printf("Fatal Error: Movies start at power-on, they can't be combined with --load-state or each other\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Battery RAM is only kept for the window. The other modes (tests, benchmarks, hash logs) always start
+    // from the same empty cartridge RAM and leave the .sav file alone, like movies.
+    int windowed = argc == 2 || (strcmp(argv[2], "--nestest") != 0 && strcmp(argv[2], "--compare-renderers") != 0 &&
+                                 strcmp(argv[2], "--headless") != 0);
+    int battery_ram_kept = NES.mapper.has_battery_backed_ram && windowed && !movie_active;
+    char battery_path[4096];
+    battery_ram_path(battery_path, sizeof(battery_path), argv[1]);
+    if (battery_ram_kept) {
+        mapper_load_battery_ram(&NES.mapper, battery_path);
+    }
+    if (load_state_path && emulator_load_state_file(&NES, load_state_path) != 0) {
+        printf("Fatal Error: Failed to load state %s\n", load_state_path);
+        exit(EXIT_FAILURE);
+    }
+
+    Movie movie;
+    MovieRecorder recorder;
+    MoviePlayer player;
+    if (play_movie_path) {
+        if (movie_load(&movie, play_movie_path) != 0) {
+            printf("Fatal Error: Failed to load movie %s\n", play_movie_path);
+            exit(EXIT_FAILURE);
+        }
+        if (movie.rom_checksum != NES.rom_checksum) {
+            printf("Fatal Error: The movie was recorded with another ROM\n");
+            exit(EXIT_FAILURE);
+        }
+        movie_player_init(&player, &movie);
+        NES.input = &player.source;
+    } else if (record_movie_path) {
+        movie_init(&movie, NES.rom_checksum);
+        movie_recorder_init(&recorder, &movie, NULL); // records the keyboard in the SDL build
+        NES.input = &recorder.source;
+    }
+
+    // Allocated once here, rolling back doesn't allocate
+    uint8_t *run_ahead_state = NULL;
+    if (run_ahead < 0 || run_ahead > MAX_RUN_AHEAD) {
+        printf("Fatal Error: Run-ahead has to be 0 - %i frames\n", MAX_RUN_AHEAD);
+        exit(EXIT_FAILURE);
+    }
+    if (run_ahead > 0) {
+        run_ahead_state = malloc(SAVE_STATE_MAX_SIZE);
+        if (run_ahead_state == NULL) {
+            printf("Fatal Error: Failed to allocate the run-ahead buffer\n");
+            exit(EXIT_FAILURE);
+        }
+        NES.run_ahead = (uint8_t)run_ahead;
+        NES.run_ahead_state = run_ahead_state;
+    }
+
+    FrameHashLog hash_log;
+    if (hash_log_path) {
+        if (frame_hash_log_open(&hash_log, hash_log_path, verify_hashes) != 0) {
+            printf("Fatal Error: Failed to open frame hash log %s\n", hash_log_path);
+            exit(EXIT_FAILURE);
+        }
+        NES.hash_log = &hash_log;
+    }
+
     // If --nestest option is specified we run nestest
     if (argc > 2 && strcmp(argv[2], "--nestest") == 0) {
         emulator_nestest(&NES);
+    } else if (argc > 3 && strcmp(argv[2], "--compare-renderers") == 0) {
+        int result = emulator_compare_renderers(buffer, (uint32_t)atoi(argv[3]));
+        free(buffer);
+        return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else if (argc > 4 && strcmp(argv[2], "--headless") == 0 && strcmp(argv[3], "--frames") == 0) {
+        uint32_t frame_count = (uint32_t)atoi(argv[4]);
+        if (frame_count == 0 && play_movie_path) {
+            frame_count = movie.frame_count; // --frames 0 plays the whole movie
+        }
+        emulator_run_headless(&NES, frame_count);
     } else {
-        sdl_instance_init();
-        emulator_run(&NES);
+#ifdef HEADLESS
+        printf("Fatal Error: This build has no window, run it with --headless --frames <count>\n");
+        exit(EXIT_FAILURE);
+#else
+        // Allocated once here, recording the history doesn't allocate
+        Rewind *rewind = malloc(sizeof(Rewind));
+        uint8_t *rewind_arena = malloc(REWIND_ARENA_SIZE);
+        if (rewind == NULL || rewind_arena == NULL) {
+            printf("Fatal Error: Failed to allocate the rewind buffer\n");
+            exit(EXIT_FAILURE);
+        }
+        rewind_init(rewind, rewind_arena, REWIND_ARENA_SIZE, REWIND_INTERVAL);
+        // Stepping back would put frames into the movie and the hash log that aren't part of the run
+        NES.rewind = movie_active || hash_log_path ? NULL : rewind;
+
+        InputSource keyboard = {.read = read_keyboard, .data = NULL};
+        if (record_movie_path) {
+            recorder.input = &keyboard;
+        } else if (!play_movie_path) {
+            NES.input = &keyboard;
+        }
+
+        if (strcmp(pacing, "timer") == 0) {
+            NES.pacing = PACING_TIMER;
+        } else if (strcmp(pacing, "audio") == 0) {
+            NES.pacing = PACING_AUDIO;
+        } else if (strcmp(pacing, "vsync") == 0) {
+            NES.pacing = PACING_VSYNC;
+        } else {
+            printf("Fatal Error: Unknown pacing %s, expected timer, audio or vsync\n", pacing);
+            exit(EXIT_FAILURE);
+        }
+
+        sdl_instance_init(NES.pacing == PACING_VSYNC);
+        int sample_rate = sdl_audio_init(SDL_AUDIO_SAMPLE_RATE);
+        if (sample_rate > 0) {
+            apu_set_output(&NES.apu, sample_rate);
+        }
+
+        // Fall back to what is available: vsync only runs the game at the right speed on a 60 Hz display
+        int refresh_rate = NES.pacing == PACING_VSYNC ? sdl_display_refresh_rate() : 60;
+        if (refresh_rate < 59 || refresh_rate > 61) {
+            printf("Error: The display runs at %i Hz, not pacing on vsync\n", refresh_rate);
+            NES.pacing = PACING_AUDIO;
+        }
+        if (NES.pacing == PACING_AUDIO && sample_rate <= 0) {
+            NES.pacing = PACING_TIMER;
+        }
+        // Skipped frames aren't drawn, they would end up in the hash log as copies of the frame before
+        NES.max_frame_skip = hash_log_path || frame_skip < 0 ? 0 : (uint8_t)(frame_skip < 255 ? frame_skip : 255);
+        render_thread_run(run_emulator, &NES);
         sdl_instance_destroy();
+
+        if (battery_ram_kept) {
+            mapper_save_battery_ram(&NES.mapper, battery_path);
+        }
+        NES.rewind = NULL;
+        free(rewind_arena);
+        free(rewind);
+#endif
     }
 
+    if (save_state_path && emulator_save_state_file(&NES, save_state_path) != 0) {
+        printf("Fatal Error: Failed to save state %s\n", save_state_path);
+        exit(EXIT_FAILURE);
+    }
+    if (record_movie_path && movie_save(&movie, record_movie_path) != 0) {
+        printf("Fatal Error: Failed to save movie %s\n", record_movie_path);
+        exit(EXIT_FAILURE);
+    }
+    if (movie_active) {
+        movie_free(&movie);
+    }
+    NES.run_ahead_state = NULL;
+    free(run_ahead_state);
+    if (hash_log_path && frame_hash_log_close(&hash_log) != 0) {
+        exit(EXIT_FAILURE); // the replay isn't bit-exact
+    }
+#ifdef PROFILER
+    profiler_close_csv();
+#endif
+#ifdef HOTSPOT_PROFILER
+    debug_hotspot_report(&NES.cpu);
+#endif
     free(buffer);
 #endif // !RISC_V
 
@@ -1,5 +1,6 @@
 #include "mapper.h"
 #include "emulator.h"
+#include "savestate.h"
 
 typedef struct {
     char magic[4];
@@ -13,14 +14,21 @@ typedef struct {
     uint8_t unused[5];
 } iNES_Header;
 
+#define BATTERY_RAM_START 0x6000
+#define BATTERY_RAM_SIZE 0x2000
+
+// Every supported mapper, see MapperInfo
+static const MapperInfo *const mappers[] = {
+    &NROM_MAPPER, &MMC1_MAPPER, &UXROM_MAPPER, &CNROM_MAPPER, &MMC3_MAPPER,
+};
+#define MAPPER_COUNT (sizeof(mappers) / sizeof(mappers[0]))
+
 // --------------- STATIC FORWARD DECLARATIONS ---------------- //
 static iNES_Header read_iNES_header(const uint8_t *buffer);
-static uint8_t nrom_read_prg(Mapper *mapper, uint16_t address);
-static uint8_t nrom_read_chr(Mapper *mapper, uint16_t address);
-static void nrom_write_chr_ram(Mapper *mapper, uint16_t address, uint8_t value);
+static const MapperInfo *find_mapper(uint16_t id);
 static void set_nametable_mapping(Mapper *mapper, uint16_t top_left, uint16_t top_right, uint16_t bottom_left,
                                   uint16_t bottom_right);
-static void set_mirroring(Mapper *mapper, Mirroring mirroring);
+static void decode_tile(Mapper *mapper, uint16_t tile_index);
 
 // --------------- PUBLIC FUNCTIONS --------------------------- //
 void mapper_init(Emulator *emulator) {
@@ -34,11 +42,11 @@ void mapper_init(Emulator *emulator) {
     mapper->prg_ram_size = rom_header.prg_ram_size;
     mapper->chr_rom_size = rom_header.chr_rom_size;
 
-    mapper->has_battery_backed_ram = (rom_header.flags_6 & 0x04) ? 1 : 0;
-    mapper->has_trainer = (rom_header.flags_6 & 0x02) ? 1 : 0;
+    mapper->has_battery_backed_ram = (rom_header.flags_6 & 0x02) ? 1 : 0;
+    mapper->has_trainer = (rom_header.flags_6 & 0x04) ? 1 : 0;
 
     Mirroring mirroring;
-    if (rom_header.flags_6 & 0x03) {
+    if (rom_header.flags_6 & 0x08) {
         mirroring = FOUR_SCREEN;
     } else if (rom_header.flags_6 & 0x01) {
         mirroring = VERTICAL;
@@ -46,7 +54,7 @@ void mapper_init(Emulator *emulator) {
         mirroring = HORIZONTAL;
     }
 
-    set_mirroring(mapper, mirroring);
+    mapper_set_mirroring(mapper, mirroring);
 
     size_t trainer_offset = (rom_header.flags_6 & 0x04) ? 512 : 0;
     mapper->prg_rom = rom + 16 + trainer_offset;
@@ -57,22 +65,191 @@ void mapper_init(Emulator *emulator) {
         mapper->chr_rom = mapper->chr_ram;
     }
 
-    int mapper_num = (rom_header.flags_7 & 0xF0) | (rom_header.flags_6 >> 4);
+    mapper_invalidate_tiles(mapper);
+    memset(mapper->prg_bank, 0, sizeof(mapper->prg_bank));
+    memset(mapper->chr_bank, 0, sizeof(mapper->chr_bank));
+    memset(mapper->chr_map, 0, sizeof(mapper->chr_map));
+    mapper->shift_register = mapper->control = 0;
+    mapper->bank_select = mapper->irq_latch = mapper->irq_counter = mapper->irq_reload = mapper->irq_enabled = 0;
+
+    uint16_t mapper_num = (rom_header.flags_7 & 0xF0) | (rom_header.flags_6 >> 4);
+    const MapperInfo *info = find_mapper(mapper_num);
+    if (info == NULL) {
+        printf("Error: Unsupported mapper: %i", mapper_num);
+        exit(EXIT_FAILURE);
+    }
+
+    mapper->read_prg = info->read_prg;
+    mapper->write_prg = info->write_prg;
+    mapper->read_chr = info->read_chr;
+    mapper->write_chr = info->write_chr;
+    mapper->map_banks = info->map_banks;
+    mapper->clock_scanline = info->clock_scanline;
+    if (info->init) {
+        info->init(mapper);
+    }
+
+    mapper->map_banks(mapper);
+}
+
+const ChrTile *mapper_get_tile(Mapper *mapper, uint16_t address) {
+    uint16_t tile_index = (address & 0x1FFF) / TILE_BYTE_SIZE;
+    if (mapper->tile_dirty[tile_index]) {
+        decode_tile(mapper, tile_index);
+    }
+    return &mapper->tile_cache[tile_index];
+}
+
+void mapper_invalidate_tile(Mapper *mapper, uint16_t address) {
+    mapper->tile_dirty[(address & 0x1FFF) / TILE_BYTE_SIZE] = TRUE;
+}
+
+void mapper_invalidate_tiles(Mapper *mapper) { memset(mapper->tile_dirty, TRUE, sizeof(mapper->tile_dirty)); }
+
+void mapper_save_state(const Mapper *mapper, StateWriter *writer) {
+    state_write_bytes(writer, mapper->prg_bank, sizeof(mapper->prg_bank));
+    state_write_bytes(writer, mapper->chr_bank, sizeof(mapper->chr_bank));
+    state_write_8(writer, mapper->mirroring);
+    for (int i = 0; i < 4; i++) {
+        state_write_16(writer, mapper->nametable_map[i]);
+    }
+
+    // CHR-ROM comes from the ROM, only CHR-RAM is part of the state
+    if (mapper->chr_rom_size == 0) {
+        state_write_bytes(writer, mapper->chr_ram, sizeof(mapper->chr_ram));
+    }
+
+    state_write_8(writer, mapper->shift_register);
+    state_write_8(writer, mapper->control);
+    state_write_8(writer, mapper->bank_select);
+    state_write_8(writer, mapper->irq_latch);
+    state_write_8(writer, mapper->irq_counter);
+    state_write_8(writer, mapper->irq_reload);
+    state_write_8(writer, mapper->irq_enabled);
+}
+
+void mapper_load_state(Mapper *mapper, StateReader *reader) {
+    uint8_t chr_ram_changed = FALSE;
+    state_read_bytes(reader, mapper->prg_bank, sizeof(mapper->prg_bank));
+    state_read_bytes(reader, mapper->chr_bank, sizeof(mapper->chr_bank));
+    mapper->mirroring = (Mirroring)state_read_8(reader);
+    for (int i = 0; i < 4; i++) {
+        mapper->nametable_map[i] = state_read_16(reader);
+    }
+
+    // map_banks only invalidates the slots that are switched, so the cache survives loading the same banks again,
+    // e.g. for every frame of run-ahead. CHR-RAM can be mapped anywhere, if any of it changed all tiles are outdated.
+    if (mapper->chr_rom_size == 0) {
+        for (size_t offset = 0; offset < sizeof(mapper->chr_ram); offset += TILE_BYTE_SIZE) {
+            uint8_t tile[TILE_BYTE_SIZE];
+            state_read_bytes(reader, tile, sizeof(tile));
+            for (size_t i = 0; i < TILE_BYTE_SIZE; i++) {
+                if (mapper->chr_ram[offset + i] != tile[i]) {
+                    mapper->chr_ram[offset + i] = tile[i];
+                    chr_ram_changed = TRUE;
+                }
+            }
+        }
+    }
+
+    mapper->shift_register = state_read_8(reader);
+    mapper->control = state_read_8(reader);
+    mapper->bank_select = state_read_8(reader);
+    mapper->irq_latch = state_read_8(reader);
+    mapper->irq_counter = state_read_8(reader);
+    mapper->irq_reload = state_read_8(reader);
+    mapper->irq_enabled = state_read_8(reader);
+
+    mapper->map_banks(mapper);
+    if (chr_ram_changed) {
+        mapper_invalidate_tiles(mapper);
+    }
+    // The PPU chunk is loaded first, its next event didn't see whether the scanline counter can raise an IRQ
+    ppu_reschedule(&mapper->emulator->ppu);
+}
+
+#ifndef RISC_V
+int mapper_load_battery_ram(Mapper *mapper, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return -1; // Nothing has been saved yet
+    }
+    MEM *mem = &mapper->emulator->mem;
+    size_t size = fread(mem->cartridge_ram + (BATTERY_RAM_START - APU_IO_REGISTER_END), 1, BATTERY_RAM_SIZE, fp);
+    fclose(fp);
+
+    if (size != BATTERY_RAM_SIZE) {
+        printf("Error: Battery RAM in %s is truncated\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int mapper_save_battery_ram(const Mapper *mapper, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("Error: Failed to save battery RAM to %s\n", path);
+        return -1;
+    }
+    const MEM *mem = &mapper->emulator->mem;
+    size_t size = fwrite(mem->cartridge_ram + (BATTERY_RAM_START - APU_IO_REGISTER_END), 1, BATTERY_RAM_SIZE, fp);
+    fclose(fp);
+    return size == BATTERY_RAM_SIZE ? 0 : -1;
+}
+#endif
 
-    switch (mapper_num) {
-    case NROM:
-        mapper->read_prg = nrom_read_prg;
-        mapper->read_chr = nrom_read_chr;
-        mapper->write_chr = nrom_write_chr_ram;
-        break;
-    case MMC1: printf("Error: Unsupported mapper: MMC1"); exit(EXIT_FAILURE);
-    case UXROM: printf("Error: Unsupported mapper: UXROM"); exit(EXIT_FAILURE);
-    case CNROM: printf("Error: Unsupported mapper: CNROM"); exit(EXIT_FAILURE);
-    case MMC3: printf("Error: Unsupported mapper: MMC3"); exit(EXIT_FAILURE);
-    default: printf("Error: Unsupported mapper: %i", mapper_num); exit(EXIT_FAILURE);
+uint8_t mapper_banked_read_prg(Mapper *mapper, uint16_t address) {
+    return mapper->prg_map[(address >> 13) & 0x03][address & (PRG_SLOT_SIZE - 1)];
+}
+
+uint8_t mapper_banked_read_chr(Mapper *mapper, uint16_t address) {
+    return mapper->chr_map[(address >> 10) & 0x07][address & (CHR_SLOT_SIZE - 1)];
+}
+
+void mapper_banked_write_chr(Mapper *mapper, uint16_t address, uint8_t value) {
+    if (mapper->chr_rom_size == 0) {
+        mapper->chr_map[(address >> 10) & 0x07][address & (CHR_SLOT_SIZE - 1)] = value;
+        mapper_invalidate_tile(mapper, address);
     }
 }
 
+void mapper_map_prg_8k(Mapper *mapper, uint8_t slot, size_t bank) {
+    uint8_t *data = mapper->prg_rom + (bank % (mapper->prg_rom_size * 2)) * PRG_SLOT_SIZE;
+    mapper->prg_map[slot] = data;
+    mem_map_pages(&mapper->emulator->mem, 0x80 + slot * (PRG_SLOT_SIZE / MEM_PAGE_SIZE), PRG_SLOT_SIZE / MEM_PAGE_SIZE,
+                  data, NULL);
+}
+
+void mapper_map_prg_16k(Mapper *mapper, uint8_t slot, size_t bank) {
+    bank %= mapper->prg_rom_size;
+    mapper_map_prg_8k(mapper, slot * 2, bank * 2);
+    mapper_map_prg_8k(mapper, slot * 2 + 1, bank * 2 + 1);
+}
+
+void mapper_map_chr_1k(Mapper *mapper, uint8_t slot, size_t bank) {
+    size_t bank_count = mapper->chr_rom_size > 0 ? mapper->chr_rom_size * 8 : sizeof(mapper->chr_ram) / CHR_SLOT_SIZE;
+    uint8_t *data = mapper->chr_rom + (bank % bank_count) * CHR_SLOT_SIZE;
+    if (mapper->chr_map[slot] == data) {
+        return;
+    }
+
+    mapper->chr_map[slot] = data;
+    memset(mapper->tile_dirty + slot * (CHR_SLOT_SIZE / TILE_BYTE_SIZE), TRUE, CHR_SLOT_SIZE / TILE_BYTE_SIZE);
+}
+
+void mapper_map_chr_4k(Mapper *mapper, uint8_t slot, size_t bank) {
+    size_t bank_count = mapper->chr_rom_size > 0 ? mapper->chr_rom_size * 2 : sizeof(mapper->chr_ram) / 0x1000;
+    bank %= bank_count;
+    for (int i = 0; i < 4; i++) {
+        mapper_map_chr_1k(mapper, slot * 4 + i, bank * 4 + i);
+    }
+}
+
+void mapper_map_chr_8k(Mapper *mapper, size_t bank) {
+    mapper_map_chr_4k(mapper, 0, bank * 2);
+    mapper_map_chr_4k(mapper, 1, bank * 2 + 1);
+}
+
 // --------------- STATIC FUNCTIONS --------------------------- //
 static iNES_Header read_iNES_header(const uint8_t *buffer) {
     iNES_Header header;
@@ -89,35 +266,56 @@ static iNES_Header read_iNES_header(const uint8_t *buffer) {
     return header;
 }
 
-static uint8_t nrom_read_prg(Mapper *mapper, uint16_t address) {
-    if (mapper->prg_rom_size == 1) {
-        // NROM-128: 16 KB PRG ROM mirrored at 0x8000-0xFFFF
-        return mapper->prg_rom[address % 0x4000];
+static const MapperInfo *find_mapper(uint16_t id) {
+    for (size_t i = 0; i < MAPPER_COUNT; i++) {
+        if (mappers[i]->id == id)
+            return mappers[i];
     }
-    return mapper->prg_rom[address - 0x8000];
+    return NULL;
 }
 
-static uint8_t nrom_read_chr(Mapper *mapper, uint16_t address) { return mapper->chr_rom[address]; }
-
-// static void nrom_write_prg(const Mapper *mapper, uint16_t address, uint8_t value) {}
-
-static void nrom_write_chr_ram(Mapper *mapper, uint16_t address, uint8_t value) { mapper->chr_ram[address] = value; }
-
-void set_nametable_mapping(Mapper *mapper, uint16_t top_left, uint16_t top_right, uint16_t bottom_left,
-                           uint16_t bottom_right) {
+static void set_nametable_mapping(Mapper *mapper, uint16_t top_left, uint16_t top_right, uint16_t bottom_left,
+                                  uint16_t bottom_right) {
     mapper->nametable_map[0] = top_left;
     mapper->nametable_map[1] = top_right;
     mapper->nametable_map[2] = bottom_left;
     mapper->nametable_map[3] = bottom_right;
 }
 
-void set_mirroring(Mapper *mapper, Mirroring mirroring) {
+void mapper_set_mirroring(Mapper *mapper, Mirroring mirroring) {
     switch (mirroring) {
     case HORIZONTAL: set_nametable_mapping(mapper, 0x0000, 0x0000, 0x0800, 0x0800); break;
     case VERTICAL: set_nametable_mapping(mapper, 0x0000, 0x0400, 0x0000, 0x0400); break;
     case FOUR_SCREEN: set_nametable_mapping(mapper, 0x0000, 0x0400, 0x0800, 0x0C00); break;
+    case SINGLE_SCREEN_UPPER: set_nametable_mapping(mapper, 0x0400, 0x0400, 0x0400, 0x0400); break;
     default: set_nametable_mapping(mapper, 0, 0, 0, 0);
     }
 
     mapper->mirroring = mirroring;
-}
\ No newline at end of file
+}
+
+// Combines the two bit planes of a tile into 2-bit pixels
+static void decode_tile(Mapper *mapper, uint16_t tile_index) {
+    ChrTile *tile = &mapper->tile_cache[tile_index];
+    uint16_t tile_address = tile_index * TILE_BYTE_SIZE;
+
+    for (int y = 0; y < TILE_HEIGHT; y++) {
+        uint8_t low_byte = mapper->read_chr(mapper, tile_address + y);
+        uint8_t high_byte = mapper->read_chr(mapper, tile_address + y + 8);
+        uint16_t row = 0;
+        uint16_t flipped_row = 0;
+
+        for (int x = 0; x < TILE_WIDTH; x++) {
+            uint8_t low_bit = (low_byte >> (7 - x)) & 0x1;
+            uint8_t high_bit = (high_byte >> (7 - x)) & 0x1;
+            uint16_t pixel = (high_bit << 1) | low_bit;
+            row |= pixel << (14 - 2 * x);
+            flipped_row |= pixel << (2 * x);
+        }
+
+        tile->rows[y] = row;
+        tile->flipped_rows[y] = flipped_row;
+    }
+
+    mapper->tile_dirty[tile_index] = FALSE;
+}
@@ -19,8 +19,25 @@ typedef enum Mirroring {
     FOUR_SCREEN,
 } Mirroring;
 
+#define CHR_TILE_COUNT (0x2000 / TILE_BYTE_SIZE) // tiles in both pattern tables
+#define PRG_SLOT_SIZE 0x2000                     // granularity of prg_map
+#define CHR_SLOT_SIZE 0x0400                     // granularity of chr_map
+
+/**
+ *  A tile from the pattern tables, decoded to 2-bit pixels.
+ *
+ *  Each row packs the 8 pixels of the tile, with the leftmost pixel in the top two bits.
+ *  flipped_rows holds the same rows mirrored horizontally (for sprites).
+ */
+typedef struct ChrTile {
+    uint16_t rows[TILE_HEIGHT];
+    uint16_t flipped_rows[TILE_HEIGHT];
+} ChrTile;
+
 // Forward declarations
 typedef struct Emulator Emulator;
+typedef struct StateWriter StateWriter;
+typedef struct StateReader StateReader;
 
 typedef struct Mapper {
     uint8_t *prg_rom;
@@ -33,11 +50,28 @@ typedef struct Mapper {
     uint8_t prg_bank[2];
     uint8_t chr_bank[8];
 
+    // MMC1 registers
+    uint8_t shift_register; // bits are shifted in from the top, the bit at 0x01 marks the fifth write
+    uint8_t control;
+
+    // MMC3 registers. The bank registers R0 - R5 are stored in chr_bank, R6 and R7 in prg_bank.
+    uint8_t bank_select;
+    uint8_t irq_latch;
+    uint8_t irq_counter;
+    uint8_t irq_reload;
+    uint8_t irq_enabled;
+
+    // The banks that are switched in, computed by map_banks when the bank registers change.
+    // prg_map is also mapped into the CPU page table, so PRG reads don't go through read_prg.
+    uint8_t *prg_map[4]; // 0x8000 - 0xFFFF in PRG_SLOT_SIZE slots
+    uint8_t *chr_map[8]; // 0x0000 - 0x1FFF in CHR_SLOT_SIZE slots
+
     uint8_t (*read_prg)(struct Mapper *mapper, uint16_t address);
-    // void (*write_prg)(struct Mapper *mapper, uint16_t address, uint8_t
-    // value);
+    void (*write_prg)(struct Mapper *mapper, uint16_t address, uint8_t value); // writes to 0x8000 - 0xFFFF
     uint8_t (*read_chr)(struct Mapper *mapper, uint16_t address);
     void (*write_chr)(struct Mapper *mapper, uint16_t address, uint8_t value);
+    void (*map_banks)(struct Mapper *mapper);
+    void (*clock_scanline)(struct Mapper *mapper); // called on rises of PPU address line A12, NULL if not used
 
     uint16_t nametable_map[4];
     Mirroring mirroring;
@@ -46,14 +80,140 @@ typedef struct Mapper {
 
     uint8_t chr_ram[0x2000]; // Only used if chr_rom_size == 0
 
+    // Decoded pattern tables, indexed by CHR address / 16. Tiles are decoded on first use.
+    ChrTile tile_cache[CHR_TILE_COUNT];
+    uint8_t tile_dirty[CHR_TILE_COUNT];
+
     Emulator *emulator;
 } Mapper;
 
+/**
+ *  Describes a mapper chip. Every supported mapper has one, and is listed in the registry in mapper.c.
+ *
+ *  The hooks are copied into the Mapper by `mapper_init`. `init` is optional and runs before the first
+ *  `map_banks`, to put the registers in their power-on state.
+ */
+typedef struct MapperInfo {
+    uint16_t id; // iNES mapper number
+    const char *name;
+    void (*init)(Mapper *mapper);
+    uint8_t (*read_prg)(Mapper *mapper, uint16_t address);
+    void (*write_prg)(Mapper *mapper, uint16_t address, uint8_t value);
+    uint8_t (*read_chr)(Mapper *mapper, uint16_t address);
+    void (*write_chr)(Mapper *mapper, uint16_t address, uint8_t value);
+    void (*map_banks)(Mapper *mapper);
+    void (*clock_scanline)(Mapper *mapper);
+} MapperInfo;
+
+extern const MapperInfo NROM_MAPPER;
+extern const MapperInfo MMC1_MAPPER;
+extern const MapperInfo UXROM_MAPPER;
+extern const MapperInfo CNROM_MAPPER;
+extern const MapperInfo MMC3_MAPPER;
+
 /**
  *  Initializes the mapper by reading emulator->rom.
  *
- *  Sets upp the function pointers depending on mapper ID specified in the iNES header.
+ *  Sets upp the function pointers from the MapperInfo of the mapper ID specified in the iNES header.
+ *  Exits if the mapper isn't supported.
  */
 void mapper_init(Emulator *emulator);
 
+/**
+ *  Returns the decoded tile that contains `address` (0x0000 - 0x1FFF).
+ *
+ *  The tile is decoded through read_chr if it isn't cached, or has been invalidated.
+ */
+const ChrTile *mapper_get_tile(Mapper *mapper, uint16_t address);
+
+/**
+ *  Marks the tile that contains `address` as outdated. Has to be called on writes to CHR-RAM.
+ */
+void mapper_invalidate_tile(Mapper *mapper, uint16_t address);
+
+/**
+ *  Marks all tiles as outdated. Has to be called when CHR banks are switched.
+ */
+void mapper_invalidate_tiles(Mapper *mapper);
+
+/**
+ *  Writes the bank registers, mirroring and CHR-RAM to a save state chunk.
+ *
+ */
+void mapper_save_state(const Mapper *mapper, StateWriter *writer);
+
+/**
+ *  Reads a chunk written by `mapper_save_state`. Invalidates the tiles that changed.
+ *
+ */
+void mapper_load_state(Mapper *mapper, StateReader *reader);
+
+#ifndef RISC_V
+/**
+ *  Loads the battery-backed PRG-RAM (0x6000 - 0x7FFF) from the file at `path`.
+ *
+ *  Returns 0 on success, -1 if there is no such file (e.g. the game hasn't been saved yet).
+ */
+int mapper_load_battery_ram(Mapper *mapper, const char *path);
+
+/**
+ *  Saves the battery-backed PRG-RAM (0x6000 - 0x7FFF) to the file at `path`.
+ *
+ *  Returns 0 on success, -1 if the file couldn't be written.
+ */
+int mapper_save_battery_ram(const Mapper *mapper, const char *path);
+#endif
+
+// --------------- MAPPER IMPLEMENTATIONS --------------------- //
+// Helpers for the mapper_*.c files
+
+/**
+ *  Reads PRG-ROM through prg_map.
+ */
+uint8_t mapper_banked_read_prg(Mapper *mapper, uint16_t address);
+
+/**
+ *  Reads the pattern tables through chr_map.
+ */
+uint8_t mapper_banked_read_chr(Mapper *mapper, uint16_t address);
+
+/**
+ *  Writes the pattern tables through chr_map. Writes are ignored unless the cartridge has CHR-RAM.
+ */
+void mapper_banked_write_chr(Mapper *mapper, uint16_t address, uint8_t value);
+
+/**
+ *  Switches 8 KB PRG-ROM bank `bank` into `slot` (0 - 3) of 0x8000 - 0xFFFF, and maps it into the CPU page table.
+ *
+ *  Bank numbers wrap around the size of the PRG-ROM.
+ */
+void mapper_map_prg_8k(Mapper *mapper, uint8_t slot, size_t bank);
+
+/**
+ *  Switches 16 KB PRG-ROM bank `bank` into `slot` (0 or 1) of 0x8000 - 0xFFFF.
+ */
+void mapper_map_prg_16k(Mapper *mapper, uint8_t slot, size_t bank);
+
+/**
+ *  Switches 1 KB CHR bank `bank` into `slot` (0 - 7) of the pattern tables.
+ *
+ *  Only the tiles of the slot are invalidated, and only if the bank actually changed.
+ */
+void mapper_map_chr_1k(Mapper *mapper, uint8_t slot, size_t bank);
+
+/**
+ *  Switches 4 KB CHR bank `bank` into pattern table `slot` (0 or 1).
+ */
+void mapper_map_chr_4k(Mapper *mapper, uint8_t slot, size_t bank);
+
+/**
+ *  Switches 8 KB CHR bank `bank` into both pattern tables.
+ */
+void mapper_map_chr_8k(Mapper *mapper, size_t bank);
+
+/**
+ *  Sets up nametable_map for `mirroring`.
+ */
+void mapper_set_mirroring(Mapper *mapper, Mirroring mirroring);
+
 #endif
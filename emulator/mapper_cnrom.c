@@ -0,0 +1,33 @@
+#include "emulator.h"
+#include "mapper.h"
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void cnrom_map_banks(Mapper *mapper);
+static void cnrom_write_prg(Mapper *mapper, uint16_t address, uint8_t value);
+
+// src: https://www.nesdev.org/wiki/CNROM
+const MapperInfo CNROM_MAPPER = {
+    .id = CNROM,
+    .name = "CNROM",
+    .read_prg = mapper_banked_read_prg,
+    .write_prg = cnrom_write_prg,
+    .read_chr = mapper_banked_read_chr,
+    .write_chr = mapper_banked_write_chr,
+    .map_banks = cnrom_map_banks,
+};
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// PRG-ROM is fixed like NROM, only the 8 KB CHR bank is switched
+static void cnrom_map_banks(Mapper *mapper) {
+    mapper_map_prg_16k(mapper, 0, 0);
+    mapper_map_prg_16k(mapper, 1, 1);
+    mapper_map_chr_8k(mapper, mapper->chr_bank[0]);
+}
+
+// Any write selects the CHR bank. Bus conflicts are not emulated, the written value is used as is.
+static void cnrom_write_prg(Mapper *mapper, uint16_t address, uint8_t value) {
+    ppu_catch_up(&mapper->emulator->ppu); // Switch the bank on the dot the CPU is at
+    mapper->chr_bank[0] = value;
+    mapper_map_chr_8k(mapper, value);
+}
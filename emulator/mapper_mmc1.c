@@ -0,0 +1,93 @@
+#include "emulator.h"
+#include "mapper.h"
+
+// Control register
+#define MMC1_PRG_MODE 0x0C
+#define MMC1_PRG_FIX_FIRST 0x08 // 0x8000 is fixed to the first bank, 0xC000 is switched
+#define MMC1_PRG_FIX_LAST 0x0C  // 0xC000 is fixed to the last bank, 0x8000 is switched
+#define MMC1_CHR_4K 0x10        // two 4 KB CHR banks instead of one 8 KB bank
+#define MMC1_SHIFT_RESET 0x10
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void mmc1_init(Mapper *mapper);
+static void mmc1_map_banks(Mapper *mapper);
+static void mmc1_write_prg(Mapper *mapper, uint16_t address, uint8_t value);
+static void mmc1_write_register(Mapper *mapper, uint16_t address, uint8_t value);
+
+// src: https://www.nesdev.org/wiki/MMC1
+const MapperInfo MMC1_MAPPER = {
+    .id = MMC1,
+    .name = "MMC1",
+    .init = mmc1_init,
+    .read_prg = mapper_banked_read_prg,
+    .write_prg = mmc1_write_prg,
+    .read_chr = mapper_banked_read_chr,
+    .write_chr = mapper_banked_write_chr,
+    .map_banks = mmc1_map_banks,
+};
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+static void mmc1_init(Mapper *mapper) {
+    mapper->shift_register = MMC1_SHIFT_RESET;
+    mapper->control = MMC1_PRG_FIX_LAST; // the reset vector is in the last bank
+}
+
+static void mmc1_map_banks(Mapper *mapper) {
+    // SUROM: with 512 KB of PRG-ROM, bit 4 of the CHR bank selects the 256 KB half
+    size_t outer_bank = mapper->prg_rom_size > 16 ? (mapper->chr_bank[0] & 0x10) : 0;
+    uint8_t bank = mapper->prg_bank[0] & 0x0F;
+
+    switch (mapper->control & MMC1_PRG_MODE) {
+    case MMC1_PRG_FIX_FIRST:
+        mapper_map_prg_16k(mapper, 0, outer_bank);
+        mapper_map_prg_16k(mapper, 1, outer_bank | bank);
+        break;
+    case MMC1_PRG_FIX_LAST:
+        mapper_map_prg_16k(mapper, 0, outer_bank | bank);
+        mapper_map_prg_16k(mapper, 1, outer_bank | 0x0F);
+        break;
+    default: // 32 KB mode, the low bit is ignored
+        mapper_map_prg_16k(mapper, 0, outer_bank | (bank & 0x0E));
+        mapper_map_prg_16k(mapper, 1, outer_bank | (bank & 0x0E) | 1);
+    }
+
+    if (mapper->control & MMC1_CHR_4K) {
+        mapper_map_chr_4k(mapper, 0, mapper->chr_bank[0]);
+        mapper_map_chr_4k(mapper, 1, mapper->chr_bank[1]);
+    } else {
+        mapper_map_chr_4k(mapper, 0, mapper->chr_bank[0] & 0x1E);
+        mapper_map_chr_4k(mapper, 1, mapper->chr_bank[0] | 0x01);
+    }
+
+    static const Mirroring mirroring[4] = {SINGLE_SCREEN_LOWER, SINGLE_SCREEN_UPPER, VERTICAL, HORIZONTAL};
+    mapper_set_mirroring(mapper, mirroring[mapper->control & 0x03]);
+}
+
+// The registers are written one bit at a time through a shift register
+static void mmc1_write_prg(Mapper *mapper, uint16_t address, uint8_t value) {
+    if (value & 0x80) {
+        mapper->shift_register = MMC1_SHIFT_RESET;
+        mapper->control |= MMC1_PRG_FIX_LAST;
+        mmc1_map_banks(mapper);
+        return;
+    }
+
+    uint8_t is_fifth_write = mapper->shift_register & 0x01;
+    mapper->shift_register = (mapper->shift_register >> 1) | ((value & 0x01) << 4);
+    if (is_fifth_write) {
+        mmc1_write_register(mapper, address, mapper->shift_register);
+        mapper->shift_register = MMC1_SHIFT_RESET;
+    }
+}
+
+static void mmc1_write_register(Mapper *mapper, uint16_t address, uint8_t value) {
+    ppu_catch_up(&mapper->emulator->ppu); // Switch the banks on the dot the CPU is at
+    switch (address & 0xE000) {
+    case 0x8000: mapper->control = value; break;
+    case 0xA000: mapper->chr_bank[0] = value; break;
+    case 0xC000: mapper->chr_bank[1] = value; break;
+    case 0xE000: mapper->prg_bank[0] = value; break; // bit 4 (PRG-RAM disable) is ignored, PRG-RAM is always on
+    }
+    mmc1_map_banks(mapper);
+}
+
@@ -0,0 +1,109 @@
+#include "emulator.h"
+#include "mapper.h"
+
+// Bank select register
+#define MMC3_PRG_SWAP 0x40      // 0x8000 is fixed to the second last bank, 0xC000 is switched
+#define MMC3_CHR_INVERSION 0x80 // the 2 KB banks are at 0x1000 instead of 0x0000
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void mmc3_init(Mapper *mapper);
+static void mmc3_map_banks(Mapper *mapper);
+static void mmc3_write_prg(Mapper *mapper, uint16_t address, uint8_t value);
+static void mmc3_clock_scanline(Mapper *mapper);
+
+// src: https://www.nesdev.org/wiki/MMC3
+const MapperInfo MMC3_MAPPER = {
+    .id = MMC3,
+    .name = "MMC3",
+    .init = mmc3_init,
+    .read_prg = mapper_banked_read_prg,
+    .write_prg = mmc3_write_prg,
+    .read_chr = mapper_banked_read_chr,
+    .write_chr = mapper_banked_write_chr,
+    .map_banks = mmc3_map_banks,
+    .clock_scanline = mmc3_clock_scanline,
+};
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+static void mmc3_init(Mapper *mapper) { mapper->prg_bank[1] = 1; }
+
+static void mmc3_map_banks(Mapper *mapper) {
+    size_t last_bank = mapper->prg_rom_size * 2 - 1;
+    if (mapper->bank_select & MMC3_PRG_SWAP) {
+        mapper_map_prg_8k(mapper, 0, last_bank - 1);
+        mapper_map_prg_8k(mapper, 2, mapper->prg_bank[0]);
+    } else {
+        mapper_map_prg_8k(mapper, 0, mapper->prg_bank[0]);
+        mapper_map_prg_8k(mapper, 2, last_bank - 1);
+    }
+    mapper_map_prg_8k(mapper, 1, mapper->prg_bank[1]);
+    mapper_map_prg_8k(mapper, 3, last_bank);
+
+    // Two 2 KB banks and four 1 KB banks, the inversion swaps the pattern tables
+    uint8_t inversion = (mapper->bank_select & MMC3_CHR_INVERSION) ? 4 : 0;
+    mapper_map_chr_1k(mapper, 0 ^ inversion, mapper->chr_bank[0] & 0xFE);
+    mapper_map_chr_1k(mapper, 1 ^ inversion, mapper->chr_bank[0] | 0x01);
+    mapper_map_chr_1k(mapper, 2 ^ inversion, mapper->chr_bank[1] & 0xFE);
+    mapper_map_chr_1k(mapper, 3 ^ inversion, mapper->chr_bank[1] | 0x01);
+    for (uint8_t i = 0; i < 4; i++) {
+        mapper_map_chr_1k(mapper, (4 + i) ^ inversion, mapper->chr_bank[2 + i]);
+    }
+}
+
+static void mmc3_write_prg(Mapper *mapper, uint16_t address, uint8_t value) {
+    PPU *ppu = &mapper->emulator->ppu;
+    CPU *cpu = &mapper->emulator->cpu;
+    uint8_t odd = address & 0x01;
+
+    // Banks, mirroring and the IRQ counter are all seen by the PPU, the write has to land on the dot the CPU is at
+    ppu_catch_up(ppu);
+
+    switch (address & 0xE000) {
+    case 0x8000:
+        if (odd) {
+            uint8_t target = mapper->bank_select & 0x07;
+            if (target < 6) {
+                mapper->chr_bank[target] = value;
+            } else {
+                mapper->prg_bank[target - 6] = value & 0x3F;
+            }
+        } else {
+            mapper->bank_select = value;
+        }
+        mmc3_map_banks(mapper);
+        break;
+    case 0xA000:
+        if (!odd && mapper->mirroring != FOUR_SCREEN) {
+            mapper_set_mirroring(mapper, (value & 0x01) ? HORIZONTAL : VERTICAL);
+        }
+        break; // PRG-RAM protection (odd) is ignored, PRG-RAM is always writable
+    case 0xC000:
+        if (odd) {
+            mapper->irq_counter = 0;
+            mapper->irq_reload = TRUE;
+        } else {
+            mapper->irq_latch = value;
+        }
+        break;
+    case 0xE000:
+        mapper->irq_enabled = odd;
+        if (!odd) {
+            cpu_set_irq_line(cpu, IRQ_SOURCE_MAPPER, FALSE); // acknowledge
+        }
+        ppu_reschedule(ppu); // the scanline counter is an event while the IRQ is enabled
+        break;
+    }
+}
+
+static void mmc3_clock_scanline(Mapper *mapper) {
+    if (mapper->irq_counter == 0 || mapper->irq_reload) {
+        mapper->irq_counter = mapper->irq_latch;
+        mapper->irq_reload = FALSE;
+    } else {
+        mapper->irq_counter--;
+    }
+
+    if (mapper->irq_counter == 0 && mapper->irq_enabled) {
+        cpu_set_irq_line(&mapper->emulator->cpu, IRQ_SOURCE_MAPPER, TRUE);
+    }
+}
@@ -0,0 +1,44 @@
+#include "mapper.h"
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void nrom_map_banks(Mapper *mapper);
+static uint8_t nrom_read_prg(Mapper *mapper, uint16_t address);
+static void nrom_write_prg(Mapper *mapper, uint16_t address, uint8_t value);
+static uint8_t nrom_read_chr(Mapper *mapper, uint16_t address);
+static void nrom_write_chr_ram(Mapper *mapper, uint16_t address, uint8_t value);
+
+const MapperInfo NROM_MAPPER = {
+    .id = NROM,
+    .name = "NROM",
+    .read_prg = nrom_read_prg,
+    .write_prg = nrom_write_prg,
+    .read_chr = nrom_read_chr,
+    .write_chr = nrom_write_chr_ram,
+    .map_banks = nrom_map_banks,
+};
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// NROM-128 has a single 16 KB bank, which is mirrored at 0xC000
+static void nrom_map_banks(Mapper *mapper) {
+    mapper_map_prg_16k(mapper, 0, 0);
+    mapper_map_prg_16k(mapper, 1, 1);
+    mapper_map_chr_8k(mapper, 0);
+}
+
+static uint8_t nrom_read_prg(Mapper *mapper, uint16_t address) {
+    if (mapper->prg_rom_size == 1) {
+        // NROM-128: 16 KB PRG ROM mirrored at 0x8000-0xFFFF
+        return mapper->prg_rom[address % 0x4000];
+    }
+    return mapper->prg_rom[address - 0x8000];
+}
+
+static uint8_t nrom_read_chr(Mapper *mapper, uint16_t address) { return mapper->chr_rom[address]; }
+
+static void nrom_write_prg(Mapper *mapper, uint16_t address, uint8_t value) {} // ROM, writes are ignored
+
+static void nrom_write_chr_ram(Mapper *mapper, uint16_t address, uint8_t value) {
+    mapper->chr_ram[address] = value;
+    mapper_invalidate_tile(mapper, address);
+}
@@ -0,0 +1,31 @@
+#include "mapper.h"
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void uxrom_map_banks(Mapper *mapper);
+static void uxrom_write_prg(Mapper *mapper, uint16_t address, uint8_t value);
+
+// src: https://www.nesdev.org/wiki/UxROM
+const MapperInfo UXROM_MAPPER = {
+    .id = UXROM,
+    .name = "UxROM",
+    .read_prg = mapper_banked_read_prg,
+    .write_prg = uxrom_write_prg,
+    .read_chr = mapper_banked_read_chr,
+    .write_chr = mapper_banked_write_chr,
+    .map_banks = uxrom_map_banks,
+};
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// 0x8000 is switched, 0xC000 is fixed to the last bank. CHR is a single 8 KB bank, normally RAM.
+static void uxrom_map_banks(Mapper *mapper) {
+    mapper_map_prg_16k(mapper, 0, mapper->prg_bank[0]);
+    mapper_map_prg_16k(mapper, 1, mapper->prg_rom_size - 1);
+    mapper_map_chr_8k(mapper, 0);
+}
+
+// Any write selects the bank at 0x8000. Bus conflicts are not emulated, the written value is used as is.
+static void uxrom_write_prg(Mapper *mapper, uint16_t address, uint8_t value) {
+    mapper->prg_bank[0] = value;
+    mapper_map_prg_16k(mapper, 0, value);
+}
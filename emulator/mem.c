@@ -4,7 +4,13 @@
 #include "emulator.h"
 #include "mapper.h"
 #include "ppu.h"
+#include "savestate.h"
 
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void write_register(MEM *mem, uint16_t address, uint8_t value);
+static uint8_t read_register(MEM *mem, uint16_t address);
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
 void init_cpu_mem(Emulator *emulator) {
     MEM *mem = &emulator->mem;
     mem->emulator = emulator;
@@ -13,9 +19,144 @@ void init_cpu_mem(Emulator *emulator) {
 
     memset(mem->ram, 0, sizeof(mem->ram));
     memset(mem->cartridge_ram, 0, sizeof(mem->cartridge_ram));
+
+    // Everything falls back to the register handlers until it is mapped
+    memset(mem->read_map, 0, sizeof(mem->read_map));
+    memset(mem->write_map, 0, sizeof(mem->write_map));
+
+    // RAM is mirrored four times in 0x0000 - 0x1FFF
+    for (uint16_t address = 0; address < RAM_MIRROR_END; address += RAM_SIZE) {
+        mem_map_pages(mem, address / MEM_PAGE_SIZE, RAM_SIZE / MEM_PAGE_SIZE, mem->ram, mem->ram);
+    }
+
+    // Cartridge RAM. Its first page is shared with the APU/IO registers, so that one stays with the handlers.
+    uint8_t *cartridge_ram_page = mem->cartridge_ram + (0x4100 - APU_IO_REGISTER_END);
+    mem_map_pages(mem, 0x41, (PRG_RAM_END - 0x4100) / MEM_PAGE_SIZE, cartridge_ram_page, cartridge_ram_page);
+
+    // PRG-ROM (0x8000 - 0xFFFF) is mapped by the mapper
+}
+
+void mem_map_pages(MEM *mem, uint8_t first_page, size_t page_count, uint8_t *read_base, uint8_t *write_base) {
+    for (size_t i = 0; i < page_count; i++) {
+        mem->read_map[first_page + i] = read_base ? read_base + i * MEM_PAGE_SIZE : NULL;
+        mem->write_map[first_page + i] = write_base ? write_base + i * MEM_PAGE_SIZE : NULL;
+    }
 }
 
 void mem_write_8(MEM *mem, uint16_t address, uint8_t value) {
+    uint8_t *page = mem->write_map[address >> 8];
+    if (page) {
+        page[address & 0xFF] = value;
+        return;
+    }
+    write_register(mem, address, value);
+}
+
+uint8_t mem_read_8(MEM *mem, uint16_t address) {
+    const uint8_t *page = mem->read_map[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    return read_register(mem, address);
+}
+
+void mem_write_16(MEM *mem, uint16_t address, uint16_t value) {
+    mem_write_8(mem, address + 1, value >> 8);
+    mem_write_8(mem, address, value);
+}
+
+uint16_t mem_read_16(MEM *mem, uint16_t address) {
+    return (mem_read_8(mem, address + 1) << 8) | mem_read_8(mem, address);
+}
+
+void mem_push_stack_8(CPU *cpu, uint8_t value) {
+    mem_write_8(&cpu->emulator->mem, STACK_OFFSET + cpu->sp, value);
+    cpu->sp -= 1;
+}
+
+uint8_t mem_pop_stack_8(CPU *cpu) {
+    cpu->sp += 1;
+    uint16_t value = mem_read_8(&cpu->emulator->mem, STACK_OFFSET + cpu->sp);
+    return value;
+}
+
+void mem_push_stack_16(CPU *cpu, uint16_t value) {
+    mem_push_stack_8(cpu, (value >> 8) & 0xFF);
+    mem_push_stack_8(cpu, value & 0xFF);
+}
+
+uint16_t pop_stack_16(CPU *cpu) {
+    uint8_t low = mem_pop_stack_8(cpu);
+    uint8_t high = mem_pop_stack_8(cpu);
+    return (high << 8) | low;
+}
+
+uint8_t mem_const_read_8(const MEM *mem, uint16_t address) {
+    const uint8_t *page = mem->read_map[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+
+    if (address < RAM_MIRROR_END) {
+        return mem->ram[address & 0x07FF];
+    }
+
+    if (address < PPU_MIRROR_END) {
+        address = (address & 0x0007) + 0x2000;
+        const PPU *ppu = &mem->emulator->ppu;
+
+        switch (address) {
+        case 0x2002: // PPU_STATUS
+            return ppu->status.reg;
+        case 0x2004: // OAM_DATA
+            return ppu->oam[ppu->oam_addr];
+        case 0x2007: // PPU_DATA
+            return ppu_const_read_vram_data(ppu, address);
+        default:
+            return 0x00; // This is returned when reading rom a WRITE_ONLY PPU
+            // register
+        }
+    }
+
+    if (address < APU_IO_REGISTER_END) {
+        return mem->apu_io_reg[address - PPU_MIRROR_END];
+    }
+
+    if (address < PRG_RAM_END) {
+        return mem->cartridge_ram[address - APU_IO_REGISTER_END];
+    }
+
+    // else
+    Mapper *mapper = &mem->emulator->mapper;
+    return mapper->read_prg(mapper, address);
+}
+
+uint8_t *mem_get_pointer(MEM *mem, uint16_t address) {
+    uint8_t *page = mem->read_map[address >> 8];
+    if (page) {
+        return page + (address & 0xFF);
+    }
+    return NULL;
+}
+
+void mem_save_state(const MEM *mem, StateWriter *writer) {
+    state_write_bytes(writer, mem->ram, sizeof(mem->ram));
+    state_write_bytes(writer, mem->apu_io_reg, sizeof(mem->apu_io_reg));
+    state_write_bytes(writer, mem->cartridge_ram, sizeof(mem->cartridge_ram));
+    state_write_8(writer, mem->controller_shift_register);
+}
+
+void mem_load_state(MEM *mem, StateReader *reader) {
+    state_read_bytes(reader, mem->ram, sizeof(mem->ram));
+    state_read_bytes(reader, mem->apu_io_reg, sizeof(mem->apu_io_reg));
+    state_read_bytes(reader, mem->cartridge_ram, sizeof(mem->cartridge_ram));
+    mem->controller_shift_register = state_read_8(reader);
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// Handles writes to pages that aren't mapped to plain memory
+static void write_register(MEM *mem, uint16_t address, uint8_t value) {
     if (address < RAM_MIRROR_END) {
         mem->ram[address & 0x07FF] = value; // Handle RAM mirroring
         return;
@@ -23,6 +164,7 @@ void mem_write_8(MEM *mem, uint16_t address, uint8_t value) {
     PPU *ppu = &mem->emulator->ppu;
     if (address < PPU_MIRROR_END) {
         address = (address & 0x0007) + 0x2000;
+        ppu_catch_up(ppu); // The write has to land on the dot the CPU is at
 
         switch (address) {
         case 0x2000: // PPU_CONTROL
@@ -30,7 +172,7 @@ void mem_write_8(MEM *mem, uint16_t address, uint8_t value) {
             break;
         case 0x2001:
             // PPU_MASK
-            ppu->mask.reg = value;
+            ppu_set_mask(ppu, value);
             break;
         case 0x2003: // OAM_ADDRESS
             ppu->oam_addr = value;
@@ -50,22 +192,30 @@ void mem_write_8(MEM *mem, uint16_t address, uint8_t value) {
             break;
         default: break;
         }
+        return;
     }
 
     if (address < APU_IO_REGISTER_END) {
+        // The APU registers, 0x4014 (OAM DMA) and 0x4016 (controller strobe) are in between
+        if (address < 0x4014 || address == 0x4015 || address == 0x4017) {
+            apu_write_register(&mem->emulator->apu, address, value);
+            return;
+        }
+
         switch (address) {
         case 0x4014:
             ppu_dma(ppu, value);
+            break;
         case 0x4016:
 #ifdef RISC_V
             // set latch pin
             input_latch();
 #else
-            mem->controller_shift_register = sdl_poll_events();
+            // Set by the frontend once per frame, the emulator doesn't read any devices itself
+            mem->controller_shift_register = mem->emulator->controller_input;
 #endif
             break;
         }
-        // mem->apu_io_reg[address - PPU_MIRROR_END] = value;
         return;
     }
 
@@ -74,11 +224,13 @@ void mem_write_8(MEM *mem, uint16_t address, uint8_t value) {
         return;
     }
 
-    printf("Tried to write to illegal memory address: %04X", address);
-    exit(EXIT_FAILURE);
+    // PRG-ROM, writes go to the registers of the mapper
+    Mapper *mapper = &mem->emulator->mapper;
+    mapper->write_prg(mapper, address, value);
 }
 
-uint8_t mem_read_8(MEM *mem, uint16_t address) {
+// Handles reads from pages that aren't mapped to plain memory
+static uint8_t read_register(MEM *mem, uint16_t address) {
     if (address < RAM_MIRROR_END) {
         return mem->ram[address & 0x07FF];
     }
@@ -86,6 +238,7 @@ uint8_t mem_read_8(MEM *mem, uint16_t address) {
     if (address < PPU_MIRROR_END) {
         address = (address & 0x0007) + 0x2000;
         PPU *ppu = &mem->emulator->ppu;
+        ppu_catch_up(ppu);
 
         switch (address) {
         case 0x2002: // PPU_STATUS
@@ -102,6 +255,7 @@ uint8_t mem_read_8(MEM *mem, uint16_t address) {
 
     if (address < APU_IO_REGISTER_END) {
         switch (address) {
+        case 0x4015: return apu_read_status(&mem->emulator->apu);
         case 0x4016: {
 #ifdef RISC_V
             // pulse clock pin
@@ -112,74 +266,8 @@ uint8_t mem_read_8(MEM *mem, uint16_t address) {
             return data;
 #endif
         }
+        default: return 0x00; // open bus, the other registers are write only
         }
-        // return mem->apu_io_reg[address - PPU_MIRROR_END];
-    }
-
-    if (address < PRG_RAM_END) {
-        return mem->cartridge_ram[address - APU_IO_REGISTER_END];
-    }
-
-    // else
-    Mapper *mapper = &mem->emulator->mapper;
-    return mapper->read_prg(mapper, address);
-}
-
-void mem_write_16(MEM *mem, uint16_t address, uint16_t value) {
-    mem_write_8(mem, address + 1, value >> 8);
-    mem_write_8(mem, address, value);
-}
-
-uint16_t mem_read_16(MEM *mem, uint16_t address) {
-    return (mem_read_8(mem, address + 1) << 8) | mem_read_8(mem, address);
-}
-
-void mem_push_stack_8(CPU *cpu, uint8_t value) {
-    mem_write_8(&cpu->emulator->mem, STACK_OFFSET + cpu->sp, value);
-    cpu->sp -= 1;
-}
-
-uint8_t mem_pop_stack_8(CPU *cpu) {
-    cpu->sp += 1;
-    uint16_t value = mem_read_8(&cpu->emulator->mem, STACK_OFFSET + cpu->sp);
-    return value;
-}
-
-void mem_push_stack_16(CPU *cpu, uint16_t value) {
-    mem_push_stack_8(cpu, (value >> 8) & 0xFF);
-    mem_push_stack_8(cpu, value & 0xFF);
-}
-
-uint16_t pop_stack_16(CPU *cpu) {
-    uint8_t low = mem_pop_stack_8(cpu);
-    uint8_t high = mem_pop_stack_8(cpu);
-    return (high << 8) | low;
-}
-
-uint8_t mem_const_read_8(const MEM *mem, uint16_t address) {
-    if (address < RAM_MIRROR_END) {
-        return mem->ram[address & 0x07FF];
-    }
-
-    if (address < PPU_MIRROR_END) {
-        address = (address & 0x0007) + 0x2000;
-        const PPU *ppu = &mem->emulator->ppu;
-
-        switch (address) {
-        case 0x2002: // PPU_STATUS
-            return ppu->status.reg;
-        case 0x2004: // OAM_DATA
-            return ppu->oam[ppu->oam_addr];
-        case 0x2007: // PPU_DATA
-            return ppu_const_read_vram_data(ppu, address);
-        default:
-            return 0x00; // This is returned when reading rom a WRITE_ONLY PPU
-            // register
-        }
-    }
-
-    if (address < APU_IO_REGISTER_END) {
-        return mem->apu_io_reg[address - PPU_MIRROR_END];
     }
 
     if (address < PRG_RAM_END) {
@@ -190,10 +278,3 @@ uint8_t mem_const_read_8(const MEM *mem, uint16_t address) {
     Mapper *mapper = &mem->emulator->mapper;
     return mapper->read_prg(mapper, address);
 }
-
-uint8_t *mem_get_pointer(MEM *mem, uint16_t address) {
-    if (address < 0x2000) {
-        return mem->ram + (address & 0x7ff);
-    }
-    return NULL;
-}
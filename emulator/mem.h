@@ -26,11 +26,24 @@
 
 #define STACK_OFFSET 0x0100
 
+// CPU memory map granularity
+#define MEM_PAGE_SIZE 0x100
+#define MEM_PAGE_COUNT 0x100
+
 // Forward declarations
 typedef struct Emulator Emulator;
 typedef struct CPU CPU;
+typedef struct StateWriter StateWriter;
+typedef struct StateReader StateReader;
 
 typedef struct MEM {
+    // CPU memory map with one entry per 256 byte page.
+    // Pages of plain memory (RAM, PRG-RAM, PRG-ROM) point directly to their backing storage,
+    // so that accessing them is a single indexed load or store. NULL entries (PPU and APU/IO registers,
+    // mapper registers) fall back to the register handlers in mem.c.
+    uint8_t *read_map[MEM_PAGE_COUNT];
+    uint8_t *write_map[MEM_PAGE_COUNT];
+
     uint8_t ram[RAM_SIZE];
     // PPU registers are stored in the PPU struct
     uint8_t apu_io_reg[APU_IO_REGISTER_SIZE];
@@ -49,6 +62,15 @@ typedef struct MEM {
  */
 void init_cpu_mem(Emulator *emulator);
 
+/**
+ *  Maps `page_count` 256 byte pages of CPU memory, starting at page `first_page`, to plain memory.
+ *
+ *  Reads from the pages are served from `read_base` and writes go to `write_base`.
+ *  Passing NULL makes the pages fall back to the register handlers instead.
+ *  This is called by the mapper at init and whenever it switches banks.
+ */
+void mem_map_pages(MEM *mem, uint8_t first_page, size_t page_count, uint8_t *read_base, uint8_t *write_base);
+
 /**
  *  Writes a byte to memory.
  *
@@ -114,6 +136,22 @@ uint16_t pop_stack_16(CPU *cpu);
  */
 uint8_t mem_const_read_8(const MEM *mem, uint16_t address);
 
-uint8_t* mem_get_pointer(MEM *mem, uint16_t address);
+/**
+ *  Returns a pointer to the byte at `address` if it is located in plain memory,
+ *  otherwise NULL. The pointer is valid until the end of its 256 byte page.
+ */
+uint8_t *mem_get_pointer(MEM *mem, uint16_t address);
+
+/**
+ *  Writes RAM, cartridge RAM and the IO registers to a save state chunk.
+ *  The memory map is not saved, it belongs to the mapper.
+ */
+void mem_save_state(const MEM *mem, StateWriter *writer);
+
+/**
+ *  Reads a chunk written by `mem_save_state`.
+ *
+ */
+void mem_load_state(MEM *mem, StateReader *reader);
 
 #endif // CPU_MEM_H
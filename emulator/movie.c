@@ -0,0 +1,209 @@
+#include "movie.h"
+
+#ifndef RISC_V
+#define MOVIE_HEADER_SIZE 14 // magic, version, ROM checksum, frame count
+#define MAX_RUN_LENGTH 256   // frames per pair, the count is stored minus one
+#define HASH_LINE_SIZE 16
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static uint8_t read_recorder(InputSource *source);
+static uint8_t read_player(InputSource *source);
+static void put_16(uint8_t *out, uint16_t value);
+static void put_32(uint8_t *out, uint32_t value);
+static uint16_t get_16(const uint8_t *in);
+static uint32_t get_32(const uint8_t *in);
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+void movie_init(Movie *movie, uint32_t rom_checksum) {
+    movie->rom_checksum = rom_checksum;
+    movie->frame_count = 0;
+    movie->capacity = 0;
+    movie->inputs = NULL;
+}
+
+void movie_free(Movie *movie) {
+    free(movie->inputs);
+    movie->inputs = NULL;
+    movie->frame_count = movie->capacity = 0;
+}
+
+void movie_append(Movie *movie, uint8_t buttons) {
+    if (movie->frame_count == movie->capacity) {
+        // An hour of input is about 200 KB, doubling keeps the reallocations rare
+        uint32_t capacity = movie->capacity ? movie->capacity * 2 : 60 * 60;
+        uint8_t *inputs = realloc(movie->inputs, capacity);
+        if (inputs == NULL) {
+            printf("Fatal Error: Failed to allocate the movie\n");
+            exit(EXIT_FAILURE);
+        }
+        movie->inputs = inputs;
+        movie->capacity = capacity;
+    }
+    movie->inputs[movie->frame_count++] = buttons;
+}
+
+int movie_save(const Movie *movie, const char *path) {
+    // Every pair covers at least one frame
+    uint8_t *buffer = malloc(MOVIE_HEADER_SIZE + 2 * (size_t)movie->frame_count);
+    if (buffer == NULL) {
+        printf("Error: Failed to allocate the movie buffer\n");
+        return -1;
+    }
+
+    memcpy(buffer, MOVIE_MAGIC, 4);
+    put_16(buffer + 4, MOVIE_VERSION);
+    put_32(buffer + 6, movie->rom_checksum);
+    put_32(buffer + 10, movie->frame_count);
+    size_t size = MOVIE_HEADER_SIZE;
+
+    for (uint32_t frame = 0; frame < movie->frame_count;) {
+        uint8_t buttons = movie->inputs[frame];
+        uint32_t run_length = 1;
+        while (frame + run_length < movie->frame_count && run_length < MAX_RUN_LENGTH &&
+               movie->inputs[frame + run_length] == buttons) {
+            run_length++;
+        }
+        buffer[size++] = buttons;
+        buffer[size++] = (uint8_t)(run_length - 1);
+        frame += run_length;
+    }
+
+    FILE *fp = fopen(path, "wb");
+    size_t written = fp ? fwrite(buffer, 1, size, fp) : 0;
+    if (fp)
+        fclose(fp);
+    free(buffer);
+    if (written != size) {
+        printf("Error: Failed to save movie to %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int movie_load(Movie *movie, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        printf("Error: Failed to open file %s\n", path);
+        return -1;
+    }
+
+    uint8_t header[MOVIE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) || memcmp(header, MOVIE_MAGIC, 4) != 0) {
+        printf("Error: Not a movie\n");
+        fclose(fp);
+        return -1;
+    }
+    if (get_16(header + 4) != MOVIE_VERSION) {
+        printf("Error: Unsupported movie version %u\n", get_16(header + 4));
+        fclose(fp);
+        return -1;
+    }
+
+    movie_init(movie, get_32(header + 6));
+    uint32_t frame_count = get_32(header + 10);
+    uint8_t pair[2];
+    while (movie->frame_count < frame_count && fread(pair, 1, sizeof(pair), fp) == sizeof(pair)) {
+        for (uint32_t i = 0; i <= pair[1]; i++) {
+            movie_append(movie, pair[0]);
+        }
+    }
+    fclose(fp);
+
+    if (movie->frame_count != frame_count) {
+        printf("Error: Movie is truncated, %u of %u frames\n", movie->frame_count, frame_count);
+        movie_free(movie);
+        return -1;
+    }
+    return 0;
+}
+
+void movie_recorder_init(MovieRecorder *recorder, Movie *movie, InputSource *input) {
+    recorder->source.read = read_recorder;
+    recorder->source.data = recorder;
+    recorder->input = input;
+    recorder->movie = movie;
+}
+
+void movie_player_init(MoviePlayer *player, const Movie *movie) {
+    player->source.read = read_player;
+    player->source.data = player;
+    player->movie = movie;
+    player->position = 0;
+}
+
+int frame_hash_log_open(FrameHashLog *log, const char *path, int verify) {
+    log->file = fopen(path, verify ? "r" : "w");
+    if (log->file == NULL) {
+        printf("Error: Failed to open file %s\n", path);
+        return -1;
+    }
+    log->verify = verify;
+    log->frame = 0;
+    log->mismatches = 0;
+    log->first_mismatch = 0;
+    return 0;
+}
+
+void frame_hash_log_add(FrameHashLog *log, uint32_t hash) {
+    if (!log->verify) {
+        fprintf(log->file, "%08X\n", hash);
+        log->frame++;
+        return;
+    }
+
+    // Frames past the end of the log count as mismatches
+    char line[HASH_LINE_SIZE];
+    int matches = fgets(line, sizeof(line), log->file) && (uint32_t)strtoul(line, NULL, 16) == hash;
+    if (!matches) {
+        if (log->mismatches == 0)
+            log->first_mismatch = log->frame;
+        log->mismatches++;
+    }
+    log->frame++;
+}
+
+uint32_t frame_hash_log_close(FrameHashLog *log) {
+    fclose(log->file);
+    log->file = NULL;
+    if (!log->verify)
+        return 0;
+
+    if (log->mismatches == 0) {
+        printf("Frame hashes:                %u frames identical\n", log->frame);
+    } else {
+        printf("Frame hashes:                %u of %u frames differ, the first is frame %u\n", log->mismatches,
+               log->frame, log->first_mismatch);
+    }
+    return log->mismatches;
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+static uint8_t read_recorder(InputSource *source) {
+    MovieRecorder *recorder = source->data;
+    uint8_t buttons = recorder->input ? recorder->input->read(recorder->input) : 0;
+    movie_append(recorder->movie, buttons);
+    return buttons;
+}
+
+static uint8_t read_player(InputSource *source) {
+    MoviePlayer *player = source->data;
+    if (player->position >= player->movie->frame_count)
+        return 0;
+    return player->movie->inputs[player->position++];
+}
+
+static void put_16(uint8_t *out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void put_32(uint8_t *out, uint32_t value) {
+    put_16(out, value & 0xFFFF);
+    put_16(out + 2, value >> 16);
+}
+
+static uint16_t get_16(const uint8_t *in) { return in[0] | (in[1] << 8); }
+
+static uint32_t get_32(const uint8_t *in) { return get_16(in) | ((uint32_t)get_16(in + 2) << 16); }
+#endif // RISC_V
@@ -0,0 +1,125 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "common.h"
+
+#ifndef RISC_V
+#define MOVIE_MAGIC "NESM"
+#define MOVIE_VERSION 1
+
+/**
+ *  Where the controller input comes from.
+ *
+ *  `emulator_run_frame` reads the source once at the start of every frame, and the strobe at 0x4016
+ *  latches that value. So the input can't change in the middle of a frame, and a run from power-on is
+ *  fully determined by the ROM and the sequence of values.
+ */
+typedef struct InputSource {
+    uint8_t (*read)(struct InputSource *source); // buttons held during the next frame
+    void *data;
+} InputSource;
+
+/**
+ *  Controller input of a run from power-on, one byte per frame.
+ *
+ *  On disk the bytes are run-length encoded, since the buttons rarely change from one frame to the
+ *  next: the header (MOVIE_MAGIC, version, ROM checksum and frame count, little endian) is followed by
+ *  pairs of the buttons and the number of frames minus one they are held for.
+ */
+typedef struct Movie {
+    uint32_t rom_checksum; // of the ROM it was recorded with, see Emulator
+    uint32_t frame_count;
+    uint32_t capacity;
+    uint8_t *inputs;
+} Movie;
+
+// Records what another source returns into a movie
+typedef struct MovieRecorder {
+    InputSource source;
+    InputSource *input; // NULL for no buttons
+    Movie *movie;
+} MovieRecorder;
+
+// Feeds a movie back. There are no buttons held after its end.
+typedef struct MoviePlayer {
+    InputSource source;
+    const Movie *movie;
+    uint32_t position;
+} MoviePlayer;
+
+/**
+ *  Log of the hash of every frame (see `emulator_frame_hash`), one hexadecimal hash per line.
+ *
+ *  When writing, every frame is appended. When verifying, every frame is compared against the log of
+ *  an earlier run, e.g. the one that recorded the movie, which makes a replay bit-exact or not.
+ */
+typedef struct FrameHashLog {
+    FILE *file;
+    int verify;
+    uint32_t frame;
+    uint32_t mismatches;
+    uint32_t first_mismatch;
+} FrameHashLog;
+
+/**
+ *  Sets up an empty movie for the ROM with `rom_checksum`.
+ *
+ */
+void movie_init(Movie *movie, uint32_t rom_checksum);
+
+/**
+ *  Frees the inputs of the movie.
+ *
+ */
+void movie_free(Movie *movie);
+
+/**
+ *  Appends the input of one frame.
+ *
+ */
+void movie_append(Movie *movie, uint8_t buttons);
+
+/**
+ *  Writes the movie to `path`. Returns 0 on success, -1 on failure.
+ *
+ */
+int movie_save(const Movie *movie, const char *path);
+
+/**
+ *  Reads a movie written by `movie_save` into `movie`, which is initialized by it.
+ *  Returns 0 on success, -1 if the file can't be read or isn't a movie.
+ */
+int movie_load(Movie *movie, const char *path);
+
+/**
+ *  Sets up `recorder` to append everything `input` returns to `movie`.
+ *  Use `&recorder->source` as the input of the emulator.
+ */
+void movie_recorder_init(MovieRecorder *recorder, Movie *movie, InputSource *input);
+
+/**
+ *  Sets up `player` to feed `movie` from its first frame.
+ *  Use `&player->source` as the input of the emulator.
+ */
+void movie_player_init(MoviePlayer *player, const Movie *movie);
+
+/**
+ *  Opens the log at `path` for writing, or for verifying against if `verify` is set.
+ *  Returns 0 on success, -1 on failure.
+ */
+int frame_hash_log_open(FrameHashLog *log, const char *path, int verify);
+
+/**
+ *  Writes or verifies the hash of the next frame.
+ *
+ */
+void frame_hash_log_add(FrameHashLog *log, uint32_t hash);
+
+/**
+ *  Closes the log. When verifying, prints the result and returns the number of frames that didn't
+ *  match, otherwise returns 0.
+ */
+uint32_t frame_hash_log_close(FrameHashLog *log);
+#endif // RISC_V
+
+#endif
@@ -2,28 +2,34 @@
 #define OPCODES_H
 // clang-format off
 
-typedef enum Opcode{
-    // Legal Opcodes
-    ADC, AND, ASL, BCC, BCS,
-    BEQ, BIT, BMI, BNE, BPL,
-    BRK, BVC, BVS, CLC, CLD,
-    CLI, CLV, CMP, CPX, CPY,
-    DEC, DEX, DEY, EOR, INC,
-    INX, INY, JMP, JSR, LDA,
-    LDX, LDY, LSR, NOP, ORA,
-    PHA, PHP, PLA, PLP, ROL,
-    ROR, RTI, RTS, SBC, SEC,
-    SED, SEI, STA, STX, STY,
-    TAX, TAY, TSX, TXA, TXS,
-    TYA,
-
+// X-macro list of every opcode mnemonic.
+// Used to generate the Opcode enum below, the opcode dispatch switch in cpu.c
+// and the names of the instruction log in debug.c.
+#define OPCODE_LIST(X) \
+    /* Legal Opcodes */ \
+    X(ADC) X(AND) X(ASL) X(BCC) X(BCS) \
+    X(BEQ) X(BIT) X(BMI) X(BNE) X(BPL) \
+    X(BRK) X(BVC) X(BVS) X(CLC) X(CLD) \
+    X(CLI) X(CLV) X(CMP) X(CPX) X(CPY) \
+    X(DEC) X(DEX) X(DEY) X(EOR) X(INC) \
+    X(INX) X(INY) X(JMP) X(JSR) X(LDA) \
+    X(LDX) X(LDY) X(LSR) X(NOP) X(ORA) \
+    X(PHA) X(PHP) X(PLA) X(PLP) X(ROL) \
+    X(ROR) X(RTI) X(RTS) X(SBC) X(SEC) \
+    X(SED) X(SEI) X(STA) X(STX) X(STY) \
+    X(TAX) X(TAY) X(TSX) X(TXA) X(TXS) \
+    X(TYA) \
+    /* Illegal Opcodes */ \
+    X(ALR) X(ANC) X(AN2) X(ANE) X(ARR) \
+    X(DCP) X(ISB) X(LAS) X(LAX) X(LXA) \
+    X(RLA) X(RRA) X(SAX) X(SBX) X(SHA) \
+    X(SHX) X(SHY) X(SLO) X(SRE) X(TAS) \
+    X(UBC) X(JAM)
 
-    // Illegal Opcodes
-    ALR, ANC, AN2, ANE, ARR,
-    DCP, ISB, LAS, LAX, LXA,
-    RLA, RRA, SAX, SBX, SHA,
-    SHX, SHY, SLO, SRE, TAS,
-    UBC, JAM,
+typedef enum Opcode{
+#define X(op) op,
+    OPCODE_LIST(X)
+#undef X
 } Opcode;
 
 typedef enum AddressMode {
@@ -55,81 +61,85 @@ typedef struct Instruction {
 // Lookup Tables //
 //---------------//
 
+// X-macro table of all 256 opcode bytes: X(byte, opcode, address mode, base cycles)
+// This is the single source of truth for decoding. The lookup tables below and the
+// pre-decoded handler table in cpu.c are all generated from it.
+#define OPCODE_TABLE(X) \
+    X(0x00, BRK, IMP, 7)   X(0x01, ORA, XIN, 6)   X(0x02, JAM, UNK, 0)   X(0x03, SLO, XIN, 8) \
+    X(0x04, NOP, ZP0, 3)   X(0x05, ORA, ZP0, 3)   X(0x06, ASL, ZP0, 5)   X(0x07, SLO, ZP0, 5) \
+    X(0x08, PHP, IMP, 3)   X(0x09, ORA, IMM, 2)   X(0x0A, ASL, ACC, 2)   X(0x0B, ANC, IMM, 2) \
+    X(0x0C, NOP, ABS, 4)   X(0x0D, ORA, ABS, 4)   X(0x0E, ASL, ABS, 6)   X(0x0F, SLO, ABS, 6) \
+    X(0x10, BPL, REL, 2)   X(0x11, ORA, YIN, 5)   X(0x12, JAM, UNK, 0)   X(0x13, SLO, YIN, 8) \
+    X(0x14, NOP, ZPX, 4)   X(0x15, ORA, ZPX, 4)   X(0x16, ASL, ZPX, 6)   X(0x17, SLO, ZPX, 6) \
+    X(0x18, CLC, IMP, 2)   X(0x19, ORA, ABY, 4)   X(0x1A, NOP, IMP, 2)   X(0x1B, SLO, ABY, 7) \
+    X(0x1C, NOP, ABX, 4)   X(0x1D, ORA, ABX, 4)   X(0x1E, ASL, ABX, 7)   X(0x1F, SLO, ABX, 7) \
+    X(0x20, JSR, ABS, 6)   X(0x21, AND, XIN, 6)   X(0x22, JAM, UNK, 0)   X(0x23, RLA, XIN, 8) \
+    X(0x24, BIT, ZP0, 3)   X(0x25, AND, ZP0, 3)   X(0x26, ROL, ZP0, 5)   X(0x27, RLA, ZP0, 5) \
+    X(0x28, PLP, IMP, 4)   X(0x29, AND, IMM, 2)   X(0x2A, ROL, ACC, 2)   X(0x2B, ANC, IMM, 2) \
+    X(0x2C, BIT, ABS, 4)   X(0x2D, AND, ABS, 4)   X(0x2E, ROL, ABS, 6)   X(0x2F, RLA, ABS, 6) \
+    X(0x30, BMI, REL, 2)   X(0x31, AND, YIN, 5)   X(0x32, JAM, UNK, 0)   X(0x33, RLA, YIN, 8) \
+    X(0x34, NOP, ZPX, 4)   X(0x35, AND, ZPX, 4)   X(0x36, ROL, ZPX, 6)   X(0x37, RLA, ZPX, 6) \
+    X(0x38, SEC, IMP, 2)   X(0x39, AND, ABY, 4)   X(0x3A, NOP, IMP, 2)   X(0x3B, RLA, ABY, 7) \
+    X(0x3C, NOP, ABX, 4)   X(0x3D, AND, ABX, 4)   X(0x3E, ROL, ABX, 7)   X(0x3F, RLA, ABX, 7) \
+    X(0x40, RTI, IMP, 6)   X(0x41, EOR, XIN, 6)   X(0x42, JAM, UNK, 0)   X(0x43, SRE, XIN, 8) \
+    X(0x44, NOP, ZP0, 3)   X(0x45, EOR, ZP0, 3)   X(0x46, LSR, ZP0, 5)   X(0x47, SRE, ZP0, 5) \
+    X(0x48, PHA, IMP, 3)   X(0x49, EOR, IMM, 2)   X(0x4A, LSR, ACC, 2)   X(0x4B, ALR, IMM, 2) \
+    X(0x4C, JMP, ABS, 3)   X(0x4D, EOR, ABS, 4)   X(0x4E, LSR, ABS, 6)   X(0x4F, SRE, ABS, 6) \
+    X(0x50, BVC, REL, 2)   X(0x51, EOR, YIN, 5)   X(0x52, JAM, UNK, 0)   X(0x53, SRE, YIN, 8) \
+    X(0x54, NOP, ZPX, 4)   X(0x55, EOR, ZPX, 4)   X(0x56, LSR, ZPX, 6)   X(0x57, SRE, ZPX, 6) \
+    X(0x58, CLI, IMP, 2)   X(0x59, EOR, ABY, 4)   X(0x5A, NOP, IMP, 2)   X(0x5B, SRE, ABY, 7) \
+    X(0x5C, NOP, ABX, 4)   X(0x5D, EOR, ABX, 4)   X(0x5E, LSR, ABX, 7)   X(0x5F, SRE, ABX, 7) \
+    X(0x60, RTS, IMP, 6)   X(0x61, ADC, XIN, 6)   X(0x62, JAM, UNK, 0)   X(0x63, RRA, XIN, 8) \
+    X(0x64, NOP, ZP0, 3)   X(0x65, ADC, ZP0, 3)   X(0x66, ROR, ZP0, 5)   X(0x67, RRA, ZP0, 5) \
+    X(0x68, PLA, IMP, 4)   X(0x69, ADC, IMM, 2)   X(0x6A, ROR, ACC, 2)   X(0x6B, ARR, IMM, 2) \
+    X(0x6C, JMP, IND, 5)   X(0x6D, ADC, ABS, 4)   X(0x6E, ROR, ABS, 6)   X(0x6F, RRA, ABS, 6) \
+    X(0x70, BVS, REL, 2)   X(0x71, ADC, YIN, 5)   X(0x72, JAM, UNK, 0)   X(0x73, RRA, YIN, 8) \
+    X(0x74, NOP, ZPX, 4)   X(0x75, ADC, ZPX, 4)   X(0x76, ROR, ZPX, 6)   X(0x77, RRA, ZPX, 6) \
+    X(0x78, SEI, IMP, 2)   X(0x79, ADC, ABY, 4)   X(0x7A, NOP, IMP, 2)   X(0x7B, RRA, ABY, 7) \
+    X(0x7C, NOP, ABX, 4)   X(0x7D, ADC, ABX, 4)   X(0x7E, ROR, ABX, 7)   X(0x7F, RRA, ABX, 7) \
+    X(0x80, NOP, IMM, 2)   X(0x81, STA, XIN, 6)   X(0x82, NOP, IMM, 2)   X(0x83, SAX, XIN, 6) \
+    X(0x84, STY, ZP0, 3)   X(0x85, STA, ZP0, 3)   X(0x86, STX, ZP0, 3)   X(0x87, SAX, ZP0, 3) \
+    X(0x88, DEY, IMP, 2)   X(0x89, NOP, IMM, 2)   X(0x8A, TXA, IMP, 2)   X(0x8B, ANE, IMM, 2) \
+    X(0x8C, STY, ABS, 4)   X(0x8D, STA, ABS, 4)   X(0x8E, STX, ABS, 4)   X(0x8F, SAX, ABS, 4) \
+    X(0x90, BCC, REL, 2)   X(0x91, STA, YIN, 6)   X(0x92, JAM, UNK, 0)   X(0x93, SHA, YIN, 6) \
+    X(0x94, STY, ZPX, 4)   X(0x95, STA, ZPX, 4)   X(0x96, STX, ZPY, 4)   X(0x97, SAX, ZPY, 4) \
+    X(0x98, TYA, IMP, 2)   X(0x99, STA, ABY, 5)   X(0x9A, TXS, IMP, 2)   X(0x9B, TAS, ABY, 5) \
+    X(0x9C, SHY, ABX, 5)   X(0x9D, STA, ABX, 5)   X(0x9E, SHX, ABY, 5)   X(0x9F, SHA, ABY, 5) \
+    X(0xA0, LDY, IMM, 2)   X(0xA1, LDA, XIN, 6)   X(0xA2, LDX, IMM, 2)   X(0xA3, LAX, XIN, 6) \
+    X(0xA4, LDY, ZP0, 3)   X(0xA5, LDA, ZP0, 3)   X(0xA6, LDX, ZP0, 3)   X(0xA7, LAX, ZP0, 3) \
+    X(0xA8, TAY, IMP, 2)   X(0xA9, LDA, IMM, 2)   X(0xAA, TAX, IMP, 2)   X(0xAB, LAX, IMM, 2) \
+    X(0xAC, LDY, ABS, 4)   X(0xAD, LDA, ABS, 4)   X(0xAE, LDX, ABS, 4)   X(0xAF, LAX, ABS, 4) \
+    X(0xB0, BCS, REL, 2)   X(0xB1, LDA, YIN, 5)   X(0xB2, JAM, UNK, 0)   X(0xB3, LAX, YIN, 5) \
+    X(0xB4, LDY, ZPX, 4)   X(0xB5, LDA, ZPX, 4)   X(0xB6, LDX, ZPY, 4)   X(0xB7, LAX, ZPY, 4) \
+    X(0xB8, CLV, IMP, 2)   X(0xB9, LDA, ABY, 4)   X(0xBA, TSX, IMP, 2)   X(0xBB, LAS, ABY, 4) \
+    X(0xBC, LDY, ABX, 4)   X(0xBD, LDA, ABX, 4)   X(0xBE, LDX, ABY, 4)   X(0xBF, LAX, ABY, 4) \
+    X(0xC0, CPY, IMM, 2)   X(0xC1, CMP, XIN, 6)   X(0xC2, NOP, IMM, 2)   X(0xC3, DCP, XIN, 8) \
+    X(0xC4, CPY, ZP0, 3)   X(0xC5, CMP, ZP0, 3)   X(0xC6, DEC, ZP0, 5)   X(0xC7, DCP, ZP0, 5) \
+    X(0xC8, INY, IMP, 2)   X(0xC9, CMP, IMM, 2)   X(0xCA, DEX, IMP, 2)   X(0xCB, SBX, IMM, 2) \
+    X(0xCC, CPY, ABS, 4)   X(0xCD, CMP, ABS, 4)   X(0xCE, DEC, ABS, 6)   X(0xCF, DCP, ABS, 6) \
+    X(0xD0, BNE, REL, 2)   X(0xD1, CMP, YIN, 5)   X(0xD2, JAM, UNK, 0)   X(0xD3, DCP, YIN, 8) \
+    X(0xD4, NOP, ZPX, 4)   X(0xD5, CMP, ZPX, 4)   X(0xD6, DEC, ZPX, 6)   X(0xD7, DCP, ZPX, 6) \
+    X(0xD8, CLD, IMP, 2)   X(0xD9, CMP, ABY, 4)   X(0xDA, NOP, IMP, 2)   X(0xDB, DCP, ABY, 7) \
+    X(0xDC, NOP, ABX, 4)   X(0xDD, CMP, ABX, 4)   X(0xDE, DEC, ABX, 7)   X(0xDF, DCP, ABX, 7) \
+    X(0xE0, CPX, IMM, 2)   X(0xE1, SBC, XIN, 6)   X(0xE2, NOP, IMM, 2)   X(0xE3, ISB, XIN, 8) \
+    X(0xE4, CPX, ZP0, 3)   X(0xE5, SBC, ZP0, 3)   X(0xE6, INC, ZP0, 5)   X(0xE7, ISB, ZP0, 5) \
+    X(0xE8, INX, IMP, 2)   X(0xE9, SBC, IMM, 2)   X(0xEA, NOP, IMP, 2)   X(0xEB, SBC, IMM, 2) \
+    X(0xEC, CPX, ABS, 4)   X(0xED, SBC, ABS, 4)   X(0xEE, INC, ABS, 6)   X(0xEF, ISB, ABS, 6) \
+    X(0xF0, BEQ, REL, 2)   X(0xF1, SBC, YIN, 5)   X(0xF2, JAM, UNK, 0)   X(0xF3, ISB, YIN, 8) \
+    X(0xF4, NOP, ZPX, 4)   X(0xF5, SBC, ZPX, 4)   X(0xF6, INC, ZPX, 6)   X(0xF7, ISB, ZPX, 6) \
+    X(0xF8, SED, IMP, 2)   X(0xF9, SBC, ABY, 4)   X(0xFA, NOP, IMP, 2)   X(0xFB, ISB, ABY, 7) \
+    X(0xFC, NOP, ABX, 4)   X(0xFD, SBC, ABX, 4)   X(0xFE, INC, ABX, 7)   X(0xFF, ISB, ABX, 7)
+
 static const Instruction instruction_lookup[] = {
-    {BRK, IMP}, {ORA, XIN}, {JAM, UNK}, {SLO, XIN}, {NOP, ZP0}, {ORA, ZP0}, {ASL, ZP0}, {SLO, ZP0}, // 0x00 - 0x07
-    {PHP, IMP}, {ORA, IMM}, {ASL, ACC}, {ANC, IMM}, {NOP, ABS}, {ORA, ABS}, {ASL, ABS}, {SLO, ABS}, // 0x08 - 0x0F
-    {BPL, REL}, {ORA, YIN}, {JAM, UNK}, {SLO, YIN}, {NOP, ZPX}, {ORA, ZPX}, {ASL, ZPX}, {SLO, ZPX}, // 0x10 - 0x17
-    {CLC, IMP}, {ORA, ABY}, {NOP, IMP}, {SLO, ABY}, {NOP, ABX}, {ORA, ABX}, {ASL, ABX}, {SLO, ABX}, // 0x18 - 0x1F
-    {JSR, ABS}, {AND, XIN}, {JAM, UNK}, {RLA, XIN}, {BIT, ZP0}, {AND, ZP0}, {ROL, ZP0}, {RLA, ZP0}, // 0x20 - 0x27
-    {PLP, IMP}, {AND, IMM}, {ROL, ACC}, {ANC, IMM}, {BIT, ABS}, {AND, ABS}, {ROL, ABS}, {RLA, ABS}, // 0x28 - 0x2F
-    {BMI, REL}, {AND, YIN}, {JAM, UNK}, {RLA, YIN}, {NOP, ZPX}, {AND, ZPX}, {ROL, ZPX}, {RLA, ZPX}, // 0x30 - 0x37
-    {SEC, IMP}, {AND, ABY}, {NOP, IMP}, {RLA, ABY}, {NOP, ABX}, {AND, ABX}, {ROL, ABX}, {RLA, ABX}, // 0x38 - 0x3F
-    {RTI, IMP}, {EOR, XIN}, {JAM, UNK}, {SRE, XIN}, {NOP, ZP0}, {EOR, ZP0}, {LSR, ZP0}, {SRE, ZP0}, // 0x40 - 0x47
-    {PHA, IMP}, {EOR, IMM}, {LSR, ACC}, {ALR, IMM}, {JMP, ABS}, {EOR, ABS}, {LSR, ABS}, {SRE, ABS}, // 0x48 - 0x4F
-    {BVC, REL}, {EOR, YIN}, {JAM, UNK}, {SRE, YIN}, {NOP, ZPX}, {EOR, ZPX}, {LSR, ZPX}, {SRE, ZPX}, // 0x50 - 0x57
-    {CLI, IMP}, {EOR, ABY}, {NOP, IMP}, {SRE, ABY}, {NOP, ABX}, {EOR, ABX}, {LSR, ABX}, {SRE, ABX}, // 0x58 - 0x5F
-    {RTS, IMP}, {ADC, XIN}, {JAM, UNK}, {RRA, XIN}, {NOP, ZP0}, {ADC, ZP0}, {ROR, ZP0}, {RRA, ZP0}, // 0x60 - 0x67
-    {PLA, IMP}, {ADC, IMM}, {ROR, ACC}, {ARR, IMM}, {JMP, IND}, {ADC, ABS}, {ROR, ABS}, {RRA, ABS}, // 0x68 - 0x6F
-    {BVS, REL}, {ADC, YIN}, {JAM, UNK}, {RRA, YIN}, {NOP, ZPX}, {ADC, ZPX}, {ROR, ZPX}, {RRA, ZPX}, // 0x70 - 0x77
-    {SEI, IMP}, {ADC, ABY}, {NOP, IMP}, {RRA, ABY}, {NOP, ABX}, {ADC, ABX}, {ROR, ABX}, {RRA, ABX}, // 0x78 - 0x7F
-    {NOP, IMM}, {STA, XIN}, {NOP, IMM}, {SAX, XIN}, {STY, ZP0}, {STA, ZP0}, {STX, ZP0}, {SAX, ZP0}, // 0x80 - 0x87
-    {DEY, IMP}, {NOP, IMM}, {TXA, IMP}, {ANE, IMM}, {STY, ABS}, {STA, ABS}, {STX, ABS}, {SAX, ABS}, // 0x88 - 0x8F
-    {BCC, REL}, {STA, YIN}, {JAM, UNK}, {SHA, YIN}, {STY, ZPX}, {STA, ZPX}, {STX, ZPY}, {SAX, ZPY}, // 0x90 - 0x97
-    {TYA, IMP}, {STA, ABY}, {TXS, IMP}, {TAS, ABY}, {SHY, ABX}, {STA, ABX}, {SHX, ABY}, {SHA, ABY}, // 0x98 - 0x9F
-    {LDY, IMM}, {LDA, XIN}, {LDX, IMM}, {LAX, XIN}, {LDY, ZP0}, {LDA, ZP0}, {LDX, ZP0}, {LAX, ZP0}, // 0xA0 - 0xA7
-    {TAY, IMP}, {LDA, IMM}, {TAX, IMP}, {LAX, IMM}, {LDY, ABS}, {LDA, ABS}, {LDX, ABS}, {LAX, ABS}, // 0xA8 - 0xAF
-    {BCS, REL}, {LDA, YIN}, {JAM, UNK}, {LAX, YIN}, {LDY, ZPX}, {LDA, ZPX}, {LDX, ZPY}, {LAX, ZPY}, // 0xB0 - 0xB7
-    {CLV, IMP}, {LDA, ABY}, {TSX, IMP}, {LAS, ABY}, {LDY, ABX}, {LDA, ABX}, {LDX, ABY}, {LAX, ABY}, // 0xB8 - 0xBF
-    {CPY, IMM}, {CMP, XIN}, {NOP, IMM}, {DCP, XIN}, {CPY, ZP0}, {CMP, ZP0}, {DEC, ZP0}, {DCP, ZP0}, // 0xC0 - 0xC7
-    {INY, IMP}, {CMP, IMM}, {DEX, IMP}, {SBX, IMM}, {CPY, ABS}, {CMP, ABS}, {DEC, ABS}, {DCP, ABS}, // 0xC8 - 0xCF
-    {BNE, REL}, {CMP, YIN}, {JAM, UNK}, {DCP, YIN}, {NOP, ZPX}, {CMP, ZPX}, {DEC, ZPX}, {DCP, ZPX}, // 0xD0 - 0xD7
-    {CLD, IMP}, {CMP, ABY}, {NOP, IMP}, {DCP, ABY}, {NOP, ABX}, {CMP, ABX}, {DEC, ABX}, {DCP, ABX}, // 0xD8 - 0xDF
-    {CPX, IMM}, {SBC, XIN}, {NOP, IMM}, {ISB, XIN}, {CPX, ZP0}, {SBC, ZP0}, {INC, ZP0}, {ISB, ZP0}, // 0xE0 - 0xE7
-    {INX, IMP}, {SBC, IMM}, {NOP, IMP}, {SBC, IMM}, {CPX, ABS}, {SBC, ABS}, {INC, ABS}, {ISB, ABS}, // 0xE8 - 0xEF
-    {BEQ, REL}, {SBC, YIN}, {JAM, UNK}, {ISB, YIN}, {NOP, ZPX}, {SBC, ZPX}, {INC, ZPX}, {ISB, ZPX}, // 0xF0 - 0xF7
-    {SED, IMP}, {SBC, ABY}, {NOP, IMP}, {ISB, ABY}, {NOP, ABX}, {SBC, ABX}, {INC, ABX}, {ISB, ABX}  // 0xF8 - 0xFF
+#define X(byte, op, mode, cycles) {op, mode},
+    OPCODE_TABLE(X)
+#undef X
 };
 
 static const uint8_t cycle_lookup[] = {
-    7, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
-    2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-    6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
-    2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-    6, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
-    2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-    6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
-    2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
-    2, 6, 0, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
-    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
-    2, 5, 0, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
-    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
-    2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
-    2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
-};
-
-static const char* opcode_name_lookup[] = {
-    // Legal
-    "ADC", "AND", "ASL", "BCC", "BCS",
-    "BEQ", "BIT", "BMI", "BNE", "BPL",
-    "BRK", "BVC", "BVS", "CLC", "CLD",
-    "CLI", "CLV", "CMP", "CPX", "CPY",
-    "DEC", "DEX", "DEY", "EOR", "INC",
-    "INX", "INY", "JMP", "JSR", "LDA",
-    "LDX", "LDY", "LSR", "NOP", "ORA",
-    "PHA", "PHP", "PLA", "PLP", "ROL",
-    "ROR", "RTI", "RTS", "SBC", "SEC",
-    "SED", "SEI", "STA", "STX", "STY",
-    "TAX", "TAY", "TSX", "TXA", "TXS",
-    "TYA",
-
-    // Illegal
-    "ALR", "ANC", "AN2", "ANE", "ARR",
-    "DCP", "ISB", "LAS", "LAX", "LXA",
-    "RLA", "RRA", "SAX", "SBX", "SHA",
-    "SHX", "SHY", "SLO", "SRE", "TAS",
-    "UBC", "JAM"
+#define X(byte, op, mode, cycles) cycles,
+    OPCODE_TABLE(X)
+#undef X
 };
 
 // clang-format on
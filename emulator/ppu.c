@@ -1,6 +1,8 @@
 
 #include "ppu.h"
 #include "emulator.h"
+#include "profiler.h"
+#include "savestate.h"
 
 // --------------- STATIC FORWARD DECLARATIONS ---------------- //
 static void increment_scroll_x(PPU *ppu);
@@ -10,13 +12,25 @@ static void reload_scroll_y(PPU *ppu);
 static void load_shifters(PPU *ppu);
 static void update_shifters(PPU *ppu);
 static uint16_t calculate_vram_index(Mapper *mapper, uint16_t address);
-static uint32_t get_color_from_palette(PPU *ppu, uint8_t palette, uint8_t pixel);
-#ifdef RISC_V
-static uint8_t get_color_from_palette_8(PPU *ppu, uint8_t palette, uint8_t pixel);
-#endif
+static uint8_t get_color_from_palette(const PPU *ppu, uint8_t palette, uint8_t pixel);
+static void update_palette_color(PPU *ppu, uint8_t index);
+static uint32_t emphasize_color(uint32_t rgb, uint8_t emphasis);
+static void fetch_tile_id(PPU *ppu);
+static void fetch_tile_attr(PPU *ppu);
+static void fetch_tile_row(PPU *ppu);
 static void prepare_background_tile(PPU *ppu);
 static void draw_pixel(PPU *ppu);
-static uint8_t reverse_bits(uint8_t n);
+static void check_sprite_zero_hit(PPU *ppu);
+static void output_pixel(PPU *ppu, size_t x, uint8_t palette, uint8_t pixel);
+static void render_scanline(PPU *ppu);
+static void finish_scanline(PPU *ppu);
+static void skip_scanline(PPU *ppu);
+static size_t dots_until_next_event(const PPU *ppu);
+static void evaluate_sprites(PPU *ppu);
+static void fetch_sprites(PPU *ppu);
+static void watch_a12(PPU *ppu, size_t dot);
+static void watch_sprite_fetch(PPU *ppu);
+static size_t dots_until_scanline_clock(const PPU *ppu);
 
 // --------------- PUBLIC FUNCTIONS --------------------------- //
 void ppu_init(Emulator *emulator) {
@@ -33,19 +47,54 @@ void ppu_reset(PPU *ppu) {
     ppu->cur_scanline = ppu->cur_dot = 0;
     ppu->frame_complete = 0;
     ppu->next_tile_id = ppu->next_tile_attr = 0x00;
-    ppu->next_tile_lsb = ppu->next_tile_msb = 0x00;
-    ppu->shifter_pattern_lo = ppu->shifter_attr_hi = 0x0000;
+    ppu->next_tile_row = 0x0000;
+    ppu->shifter_pattern = 0x00000000;
     ppu->shifter_attr_lo = ppu->shifter_attr_hi = 0x0000;
     ppu->cycle_counter = 0;
+    ppu->pending_dots = 0;
+    ppu->scanline_renderer = TRUE;
+    ppu->skip_rendering = FALSE;
+    ppu->a12_high_position = 0;
+    ppu->next_event_dots = dots_until_next_event(ppu);
     ppu->sprite_count = 0;
     ppu->sprite_zero_hit_possible = 0;
     ppu->sprite_zero_hit_rendering = 0;
     memset(ppu->vram, 0, sizeof(ppu->vram));
     memset(ppu->palette, 0, sizeof(ppu->palette));
+    memset(ppu->palette_colors, 0, sizeof(ppu->palette_colors));
     memset(ppu->oam, 0, sizeof(ppu->oam));
     memset(ppu->sprite_scanline, 0, sizeof(ppu->sprite_scanline));
+    memset(ppu->framebuffer, 0, sizeof(ppu->framebuffer));
+}
+
+void ppu_advance(PPU *ppu, size_t cpu_cycles) {
+    ppu->pending_dots += cpu_cycles * 3;
+    if (ppu->pending_dots >= ppu->next_event_dots) {
+        ppu_catch_up(ppu);
+    }
 }
 
+void ppu_catch_up(PPU *ppu) {
+    PROFILE_BEGIN(PROFILE_PPU);
+    while (ppu->pending_dots > 0) {
+        // If the whole visible part of a scanline is due, no register can change in the middle of it,
+        // so it can be rendered in one pass. Otherwise we fall back to running dot by dot.
+        if (ppu->cur_dot == 1 && ppu->pending_dots >= VISIBLE_DOTS_PER_SCANLINE &&
+            ppu->cur_scanline < VISIBLE_SCANLINES && ppu->scanline_renderer && ppu->mask.render_background) {
+            render_scanline(ppu);
+            ppu->pending_dots -= VISIBLE_DOTS_PER_SCANLINE;
+            continue;
+        }
+
+        ppu_run_cycle(ppu);
+        ppu->pending_dots--;
+    }
+    ppu->next_event_dots = dots_until_next_event(ppu);
+    PROFILE_END(PROFILE_PPU);
+}
+
+void ppu_reschedule(PPU *ppu) { ppu->next_event_dots = dots_until_next_event(ppu); }
+
 void ppu_run_cycle(PPU *ppu) {
     CPU *cpu = &ppu->emulator->cpu;
 
@@ -68,8 +117,9 @@ void ppu_run_cycle(PPU *ppu) {
             }
         }
 
-        else if (ppu->cur_dot < 321) {
-        } // IDLE
+        else if (ppu->cur_dot < 321) { // Sprite fetches for the next row
+            watch_sprite_fetch(ppu);
+        }
 
         else if (ppu->cur_dot < 337) { // Prepare next row
             prepare_background_tile(ppu);
@@ -106,8 +156,7 @@ void ppu_run_cycle(PPU *ppu) {
                 ppu->status.vblank = FALSE;
                 ppu->status.sprite_zero_hit = FALSE;
                 ppu->status.sprite_overflow = FALSE;
-                memset(ppu->sprite_shifter_pattern_lo, 0, sizeof(ppu->sprite_shifter_pattern_lo));
-                memset(ppu->sprite_shifter_pattern_hi, 0, sizeof(ppu->sprite_shifter_pattern_hi));
+                memset(ppu->sprite_shifter_pattern, 0, sizeof(ppu->sprite_shifter_pattern));
             }
 
             prepare_background_tile(ppu);
@@ -136,6 +185,10 @@ void ppu_run_cycle(PPU *ppu) {
             prepare_background_tile(ppu);
         }
 
+        if (257 < ppu->cur_dot && ppu->cur_dot < 321) {
+            watch_sprite_fetch(ppu);
+        }
+
         // Skip a cycle on odd frames (NTSC only)
         if (ppu->cur_dot == 339 && ppu->emulator->cur_frame % 2 == 1 && ppu->mask.render_background) {
             ppu->cur_dot++;
@@ -159,58 +212,11 @@ void ppu_run_cycle(PPU *ppu) {
 
     // Sprite rendering (scanline based)
     if (ppu->cur_dot == 257 && ppu->cur_scanline != 261) {
-        memset(ppu->sprite_scanline, 0xFF, sizeof(ppu->sprite_scanline));
-        ppu->sprite_count = 0;
-        ppu->sprite_zero_hit_possible = FALSE;
-
-        for (size_t oam_entity_index = 0; oam_entity_index < 64 && ppu->sprite_count < 9; oam_entity_index++) {
-            uint8_t sprite_y = ppu->oam[oam_entity_index * 4];
-            size_t y_diff = (ppu->cur_scanline - (size_t) sprite_y);
-            if (y_diff < (ppu->ctrl.sprite_size ? 16 : 8)) {
-                if (oam_entity_index == 0)
-                    ppu->sprite_zero_hit_possible = TRUE;
-                if (ppu->sprite_count < 8) {
-                    memcpy(&ppu->sprite_scanline[ppu->sprite_count * 4], &ppu->oam[oam_entity_index * 4], 4);
-                    ppu->sprite_count++;
-                }
-            }
-        }
-        ppu->status.sprite_overflow = (ppu->sprite_count > 8);
+        evaluate_sprites(ppu);
     }
 
     if (ppu->cur_dot == 340) {
-        for (uint8_t i = 0; i < ppu->sprite_count; i++) {
-            uint16_t sprite_pattern_addr_lo;
-            uint8_t flipped_horizontal = ppu->sprite_scanline[i * 4 + 2] & 0x40;
-            uint8_t flipped_vertical = ppu->sprite_scanline[i * 4 + 2] & 0x80;
-            uint8_t sprite_y = ppu->sprite_scanline[i * 4];
-            uint16_t y_diff = ppu->cur_scanline - (uint16_t)sprite_y;
-            uint8_t sprite_id = ppu->sprite_scanline[i * 4 + 1];
-
-            if (!ppu->ctrl.sprite_size) {
-                // 8 pixel height
-                uint16_t row = flipped_vertical ? (7 - y_diff) : y_diff;
-                sprite_pattern_addr_lo = (ppu->ctrl.pattern_sprite << 12) | (sprite_id << 4) | row;
-            } else {
-                // 16 pixel height
-                uint16_t cell = y_diff < 8 ? (sprite_id & 0xFE) : (sprite_id & 0xFE) + 1;
-                uint16_t row = flipped_vertical ? (7 - (y_diff & 0x07)) : (y_diff & 0x07);
-                sprite_pattern_addr_lo = ((sprite_id & 0x01) << 12) | (cell << 4) | row;
-            }
-
-            uint16_t sprite_pattern_addr_hi = sprite_pattern_addr_lo + 1;
-            uint8_t sprite_pattern_bits_lo = ppu_const_read_vram_data(ppu, sprite_pattern_addr_lo);
-            uint8_t sprite_pattern_bits_hi = ppu_const_read_vram_data(ppu, sprite_pattern_addr_hi);
-
-            // if flipped horizontally we just reverse the bytes
-            if (flipped_horizontal) {
-                sprite_pattern_bits_lo = reverse_bits(sprite_pattern_bits_lo);
-                sprite_pattern_bits_hi = reverse_bits(sprite_pattern_bits_hi);
-            }
-
-            ppu->sprite_shifter_pattern_lo[i] = sprite_pattern_bits_lo;
-            ppu->sprite_shifter_pattern_hi[i] = sprite_pattern_bits_hi;
-        }
+        fetch_sprites(ppu);
     }
 }
 
@@ -221,6 +227,17 @@ void ppu_set_ctrl(PPU *ppu, uint8_t value) {
     ppu->temp_addr.nametable_y = ppu->ctrl.nametable_y;
 }
 
+void ppu_set_mask(PPU *ppu, uint8_t value) {
+    uint8_t grayscale_changed = (ppu->mask.reg ^ value) & 0x01;
+    ppu->mask.reg = value;
+
+    if (grayscale_changed) {
+        for (uint8_t i = 0; i < sizeof(ppu->palette); i++) {
+            update_palette_color(ppu, i);
+        }
+    }
+}
+
 // src: https://www.nesdev.org/wiki/PPU_scrolling#$2002_(PPUSTATUS)_read
 uint8_t ppu_read_status(PPU *ppu) {
     uint8_t status = ppu->status.reg;
@@ -280,9 +297,11 @@ void ppu_write_vram_data(PPU *ppu, uint8_t value) {
     else if (address < 0x4000) {
         address = address & 0x1F;
         ppu->palette[address] = value;
+        update_palette_color(ppu, address);
 
         if (address % 4 == 0) {
             ppu->palette[address ^ 0x10] = value;
+            update_palette_color(ppu, address ^ 0x10);
         }
     }
 
@@ -350,6 +369,8 @@ void ppu_dma(PPU *ppu, uint8_t page) {
     MEM *mem = &ppu->emulator->mem;
     CPU *cpu = &ppu->emulator->cpu;
 
+    ppu_catch_up(ppu); // Sprite evaluation must not see the new OAM too early
+
     uint8_t* ptr = mem_get_pointer(mem, (uint16_t)page << 8);
     if (ptr == NULL) {
         // TODO slow DMA
@@ -364,6 +385,119 @@ void ppu_dma(PPU *ppu, uint8_t page) {
     cpu->dma_cycles += 513 + (cpu->total_cycles & 1);
 }
 
+void ppu_build_rgb_palette(const PPU *ppu, uint32_t *palette) {
+    uint8_t emphasis = ppu->mask.reg >> 5;
+    for (int i = 0; i < 0x40; i++) {
+        palette[i] = emphasis ? emphasize_color(nes_palette_rgb[i], emphasis) : nes_palette_rgb[i];
+    }
+}
+
+#ifdef RISC_V
+void ppu_build_8bit_palette(const PPU *ppu, uint8_t *palette) {
+    uint8_t emphasis = ppu->mask.reg >> 5;
+    for (int i = 0; i < 0x40; i++) {
+        if (emphasis == 0) {
+            palette[i] = nes_palette_8bit[i];
+            continue;
+        }
+        // RRRGGGBB
+        uint32_t rgb = emphasize_color(nes_palette_rgb[i], emphasis);
+        palette[i] = ((rgb >> 16) & 0xE0) | ((rgb >> 11) & 0x1C) | ((rgb >> 6) & 0x03);
+    }
+}
+#endif
+
+void ppu_save_state(const PPU *ppu, StateWriter *writer) {
+    state_write_8(writer, ppu->ctrl.reg);
+    state_write_8(writer, ppu->mask.reg);
+    state_write_8(writer, ppu->status.reg);
+    state_write_8(writer, ppu->oam_addr);
+    state_write_16(writer, ppu->vram_addr.reg);
+    state_write_16(writer, ppu->temp_addr.reg);
+    state_write_8(writer, ppu->write_latch);
+    state_write_8(writer, ppu->data_read_buffer);
+    state_write_8(writer, ppu->fine_x);
+
+    state_write_16(writer, ppu->cur_scanline);
+    state_write_16(writer, ppu->cur_dot);
+    state_write_8(writer, ppu->frame_complete);
+    state_write_size(writer, ppu->cycle_counter);
+    state_write_size(writer, ppu->pending_dots);
+
+    state_write_8(writer, ppu->next_tile_id);
+    state_write_8(writer, ppu->next_tile_attr);
+    state_write_16(writer, ppu->next_tile_row);
+    state_write_32(writer, ppu->shifter_pattern);
+    state_write_16(writer, ppu->shifter_attr_lo);
+    state_write_16(writer, ppu->shifter_attr_hi);
+
+    state_write_bytes(writer, ppu->vram, sizeof(ppu->vram));
+    state_write_bytes(writer, ppu->palette, sizeof(ppu->palette));
+
+    state_write_bytes(writer, ppu->oam, sizeof(ppu->oam));
+    state_write_bytes(writer, ppu->sprite_scanline, sizeof(ppu->sprite_scanline));
+    state_write_8(writer, ppu->sprite_count);
+    for (int i = 0; i < 8; i++) {
+        state_write_16(writer, ppu->sprite_shifter_pattern[i]);
+    }
+    state_write_8(writer, ppu->sprite_zero_hit_possible);
+    state_write_8(writer, ppu->sprite_zero_hit_rendering);
+    state_write_size(writer, ppu->a12_high_position);
+
+    // So that a loaded state can be shown right away. Rewind snapshots leave it out to stay small.
+    if (writer->include_framebuffer) {
+        state_write_bytes(writer, ppu->framebuffer, sizeof(ppu->framebuffer));
+    }
+}
+
+void ppu_load_state(PPU *ppu, StateReader *reader) {
+    ppu->ctrl.reg = state_read_8(reader);
+    ppu->mask.reg = state_read_8(reader);
+    ppu->status.reg = state_read_8(reader);
+    ppu->oam_addr = state_read_8(reader);
+    ppu->vram_addr.reg = state_read_16(reader);
+    ppu->temp_addr.reg = state_read_16(reader);
+    ppu->write_latch = state_read_8(reader);
+    ppu->data_read_buffer = state_read_8(reader);
+    ppu->fine_x = state_read_8(reader);
+
+    ppu->cur_scanline = state_read_16(reader);
+    ppu->cur_dot = state_read_16(reader);
+    ppu->frame_complete = state_read_8(reader);
+    ppu->cycle_counter = state_read_size(reader);
+    ppu->pending_dots = state_read_size(reader);
+
+    ppu->next_tile_id = state_read_8(reader);
+    ppu->next_tile_attr = state_read_8(reader);
+    ppu->next_tile_row = state_read_16(reader);
+    ppu->shifter_pattern = state_read_32(reader);
+    ppu->shifter_attr_lo = state_read_16(reader);
+    ppu->shifter_attr_hi = state_read_16(reader);
+
+    state_read_bytes(reader, ppu->vram, sizeof(ppu->vram));
+    state_read_bytes(reader, ppu->palette, sizeof(ppu->palette));
+
+    state_read_bytes(reader, ppu->oam, sizeof(ppu->oam));
+    state_read_bytes(reader, ppu->sprite_scanline, sizeof(ppu->sprite_scanline));
+    ppu->sprite_count = state_read_8(reader);
+    for (int i = 0; i < 8; i++) {
+        ppu->sprite_shifter_pattern[i] = state_read_16(reader);
+    }
+    ppu->sprite_zero_hit_possible = state_read_8(reader);
+    ppu->sprite_zero_hit_rendering = state_read_8(reader);
+    ppu->a12_high_position = state_read_size(reader);
+
+    if (reader->size - reader->position >= sizeof(ppu->framebuffer)) {
+        state_read_bytes(reader, ppu->framebuffer, sizeof(ppu->framebuffer));
+    }
+
+    // Rebuild what is derived from the loaded state
+    for (uint8_t i = 0; i < sizeof(ppu->palette_colors); i++) {
+        update_palette_color(ppu, i);
+    }
+    ppu->next_event_dots = dots_until_next_event(ppu); // measured from cur_dot, like in ppu_catch_up
+}
+
 // --------------- STATIC FUNCTIONS --------------------------- //
 
 // src: https://www.nesdev.org/wiki/PPU_scrolling#Coarse_X_increment
@@ -421,16 +555,14 @@ static void reload_scroll_y(PPU *ppu) {
 }
 
 static void load_shifters(PPU *ppu) {
-    ppu->shifter_pattern_lo = (ppu->shifter_pattern_lo & 0xFF00) | ppu->next_tile_lsb;
-    ppu->shifter_pattern_hi = (ppu->shifter_pattern_hi & 0xFF00) | ppu->next_tile_msb;
+    ppu->shifter_pattern = (ppu->shifter_pattern & 0xFFFF0000) | ppu->next_tile_row;
     ppu->shifter_attr_lo = (ppu->shifter_attr_lo & 0xFF00) | ((ppu->next_tile_attr & 0b01) ? 0xFF : 0x00);
     ppu->shifter_attr_hi = (ppu->shifter_attr_hi & 0xFF00) | ((ppu->next_tile_attr & 0b10) ? 0xFF : 0x00);
 }
 
 static void update_shifters(PPU *ppu) {
     if (ppu->mask.render_background) {
-        ppu->shifter_pattern_lo <<= 1;
-        ppu->shifter_pattern_hi <<= 1;
+        ppu->shifter_pattern <<= 2;
         ppu->shifter_attr_lo <<= 1;
         ppu->shifter_attr_hi <<= 1;
     }
@@ -443,10 +575,7 @@ static void update_shifters(PPU *ppu) {
             }
             else
             {
-                uint8_t pattern_lo = ppu->sprite_shifter_pattern_lo[i];
-                uint8_t pattern_hi = ppu->sprite_shifter_pattern_hi[i];
-                ppu->sprite_shifter_pattern_lo[i] = pattern_lo << 1;
-                ppu->sprite_shifter_pattern_hi[i] = pattern_hi << 1;
+                ppu->sprite_shifter_pattern[i] <<= 2;
             }
         }
     }
@@ -467,55 +596,60 @@ static uint16_t calculate_vram_index(Mapper *mapper, uint16_t address) {
     return vram_index;
 }
 
-static uint32_t get_color_from_palette(PPU *ppu, uint8_t palette, uint8_t pixel) {
-    uint32_t index = ppu_const_read_vram_data(ppu, (0x3F00 + (palette << 2) + pixel)) & 0x3F;
-    return nes_palette_rgb[index];
+// Returns the NES color index (0x00 - 0x3F) of a pixel
+static uint8_t get_color_from_palette(const PPU *ppu, uint8_t palette, uint8_t pixel) {
+    return ppu->palette_colors[(palette << 2) | pixel];
 }
 
-#ifdef RISC_V
-static uint8_t get_color_from_palette_8(PPU *ppu, uint8_t palette, uint8_t pixel) {
-    uint32_t index = ppu_const_read_vram_data(ppu, (0x3F00 + (palette << 2) + pixel)) & 0x3F;
-    return nes_palette_8bit[index];
+// Resolves one entry of palette memory to the color index that is drawn
+static void update_palette_color(PPU *ppu, uint8_t index) {
+    // Grayscale only keeps the brightness (upper two bits) of the color
+    uint8_t mask = ppu->mask.grayscale ? 0x30 : 0x3F;
+    ppu->palette_colors[index] = ppu->palette[index] & mask;
+}
+
+// fetch next nametable tile id
+static void fetch_tile_id(PPU *ppu) {
+    uint16_t addr = 0x2000 | (ppu->vram_addr.reg & 0x0FFF);
+    ppu->next_tile_id = ppu_const_read_vram_data(ppu, addr);
+}
+
+// fetch next tile attribute
+static void fetch_tile_attr(PPU *ppu) {
+    uint16_t addr = 0x23C0 | (ppu->vram_addr.nametable_y << 11 | ppu->vram_addr.nametable_x << 10 |
+                              ((ppu->vram_addr.coarse_y >> 2) << 3) | (ppu->vram_addr.coarse_x >> 2));
+    ppu->next_tile_attr = ppu_const_read_vram_data(ppu, addr);
+    if (ppu->vram_addr.coarse_y & 0x02)
+        ppu->next_tile_attr >>= 4;
+    if (ppu->vram_addr.coarse_x & 0x02)
+        ppu->next_tile_attr >>= 2;
+    ppu->next_tile_attr &= 0x03;
+}
+
+// fetch next pattern table tile row (both bit planes, already decoded)
+static void fetch_tile_row(PPU *ppu) {
+    Mapper *mapper = &ppu->emulator->mapper;
+    uint16_t tile_address = (ppu->ctrl.pattern_background << 12) + ((uint16_t)ppu->next_tile_id << 4);
+    ppu->next_tile_row = mapper_get_tile(mapper, tile_address)->rows[ppu->vram_addr.fine_y];
 }
-#endif
 
 static void prepare_background_tile(PPU *ppu) {
     update_shifters(ppu);
 
     switch (ppu->cur_dot % 8) {
-    case 1: {
-        // fetch next nametable tile id
+    case 1:
         load_shifters(ppu);
-        uint16_t addr = 0x2000 | (ppu->vram_addr.reg & 0x0FFF);
-        ppu->next_tile_id = ppu_const_read_vram_data(ppu, addr);
+        fetch_tile_id(ppu);
         break;
-    }
-    case 3: {
-        // fetch next tile attribute
-        uint16_t addr = 0x23C0 | (ppu->vram_addr.nametable_y << 11 | ppu->vram_addr.nametable_x << 10 |
-                                  ((ppu->vram_addr.coarse_y >> 2) << 3) | (ppu->vram_addr.coarse_x >> 2));
-        ppu->next_tile_attr = ppu_const_read_vram_data(ppu, addr);
-        if (ppu->vram_addr.coarse_y & 0x02)
-            ppu->next_tile_attr >>= 4;
-        if (ppu->vram_addr.coarse_x & 0x02)
-            ppu->next_tile_attr >>= 2;
-        ppu->next_tile_attr &= 0x03;
-        break;
-    }
-    case 5: {
-        // fetch next pattern table tile row (LSB)
-        ppu->next_tile_lsb = ppu_const_read_vram_data(ppu, (ppu->ctrl.pattern_background << 12) +
-                                                               ((uint16_t)ppu->next_tile_id << 4) +
-                                                               (ppu->vram_addr.fine_y) + 0);
+    case 3:
+        fetch_tile_attr(ppu);
         break;
-    }
-    case 7: {
-        // fetch next pattern table tile row (MSB)
-        ppu->next_tile_msb = ppu_const_read_vram_data(ppu, (ppu->ctrl.pattern_background << 12) +
-                                                               ((uint16_t)ppu->next_tile_id << 4) +
-                                                               (ppu->vram_addr.fine_y) + 8);
+    case 5:
+        fetch_tile_row(ppu);
+        if (ppu->ctrl.pattern_background) {
+            watch_a12(ppu, ppu->cur_dot);
+        }
         break;
-    }
     case 0: // increment vram_addr to next nametable tile
         increment_scroll_x(ppu);
         break;
@@ -529,9 +663,7 @@ static void draw_pixel(PPU *ppu) {
     if (ppu->mask.render_background) {
         uint16_t bit_mux = 0x8000 >> ppu->fine_x;
 
-        uint8_t p0_pixel = (ppu->shifter_pattern_lo & bit_mux) > 0;
-        uint8_t p1_pixel = (ppu->shifter_pattern_hi & bit_mux) > 0;
-        bg_pixel = (p1_pixel << 1) | p0_pixel;
+        bg_pixel = (ppu->shifter_pattern >> (30 - 2 * ppu->fine_x)) & 0x03;
 
         uint8_t pal0 = (ppu->shifter_attr_lo & bit_mux) > 0;
         uint8_t pal1 = (ppu->shifter_attr_hi & bit_mux) > 0;
@@ -550,9 +682,7 @@ static void draw_pixel(PPU *ppu) {
             uint8_t sprite_attr  = ppu->sprite_scanline[i * 4 + 2];
 
             if (sprite_x == 0) {
-                uint8_t sprite_pixel_lo = (ppu->sprite_shifter_pattern_lo[i] & 0x80) > 0;
-                uint8_t sprite_pixel_hi = (ppu->sprite_shifter_pattern_hi[i] & 0x80) > 0;
-                sprite_pixel = (sprite_pixel_hi << 1) | sprite_pixel_lo;
+                sprite_pixel = ppu->sprite_shifter_pattern[i] >> 14;
 
                 sprite_palette = (sprite_attr & 0x03) + 0x04;
                 sprite_priority = (sprite_attr & 0x20) == 0;
@@ -567,6 +697,13 @@ static void draw_pixel(PPU *ppu) {
         }
     }
 
+    if (ppu->skip_rendering) {
+        if (sprite_pixel != 0 && bg_pixel != 0) {
+            check_sprite_zero_hit(ppu);
+        }
+        return;
+    }
+
     uint8_t pixel = 0x00;
     uint8_t palette = 0x00;
 
@@ -589,29 +726,348 @@ static void draw_pixel(PPU *ppu) {
             palette = bg_palette;
         }
 
-        if (ppu->sprite_zero_hit_possible && ppu->sprite_zero_hit_rendering) {
-            if (ppu->mask.render_background & ppu->mask.render_sprites) {
-                if (ppu->mask.render_background_left & ppu->mask.render_sprites_left) {
-                    if (9 <= ppu->cur_dot && ppu->cur_dot < 258) ppu->status.sprite_zero_hit = TRUE;
-                } else {
-                    if (1 <= ppu->cur_dot && ppu->cur_dot < 258) ppu->status.sprite_zero_hit = TRUE;
-                }
+        check_sprite_zero_hit(ppu);
+    }
+
+    // Dot 257 goes through the pixel logic as well, but is outside the screen
+    if (ppu->cur_dot <= VISIBLE_DOTS_PER_SCANLINE) {
+        output_pixel(ppu, ppu->cur_dot - 1, palette, pixel);
+    }
+}
+
+// Called by draw_pixel where an opaque sprite pixel meets an opaque background pixel
+static void check_sprite_zero_hit(PPU *ppu) {
+    if (ppu->sprite_zero_hit_possible && ppu->sprite_zero_hit_rendering) {
+        if (ppu->mask.render_background & ppu->mask.render_sprites) {
+            if (ppu->mask.render_background_left & ppu->mask.render_sprites_left) {
+                if (9 <= ppu->cur_dot && ppu->cur_dot < 258) ppu->status.sprite_zero_hit = TRUE;
+            } else {
+                if (1 <= ppu->cur_dot && ppu->cur_dot < 258) ppu->status.sprite_zero_hit = TRUE;
             }
         }
     }
+}
 
-#ifdef RISC_V
-    uint8_t color = get_color_from_palette_8(ppu, palette, pixel);
-    vga_screen_put_pixel(ppu->cur_dot, ppu->cur_scanline, color);
-#else
-    uint32_t color = get_color_from_palette(ppu, palette, pixel);
-    sdl_put_pixel_nes_screen(ppu->cur_dot, ppu->cur_scanline, color);
-#endif
+static void output_pixel(PPU *ppu, size_t x, uint8_t palette, uint8_t pixel) {
+    ppu->framebuffer[ppu->cur_scanline * VISIBLE_DOTS_PER_SCANLINE + x] = get_color_from_palette(ppu, palette, pixel);
+}
+
+// Returns how many dots the PPU can fall behind before the CPU would notice without touching
+// a PPU register, i.e. until vblank starts (NMI), the frame is complete or the mapper might raise an IRQ.
+static size_t dots_until_next_event(const PPU *ppu) {
+    const size_t position = ppu->cur_scanline * DOTS_PER_SCANLINE + ppu->cur_dot;
+    const size_t vblank_position = 241 * DOTS_PER_SCANLINE + 1;
+    // One dot early, as the last dot of odd frames might be skipped
+    const size_t frame_end_position = NTSC_SCANLINES_PER_FRAME * DOTS_PER_SCANLINE - 1;
+
+    size_t dots;
+    if (position <= vblank_position) {
+        dots = vblank_position - position + 1;
+    } else if (position < frame_end_position) {
+        dots = frame_end_position - position;
+    } else {
+        return 1;
+    }
+
+    const Mapper *mapper = &ppu->emulator->mapper;
+    if (mapper->clock_scanline && mapper->irq_enabled) {
+        size_t clock_dots = dots_until_scanline_clock(ppu);
+        if (clock_dots < dots)
+            dots = clock_dots;
+    }
+    return dots;
+}
+
+// Returns the dots until the next point where the scanline counter of the mapper is usually clocked,
+// counted like dots_until_next_event. That is the first sprite fetch of a rendered scanline, or the
+// first fetch of the next row if only the background uses the pattern table at 0x1000.
+static size_t dots_until_scanline_clock(const PPU *ppu) {
+    const size_t position = ppu->cur_scanline * DOTS_PER_SCANLINE + ppu->cur_dot;
+    size_t clock_dot = ppu->ctrl.pattern_background && !ppu->ctrl.pattern_sprite && !ppu->ctrl.sprite_size ? 325 : 261;
+
+    size_t scanline = ppu->cur_scanline;
+    if (ppu->cur_dot > clock_dot) {
+        scanline++;
+    }
+    if (VISIBLE_SCANLINES <= scanline && scanline < NTSC_SCANLINES_PER_FRAME - 1) {
+        scanline = NTSC_SCANLINES_PER_FRAME - 1; // the pre-render scanline
+    }
+    // Past the pre-render scanline the end of the frame comes first anyway
+    return scanline * DOTS_PER_SCANLINE + clock_dot - position + 1;
+}
+
+// Called for pattern fetches with A12 high. A12 has to be low for a while before the mapper sees it
+// rise, so the fetches of a scanline (8 dots apart) only clock its scanline counter once.
+// src: https://www.nesdev.org/wiki/MMC3#IRQ_Specifics
+#define A12_MIN_LOW_DOTS 16
+
+static void watch_a12(PPU *ppu, size_t dot) {
+    Mapper *mapper = &ppu->emulator->mapper;
+    if (!mapper->clock_scanline || (!ppu->mask.render_background && !ppu->mask.render_sprites))
+        return;
+
+    const size_t frame_dots = NTSC_SCANLINES_PER_FRAME * DOTS_PER_SCANLINE;
+    size_t position = ppu->cur_scanline * DOTS_PER_SCANLINE + dot;
+    size_t low_dots = (position + frame_dots - ppu->a12_high_position) % frame_dots;
+    ppu->a12_high_position = position;
+
+    if (low_dots >= A12_MIN_LOW_DOTS) {
+        mapper->clock_scanline(mapper);
+    }
+}
+
+// The sprite pattern fetches (dots 257 - 320), one per sprite slot. Unused slots fetch tile 0xFF.
+static void watch_sprite_fetch(PPU *ppu) {
+    if (ppu->cur_dot % 8 != 5)
+        return;
+
+    uint8_t a12 = ppu->ctrl.pattern_sprite;
+    if (ppu->ctrl.sprite_size) {
+        uint8_t slot = (ppu->cur_dot - 257) / 8;
+        a12 = slot < ppu->sprite_count ? ppu->sprite_scanline[slot * 4 + 1] & 0x01 : 1;
+    }
+    if (a12) {
+        watch_a12(ppu, ppu->cur_dot);
+    }
+}
+
+size_t ppu_dots_until_status_change(const PPU *ppu, size_t dots_before) {
+    const size_t position = ppu->cur_scanline * DOTS_PER_SCANLINE + ppu->cur_dot + ppu->pending_dots;
+    const size_t vblank_position = 241 * DOTS_PER_SCANLINE + 1;
+    const size_t pre_render_position = 261 * DOTS_PER_SCANLINE + 1;
+
+    if (position < dots_before) {
+        return 0; // the window starts in the previous frame
+    }
+    const size_t start = position - dots_before;
+
+    // Sprite zero hit and sprite overflow can be set on any visible scanline
+    if ((ppu->mask.render_background || ppu->mask.render_sprites) && start < VISIBLE_SCANLINES * DOTS_PER_SCANLINE) {
+        return 0;
+    }
+
+    size_t change_position;
+    if (start <= vblank_position) {
+        change_position = vblank_position;
+    } else if (start <= pre_render_position) {
+        change_position = pre_render_position;
+    } else {
+        return 0;
+    }
+    return change_position < position ? 0 : change_position - position + 1;
+}
+
+// Finds the (at most 8) sprites on the current scanline and copies them to sprite_scanline
+static void evaluate_sprites(PPU *ppu) {
+    PROFILE_BEGIN(PROFILE_SPRITES);
+    memset(ppu->sprite_scanline, 0xFF, sizeof(ppu->sprite_scanline));
+    ppu->sprite_count = 0;
+    ppu->sprite_zero_hit_possible = FALSE;
+
+    for (size_t oam_entity_index = 0; oam_entity_index < 64 && ppu->sprite_count < 9; oam_entity_index++) {
+        uint8_t sprite_y = ppu->oam[oam_entity_index * 4];
+        size_t y_diff = (ppu->cur_scanline - (size_t) sprite_y);
+        if (y_diff < (ppu->ctrl.sprite_size ? 16 : 8)) {
+            if (oam_entity_index == 0)
+                ppu->sprite_zero_hit_possible = TRUE;
+            if (ppu->sprite_count < 8) {
+                memcpy(&ppu->sprite_scanline[ppu->sprite_count * 4], &ppu->oam[oam_entity_index * 4], 4);
+                ppu->sprite_count++;
+            }
+        }
+    }
+    ppu->status.sprite_overflow = (ppu->sprite_count > 8);
+    PROFILE_END(PROFILE_SPRITES);
+}
+
+// Fetches the pattern rows of the sprites in sprite_scanline into the sprite shifters
+static void fetch_sprites(PPU *ppu) {
+    PROFILE_BEGIN(PROFILE_SPRITES);
+    Mapper *mapper = &ppu->emulator->mapper;
+
+    for (uint8_t i = 0; i < ppu->sprite_count; i++) {
+        uint16_t sprite_pattern_addr;
+        uint8_t flipped_horizontal = ppu->sprite_scanline[i * 4 + 2] & 0x40;
+        uint8_t flipped_vertical = ppu->sprite_scanline[i * 4 + 2] & 0x80;
+        uint8_t sprite_y = ppu->sprite_scanline[i * 4];
+        uint16_t y_diff = ppu->cur_scanline - (uint16_t)sprite_y;
+        uint8_t sprite_id = ppu->sprite_scanline[i * 4 + 1];
+
+        if (!ppu->ctrl.sprite_size) {
+            // 8 pixel height
+            uint16_t row = flipped_vertical ? (7 - y_diff) : y_diff;
+            sprite_pattern_addr = (ppu->ctrl.pattern_sprite << 12) | (sprite_id << 4) | row;
+        } else {
+            // 16 pixel height
+            uint16_t cell = y_diff < 8 ? (sprite_id & 0xFE) : (sprite_id & 0xFE) + 1;
+            uint16_t row = flipped_vertical ? (7 - (y_diff & 0x07)) : (y_diff & 0x07);
+            sprite_pattern_addr = ((sprite_id & 0x01) << 12) | (cell << 4) | row;
+        }
+
+        // if flipped horizontally we use the mirrored copy of the tile
+        const ChrTile *tile = mapper_get_tile(mapper, sprite_pattern_addr);
+        uint8_t row = sprite_pattern_addr & 0x07;
+        ppu->sprite_shifter_pattern[i] = flipped_horizontal ? tile->flipped_rows[row] : tile->rows[row];
+    }
+    PROFILE_END(PROFILE_SPRITES);
+}
+
+// Sprite pixels in the scanline buffer of render_scanline
+#define SPRITE_LINE_COLOR 0x1F // palette memory index (0x10 - 0x1F)
+#define SPRITE_LINE_FRONT 0x20 // drawn in front of the background
+#define SPRITE_LINE_ZERO 0x40  // pixel belongs to sprite 0
+
+/**
+ *  Renders dots 1 - 256 of a visible scanline in one pass.
+ *
+ *  The result (pixels, sprite zero hit, shifters, scroll, sprite state and A12 clocks) is exactly the same as
+ *  running those dots through ppu_run_cycle, including its quirks. This only holds as long as no
+ *  PPU register is accessed during the scanline, which ppu_catch_up makes sure of.
+ *  Requires the background to be enabled. With skip_rendering, no pixels are written.
+ */
+static void render_scanline(PPU *ppu) {
+    // Sprite pixels indexed by dot, the first opaque sprite wins.
+    uint8_t sprite_line[VISIBLE_DOTS_PER_SCANLINE + 1];
+    memset(sprite_line, 0, sizeof(sprite_line));
+
+    if (ppu->mask.render_sprites) {
+        for (uint8_t i = 0; i < ppu->sprite_count; i++) {
+            uint8_t sprite_x = ppu->sprite_scanline[i * 4 + 3];
+            uint8_t sprite_attr = ppu->sprite_scanline[i * 4 + 2];
+            uint16_t pattern = ppu->sprite_shifter_pattern[i];
+
+            uint8_t flags = 0x10 | ((sprite_attr & 0x03) << 2);
+            if ((sprite_attr & 0x20) == 0)
+                flags |= SPRITE_LINE_FRONT;
+            if (i == 0)
+                flags |= SPRITE_LINE_ZERO;
+
+            // The x counter in update_shifters makes bit n show up on dot x + n
+            for (size_t bit = 0; bit < 8; bit++) {
+                size_t dot = sprite_x + bit;
+                if (dot < 1 || dot > VISIBLE_DOTS_PER_SCANLINE)
+                    continue;
+
+                uint8_t pixel = (pattern >> (14 - 2 * bit)) & 0x03;
+                if (pixel != 0 && sprite_line[dot] == 0)
+                    sprite_line[dot] = flags | pixel;
+            }
+
+            // State after 256 dots of update_shifters
+            size_t shifts = VISIBLE_DOTS_PER_SCANLINE - sprite_x;
+            ppu->sprite_shifter_pattern[i] = shifts < 8 ? pattern << (2 * shifts) : 0;
+            ppu->sprite_scanline[i * 4 + 3] = 0;
+        }
+        ppu->sprite_zero_hit_rendering = (sprite_line[VISIBLE_DOTS_PER_SCANLINE] & SPRITE_LINE_ZERO) != 0;
+    }
+
+    // Of the background fetches (dots 5, 13, ..., 253) only the first can clock the scanline counter
+    // of the mapper, the others follow 8 dots after each other
+    if (ppu->ctrl.pattern_background) {
+        watch_a12(ppu, 5);
+        ppu->a12_high_position = ppu->cur_scanline * DOTS_PER_SCANLINE + 253;
+    }
+
+    uint8_t zero_hit_possible = ppu->sprite_zero_hit_possible && ppu->mask.render_sprites;
+    size_t zero_hit_first_dot = (ppu->mask.render_background_left & ppu->mask.render_sprites_left) ? 9 : 1;
+    uint16_t bit_mux = 0x8000 >> ppu->fine_x;
+    uint8_t pixel_shift = 30 - 2 * ppu->fine_x;
+
+    if (ppu->skip_rendering && !zero_hit_possible) {
+        skip_scanline(ppu);
+        return;
+    }
+
+    for (size_t dot = 1; dot <= VISIBLE_DOTS_PER_SCANLINE; dot++) {
+        ppu->shifter_pattern <<= 2;
+        ppu->shifter_attr_lo <<= 1;
+        ppu->shifter_attr_hi <<= 1;
+        if (dot % 8 == 1)
+            load_shifters(ppu);
+
+        uint8_t bg_pixel = (ppu->shifter_pattern >> pixel_shift) & 0x03;
+        uint8_t bg_palette = (((ppu->shifter_attr_hi & bit_mux) > 0) << 1) | ((ppu->shifter_attr_lo & bit_mux) > 0);
+        uint8_t sprite = sprite_line[dot];
+
+        if (ppu->skip_rendering) {
+        } // Only the sprite zero hit below
+        else if (sprite == 0 && bg_pixel == 0) {
+            output_pixel(ppu, dot - 1, 0x00, 0x00);
+        } else if (sprite == 0 || (bg_pixel != 0 && !(sprite & SPRITE_LINE_FRONT))) {
+            output_pixel(ppu, dot - 1, bg_palette, bg_pixel);
+        } else {
+            output_pixel(ppu, dot - 1, (sprite & SPRITE_LINE_COLOR) >> 2, sprite & 0x03);
+        }
+
+        if (sprite != 0 && bg_pixel != 0 && (sprite & SPRITE_LINE_ZERO) && zero_hit_possible &&
+            dot >= zero_hit_first_dot) {
+            ppu->status.sprite_zero_hit = TRUE;
+        }
+
+        // The fetches of the dots 8k+1 - 8k+7 all use the same vram_addr
+        if (dot % 8 == 0) {
+            fetch_tile_id(ppu);
+            fetch_tile_attr(ppu);
+            fetch_tile_row(ppu);
+            increment_scroll_x(ppu);
+        }
+    }
+
+    finish_scanline(ppu);
+}
+
+// The end of render_scanline, from the increment of the vertical scroll at dot 256 on
+static void finish_scanline(PPU *ppu) {
+    increment_scroll_y(ppu);
+
+    ppu->cycle_counter += VISIBLE_DOTS_PER_SCANLINE;
+    ppu->cur_dot = VISIBLE_DOTS_PER_SCANLINE + 1;
+    evaluate_sprites(ppu);
+}
+
+/**
+ *  Like the pixel loop of render_scanline while rendering is skipped and sprite 0 can't hit, where only the
+ *  state at the end of the scanline matters. The shifters are loaded on dots 8k+1 and shifted on every dot,
+ *  so each tile takes one load and 8 shifts, and the fetches of dot 8k+8 follow.
+ */
+static void skip_scanline(PPU *ppu) {
+    for (size_t tile = 0; tile < VISIBLE_DOTS_PER_SCANLINE / 8; tile++) {
+        ppu->shifter_pattern <<= 2;
+        ppu->shifter_attr_lo <<= 1;
+        ppu->shifter_attr_hi <<= 1;
+        load_shifters(ppu);
+        ppu->shifter_pattern <<= 2 * 7;
+        ppu->shifter_attr_lo <<= 7;
+        ppu->shifter_attr_hi <<= 7;
+
+        fetch_tile_id(ppu);
+        fetch_tile_attr(ppu);
+        fetch_tile_row(ppu);
+        increment_scroll_x(ppu);
+    }
+    finish_scanline(ppu);
 }
 
-static uint8_t reverse_bits(uint8_t n) {
-    n = (n & 0xF0) >> 4 | (n & 0x0F) << 4; // Swap halves
-    n = (n & 0xCC) >> 2 | (n & 0x33) << 2; // Swap pairs
-    n = (n & 0xAA) >> 1 | (n & 0x55) << 1; // Swap individual bits
-    return n;
-}
\ No newline at end of file
+// Emphasizing a color channel darkens the two other channels.
+// `emphasis` holds the emphasis bits of PPUMASK: bit 0 red, bit 1 green, bit 2 blue.
+// src: https://www.nesdev.org/wiki/NTSC_video#Color_Tint_Bits
+static uint32_t emphasize_color(uint32_t rgb, uint8_t emphasis) {
+    // The black colors of the palette (0x0E, 0x0F, 0x1D etc.) stay black, since every channel is 0
+    uint32_t red = (rgb >> 16) & 0xFF, green = (rgb >> 8) & 0xFF, blue = rgb & 0xFF;
+    const uint32_t attenuation = 209; // ~0.816, out of 256
+
+    if (emphasis & 0x01) { // red
+        green = green * attenuation >> 8;
+        blue = blue * attenuation >> 8;
+    }
+    if (emphasis & 0x02) { // green
+        red = red * attenuation >> 8;
+        blue = blue * attenuation >> 8;
+    }
+    if (emphasis & 0x04) { // blue
+        red = red * attenuation >> 8;
+        green = green * attenuation >> 8;
+    }
+
+    return (red << 16) | (green << 8) | blue;
+}
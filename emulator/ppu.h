@@ -111,6 +111,8 @@ typedef union {
 
 // Forward Declarations
 typedef struct Emulator Emulator;
+typedef struct StateWriter StateWriter;
+typedef struct StateReader StateReader;
 
 typedef struct PPU {
     // PPU Registers
@@ -132,29 +134,41 @@ typedef struct PPU {
     // Background rendering shifters
     uint8_t next_tile_id;
     uint8_t next_tile_attr;
-    uint8_t next_tile_lsb;
-    uint8_t next_tile_msb;
-    uint16_t shifter_pattern_lo;
-    uint16_t shifter_pattern_hi;
+    uint16_t next_tile_row;   // decoded pattern row, see ChrTile
+    uint32_t shifter_pattern; // 16 pixels, 2 bits each
     uint16_t shifter_attr_lo;
     uint16_t shifter_attr_hi;
 
     // debug
     size_t cycle_counter;
 
+    // Catch-up scheduling
+    size_t pending_dots;    // dots the PPU is lagging behind the CPU
+    size_t next_event_dots; // pending dots at which the PPU has to catch up on its own
+    uint8_t scanline_renderer; // render whole scanlines at once when possible (see `ppu_catch_up`)
+    uint8_t skip_rendering;    // leave the framebuffer alone, everything the CPU can see is still emulated
+
+    // Position (scanline * DOTS_PER_SCANLINE + dot) of the last pattern fetch with address line A12 high.
+    // Only tracked for mappers that count scanlines by watching A12 (see Mapper.clock_scanline).
+    size_t a12_high_position;
+
     // PPU memory
     Emulator *emulator;
     uint8_t vram[0x2000];
     uint8_t palette[0x20];
+    uint8_t palette_colors[0x20]; // palette with PPUMASK grayscale applied, kept up to date on writes
 
     // Sprite rendering
     uint8_t oam[0x100];
     uint8_t sprite_scanline[0x40];
     uint8_t sprite_count;
-    uint8_t sprite_shifter_pattern_lo[8];
-    uint8_t sprite_shifter_pattern_hi[8];
+    uint16_t sprite_shifter_pattern[8]; // decoded pattern rows, see ChrTile
     uint8_t sprite_zero_hit_possible;
     uint8_t sprite_zero_hit_rendering;
+
+    // Rendered frame, one NES color index (0x00 - 0x3F) per pixel.
+    // It is converted to the colors of the screen once per frame (see ppu_build_rgb_palette)
+    uint8_t framebuffer[VISIBLE_SCANLINES * VISIBLE_DOTS_PER_SCANLINE];
 } PPU;
 
 /**
@@ -165,12 +179,42 @@ typedef struct PPU {
 void ppu_init(Emulator *emulator);
 void ppu_reset(PPU *ppu);
 
+/**
+ *  Lets `cpu_cycles` CPU cycles (3 dots each) pass for the PPU.
+ *
+ *  The dots are not run right away, they are added to ppu->pending_dots.
+ *  The PPU only catches up once the next event (vblank/NMI, end of frame, the scanline counter
+ *  of the mapper while its IRQ is enabled) is due.
+ */
+void ppu_advance(PPU *ppu, size_t cpu_cycles);
+
+/**
+ *  Runs all pending dots, so that the PPU is at the same point in time as the CPU.
+ *
+ *  This has to be called before any PPU state is read or written from the CPU side.
+ */
+void ppu_catch_up(PPU *ppu);
+
+/**
+ *  Recomputes when the PPU has to catch up on its own.
+ *
+ *  Has to be called when an event is enabled from outside the PPU, e.g. the IRQ of the mapper.
+ */
+void ppu_reschedule(PPU *ppu);
+
+/**
+ *  Returns how many dots (counted like the events of `ppu_advance`) can pass before a bit of
+ *  PPUSTATUS might change, including the dots that are already pending.
+ *  Returns 0 if it might have changed during the last `dots_before` dots, or if it can change
+ *  on any dot, i.e. while the visible scanlines are rendered.
+ */
+size_t ppu_dots_until_status_change(const PPU *ppu, size_t dots_before);
+
 /**
  *  Runs one cycle of the PPU.
  *
  *  Each cycle corresponds to one pixel one the screen.
- *  This function is called 89342 times per frame.
- *  It is called three times as often as `cpu_run_cycle`
+ *  This function is called 89342 times per frame, by `ppu_catch_up`.
  */
 void ppu_run_cycle(PPU *ppu);
 
@@ -180,6 +224,13 @@ void ppu_run_cycle(PPU *ppu);
  */
 void ppu_set_ctrl(PPU *ppu, uint8_t value);
 
+/**
+ *  Sets the PPUMASK register.
+ *
+ *  Updates palette_colors if the grayscale bit changes.
+ */
+void ppu_set_mask(PPU *ppu, uint8_t value);
+
 /**
  *  Reads the PPUSTATUS register.
  *
@@ -237,4 +288,31 @@ uint8_t ppu_const_read_vram_data(const PPU *ppu, uint16_t address);
 
 void ppu_dma(PPU *ppu, uint8_t page);
 
+/**
+ *  Fills `palette` (64 entries) with the ARGB color of every NES color index,
+ *  with the color emphasis bits of PPUMASK applied.
+ *
+ *  The framebuffer is converted with this palette once per frame.
+ */
+void ppu_build_rgb_palette(const PPU *ppu, uint32_t *palette);
+
+/**
+ *  Writes the registers, rendering state, VRAM, palette, OAM and framebuffer to a save state chunk.
+ *
+ */
+void ppu_save_state(const PPU *ppu, StateWriter *writer);
+
+/**
+ *  Reads a chunk written by `ppu_save_state`.
+ *
+ */
+void ppu_load_state(PPU *ppu, StateReader *reader);
+
+#ifdef RISC_V
+/**
+ *  Same as `ppu_build_rgb_palette`, but with the 8-bit colors of the VGA screen.
+ */
+void ppu_build_8bit_palette(const PPU *ppu, uint8_t *palette);
+#endif
+
 #endif
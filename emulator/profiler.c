@@ -0,0 +1,162 @@
+#include "profiler.h"
+
+#ifdef RISC_V
+#define PROFILER_TICK_UNIT "cycles"
+#else
+#define PROFILER_TICK_UNIT "ns"
+#endif
+
+typedef struct Profiler {
+    uint32_t current[PROFILE_SECTION_COUNT];                // inclusive ticks of the frame in progress
+    uint32_t frames[NTSC_FRAME_RATE][PROFILE_SECTION_COUNT]; // exclusive ticks of the last 60 frames
+    uint32_t frame_index;
+    uint32_t frame_count;
+#ifndef RISC_V
+    FILE *csv;
+#endif
+} Profiler;
+
+static const char *section_names[PROFILE_SECTION_COUNT] = {"CPU", "PPU", "Sprites", "Present", "Debug", "Rollback"};
+
+static Profiler profiler;
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void print_summary(void);
+static void print_text(const char *text);
+static void print_number(uint32_t value);
+static uint32_t frame_total(const uint32_t *frame);
+#ifdef RISC_V
+static void print_csv(void);
+#else
+static void write_csv_row(const uint32_t *frame);
+#endif
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+void profiler_add(ProfileSection section, uint32_t ticks) {
+    profiler.current[section] += ticks;
+}
+
+void profiler_end_frame(void) {
+    uint32_t *frame = profiler.frames[profiler.frame_index];
+    for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+        frame[i] = profiler.current[i];
+        profiler.current[i] = 0;
+    }
+
+    // Remove the nested sections, the PPU runs inside the CPU and the sprites inside the PPU
+    frame[PROFILE_PPU] -= frame[PROFILE_SPRITES];
+    frame[PROFILE_CPU] -= frame[PROFILE_PPU] + frame[PROFILE_SPRITES];
+
+#ifndef RISC_V
+    if (profiler.csv) {
+        write_csv_row(frame);
+    }
+#endif
+
+    profiler.frame_count++;
+    profiler.frame_index++;
+    if (profiler.frame_index == NTSC_FRAME_RATE) {
+        profiler.frame_index = 0;
+        print_summary();
+#ifdef RISC_V
+        print_csv();
+#endif
+    }
+}
+
+#ifndef RISC_V
+void profiler_open_csv(const char *path) {
+    profiler.csv = fopen(path, "w");
+    if (profiler.csv == NULL) {
+        printf("Fatal Error: Failed to open file %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(profiler.csv, "frame,cpu,ppu,sprites,present,debug_screen,rollback,total\n");
+}
+
+void profiler_close_csv(void) {
+    if (profiler.csv) {
+        fclose(profiler.csv);
+        profiler.csv = NULL;
+    }
+}
+#endif
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// One line with the average ticks per frame of every section, e.g.
+// "Profile (ns/frame): CPU 812000 (61%) | PPU 402000 (30%) | ... | Total 1320000"
+static void print_summary(void) {
+    uint32_t averages[PROFILE_SECTION_COUNT];
+    uint32_t total = 0;
+    for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+        uint32_t sum = 0;
+        for (int frame = 0; frame < NTSC_FRAME_RATE; frame++) {
+            sum += profiler.frames[frame][i];
+        }
+        averages[i] = sum / NTSC_FRAME_RATE;
+        total += averages[i];
+    }
+
+    print_text("Profile (" PROFILER_TICK_UNIT "/frame): ");
+    for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+        print_text(section_names[i]);
+        print_text(" ");
+        print_number(averages[i]);
+        print_text(" (");
+        print_number(total ? (uint32_t)((unsigned long long)averages[i] * 100 / total) : 0);
+        print_text("%) | ");
+    }
+    print_text("Total ");
+    print_number(total);
+    print_text("\n");
+}
+
+// printf can't be used for this on RISC-V, there it only prints the format string
+static void print_text(const char *text) {
+#ifdef RISC_V
+    dtekv_print((char *)text);
+#else
+    fputs(text, stdout);
+#endif
+}
+
+static void print_number(uint32_t value) {
+#ifdef RISC_V
+    dtekv_print_dec(value);
+#else
+    printf("%u", value);
+#endif
+}
+
+static uint32_t frame_total(const uint32_t *frame) {
+    uint32_t total = 0;
+    for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+        total += frame[i];
+    }
+    return total;
+}
+
+#ifdef RISC_V
+static void print_csv(void) {
+    print_text("frame,cpu,ppu,sprites,present,debug_screen,rollback,total\n");
+    for (int frame = 0; frame < NTSC_FRAME_RATE; frame++) {
+        print_number(profiler.frame_count - NTSC_FRAME_RATE + frame);
+        for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+            print_text(",");
+            print_number(profiler.frames[frame][i]);
+        }
+        print_text(",");
+        print_number(frame_total(profiler.frames[frame]));
+        print_text("\n");
+    }
+}
+#else
+static void write_csv_row(const uint32_t *frame) {
+    fprintf(profiler.csv, "%u", profiler.frame_count);
+    for (int i = 0; i < PROFILE_SECTION_COUNT; i++) {
+        fprintf(profiler.csv, ",%u", frame[i]);
+    }
+    fprintf(profiler.csv, ",%u\n", frame_total(frame));
+}
+#endif
@@ -0,0 +1,77 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "common.h"
+#include "timer.h"
+
+/**
+ *  Optional per-subsystem profiler, enabled by building with PROFILER defined
+ *  (cmake -DENABLE_PROFILER=ON). Without it the PROFILE_* macros compile to nothing.
+ *
+ *  Time is measured in profiler_ticks: mcycle cycles on RISC-V and nanoseconds on the host.
+ *  Sections can be nested, the report subtracts the nested sections so that every tick is
+ *  only counted once: CPU excludes the PPU, and the PPU excludes the sprites.
+ *
+ *  Every 60 frames the average of each section is printed to the console (the JTAG-UART on
+ *  the board). The per-frame numbers can also be dumped as CSV, see `profiler_open_csv`.
+ *
+ */
+typedef enum ProfileSection {
+    PROFILE_CPU,          // emulator_run_frame, CPU execution
+    PROFILE_PPU,          // ppu_catch_up, PPU rendering
+    PROFILE_SPRITES,      // sprite evaluation and fetching
+    PROFILE_PRESENT,      // handing the frame to the render thread or the VGA screen
+    PROFILE_DEBUG_SCREEN, // taking the snapshot of the debug screen
+    PROFILE_ROLLBACK,     // saving and loading the state around the frames that are run ahead
+    PROFILE_SECTION_COUNT
+} ProfileSection;
+
+#ifdef PROFILER
+#define PROFILE_BEGIN(section) uint32_t profile_start_##section = profiler_ticks()
+#define PROFILE_END(section) profiler_add(section, profiler_ticks() - profile_start_##section)
+#else
+#define PROFILE_BEGIN(section)
+#define PROFILE_END(section)
+#endif
+
+/**
+ *  Returns the current time in profiler ticks, only the difference of two calls is meaningful.
+ *  Most sections (e.g. a ppu_catch_up of a few dots) are shorter than a microsecond, so on the host
+ *  they would mostly measure 0 with get_time_point, and end up in the section around them.
+ */
+static inline uint32_t profiler_ticks(void) {
+#ifdef RISC_V
+    return get_time_point();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec); // wraps around correctly
+#endif
+}
+
+/**
+ *  Adds `ticks` to `section` for the current frame.
+ *
+ */
+void profiler_add(ProfileSection section, uint32_t ticks);
+
+/**
+ *  Closes the current frame. Prints the summary every 60 frames, and writes
+ *  the frame to the CSV output if there is one.
+ *
+ */
+void profiler_end_frame(void);
+
+#ifndef RISC_V
+/**
+ *  Writes one CSV row per frame to the file at `path`, until `profiler_close_csv` is called.
+ *  On RISC-V there is no file system, there the rows of the last 60 frames are printed
+ *  to the JTAG-UART after every summary instead.
+ *
+ */
+void profiler_open_csv(const char *path);
+
+void profiler_close_csv(void);
+#endif
+
+#endif
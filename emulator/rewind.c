@@ -0,0 +1,176 @@
+#include "rewind.h"
+#include "emulator.h"
+#include "savestate.h"
+
+// Deltas are a sequence of runs: u16 unchanged bytes, u16 changed bytes, the XOR of the changed bytes
+#define RUN_HEADER_SIZE 4
+#define MAX_RUN_LENGTH 0xFFFF
+#define MIN_ZERO_RUN 4 // shorter runs of unchanged bytes are stored in the changed bytes
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void clear_history(Rewind *rewind);
+static void drop_oldest_delta(Rewind *rewind);
+static size_t reserve_delta(Rewind *rewind, size_t max_size);
+static size_t encode_delta(const uint8_t *state, const uint8_t *previous_state, size_t size, uint8_t *out);
+static void apply_delta(const uint8_t *delta, size_t delta_size, uint8_t *state, size_t size);
+static size_t max_delta_size(size_t state_size);
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+void rewind_init(Rewind *rewind, uint8_t *arena, size_t arena_size, uint32_t interval) {
+    if (arena_size <= 2 * SAVE_STATE_MAX_SIZE) {
+        printf("Fatal Error: Rewind arena is too small\n");
+        exit(EXIT_FAILURE);
+    }
+
+    rewind->latest = arena;
+    rewind->scratch = arena + SAVE_STATE_MAX_SIZE;
+    rewind->ring = arena + 2 * SAVE_STATE_MAX_SIZE;
+    rewind->ring_size = arena_size - 2 * SAVE_STATE_MAX_SIZE;
+    rewind->interval = interval;
+    clear_history(rewind);
+}
+
+void rewind_record_frame(Rewind *rewind, const Emulator *emulator) {
+    rewind->frames_since_snapshot++;
+    if (rewind->state_size > 0 && rewind->frames_since_snapshot < rewind->interval)
+        return;
+    rewind->frames_since_snapshot = 0;
+
+    size_t size = emulator_save_state_without_frame(emulator, rewind->scratch, SAVE_STATE_MAX_SIZE);
+    if (size == 0) {
+        printf("Fatal Error: Save state doesn't fit into the rewind buffer\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The deltas can only be applied to states of the same size
+    if (size != rewind->state_size) {
+        clear_history(rewind);
+    } else {
+        size_t max_size = max_delta_size(size);
+        if (max_size > rewind->ring_size) {
+            printf("Fatal Error: Rewind arena is too small\n");
+            exit(EXIT_FAILURE);
+        }
+
+        size_t offset = reserve_delta(rewind, max_size);
+        size_t delta_size = encode_delta(rewind->latest, rewind->scratch, size, rewind->ring + offset);
+
+        size_t index = (rewind->first + rewind->count) % REWIND_MAX_SNAPSHOTS;
+        rewind->deltas[index].offset = offset;
+        rewind->deltas[index].size = delta_size;
+        rewind->count++;
+        rewind->write_offset = offset + delta_size;
+    }
+
+    memcpy(rewind->latest, rewind->scratch, size);
+    rewind->state_size = size;
+}
+
+int rewind_step_back(Rewind *rewind, Emulator *emulator) {
+    if (rewind->count == 0)
+        return -1;
+
+    // latest XOR delta gives the snapshot before it
+    size_t index = (rewind->first + rewind->count - 1) % REWIND_MAX_SNAPSHOTS;
+    RewindDelta *delta = &rewind->deltas[index];
+    apply_delta(rewind->ring + delta->offset, delta->size, rewind->latest, rewind->state_size);
+    rewind->count--;
+    rewind->write_offset = delta->offset;
+    rewind->frames_since_snapshot = 0;
+
+    return emulator_load_state(emulator, rewind->latest, rewind->state_size);
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+static void clear_history(Rewind *rewind) {
+    rewind->state_size = 0;
+    rewind->write_offset = 0;
+    rewind->first = 0;
+    rewind->count = 0;
+    rewind->frames_since_snapshot = 0;
+}
+
+static void drop_oldest_delta(Rewind *rewind) {
+    rewind->first = (rewind->first + 1) % REWIND_MAX_SNAPSHOTS;
+    rewind->count--;
+}
+
+// Returns the offset in the ring where a delta of up to `max_size` bytes can be written,
+// and drops the oldest deltas that are in the way
+static size_t reserve_delta(Rewind *rewind, size_t max_size) {
+    size_t offset = rewind->write_offset;
+    if (offset + max_size > rewind->ring_size) {
+        offset = 0; // wrap around, the end of the ring stays unused
+    }
+
+    while (rewind->count > 0) {
+        const RewindDelta *oldest = &rewind->deltas[rewind->first];
+        int overlaps = oldest->offset < offset + max_size && offset < oldest->offset + oldest->size;
+        if (!overlaps && rewind->count < REWIND_MAX_SNAPSHOTS)
+            break;
+        drop_oldest_delta(rewind);
+    }
+    return offset;
+}
+
+static size_t max_delta_size(size_t state_size) {
+    return state_size + RUN_HEADER_SIZE * (state_size / MAX_RUN_LENGTH + 2);
+}
+
+static size_t encode_delta(const uint8_t *state, const uint8_t *previous_state, size_t size, uint8_t *out) {
+    size_t out_size = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        size_t zeros = 0;
+        while (i + zeros < size && zeros < MAX_RUN_LENGTH && state[i + zeros] == previous_state[i + zeros]) {
+            zeros++;
+        }
+        i += zeros;
+
+        // Changed bytes, until a run of unchanged bytes that is worth a new run header
+        size_t changed = 0;
+        size_t unchanged = 0;
+        while (i + changed < size && changed < MAX_RUN_LENGTH) {
+            if (state[i + changed] == previous_state[i + changed]) {
+                unchanged++;
+                if (unchanged == MIN_ZERO_RUN)
+                    break;
+            } else {
+                unchanged = 0;
+            }
+            changed++;
+        }
+        if (unchanged == MIN_ZERO_RUN) {
+            changed -= MIN_ZERO_RUN - 1;
+        }
+
+        out[out_size++] = zeros & 0xFF;
+        out[out_size++] = zeros >> 8;
+        out[out_size++] = changed & 0xFF;
+        out[out_size++] = changed >> 8;
+        for (size_t j = 0; j < changed; j++) {
+            out[out_size++] = state[i + j] ^ previous_state[i + j];
+        }
+        i += changed;
+    }
+
+    return out_size;
+}
+
+static void apply_delta(const uint8_t *delta, size_t delta_size, uint8_t *state, size_t size) {
+    size_t position = 0;
+    size_t i = 0;
+
+    while (i + RUN_HEADER_SIZE <= delta_size) {
+        size_t zeros = delta[i] | (delta[i + 1] << 8);
+        size_t changed = delta[i + 2] | (delta[i + 3] << 8);
+        i += RUN_HEADER_SIZE;
+        position += zeros;
+
+        for (size_t j = 0; j < changed && position < size; j++) {
+            state[position++] ^= delta[i + j];
+        }
+        i += changed;
+    }
+}
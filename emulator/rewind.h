@@ -0,0 +1,66 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "common.h"
+
+#define REWIND_MAX_SNAPSHOTS 8192
+
+// Forward declarations
+typedef struct Emulator Emulator;
+
+// Where a delta is stored in the ring of the arena
+typedef struct RewindDelta {
+    size_t offset;
+    size_t size;
+} RewindDelta;
+
+/**
+ *  Rewind history
+ *
+ *  Every `interval` frames a save state (without the framebuffer) is taken. Only the newest
+ *  snapshot is kept as a whole, every older one is stored as the XOR of it and the snapshot
+ *  after it, run-length encoded. Since most of RAM, VRAM and cartridge RAM doesn't change
+ *  between two snapshots these deltas are mostly zeros and only take a few hundred bytes.
+ *
+ *  All memory comes from the arena passed to `rewind_init`: two save state buffers, followed
+ *  by a ring buffer of deltas. When the ring is full the oldest deltas are dropped.
+ */
+typedef struct Rewind {
+    uint8_t *latest;  // newest snapshot
+    uint8_t *scratch; // the snapshot being taken
+    size_t state_size;
+
+    uint8_t *ring;
+    size_t ring_size;
+    size_t write_offset;
+
+    RewindDelta deltas[REWIND_MAX_SNAPSHOTS]; // deltas[first] is the oldest
+    size_t first;
+    size_t count;
+
+    uint32_t interval;
+    uint32_t frames_since_snapshot;
+} Rewind;
+
+/**
+ *  Sets up an empty history in `arena`, which has to be larger than 2 * SAVE_STATE_MAX_SIZE.
+ *  A snapshot is taken every `interval` frames.
+ *
+ */
+void rewind_init(Rewind *rewind, uint8_t *arena, size_t arena_size, uint32_t interval);
+
+/**
+ *  Has to be called after every frame. Takes a snapshot every `interval` frames.
+ *
+ */
+void rewind_record_frame(Rewind *rewind, const Emulator *emulator);
+
+/**
+ *  Loads the previous snapshot into `emulator` and removes it from the history.
+ *
+ *  The framebuffer isn't part of the snapshots, so a frame should be run before it is shown.
+ *  Returns 0 on success, -1 if the history is empty.
+ */
+int rewind_step_back(Rewind *rewind, Emulator *emulator);
+
+#endif
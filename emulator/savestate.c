@@ -0,0 +1,312 @@
+#include "savestate.h"
+#include "emulator.h"
+
+#define SAVE_STATE_HEADER_SIZE 10 // magic, version, ROM checksum
+#define CHUNK_HEADER_SIZE 8       // tag, size
+
+typedef struct Chunk {
+    char tag[4];
+    void (*save)(const Emulator *emulator, StateWriter *writer);
+    void (*load)(Emulator *emulator, StateReader *reader);
+} Chunk;
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void save_cpu(const Emulator *emulator, StateWriter *writer);
+static void load_cpu(Emulator *emulator, StateReader *reader);
+static void save_ppu(const Emulator *emulator, StateWriter *writer);
+static void load_ppu(Emulator *emulator, StateReader *reader);
+static void save_apu(const Emulator *emulator, StateWriter *writer);
+static void load_apu(Emulator *emulator, StateReader *reader);
+static void save_mem(const Emulator *emulator, StateWriter *writer);
+static void load_mem(Emulator *emulator, StateReader *reader);
+static void save_mapper(const Emulator *emulator, StateWriter *writer);
+static void load_mapper(Emulator *emulator, StateReader *reader);
+static void save_emulator(const Emulator *emulator, StateWriter *writer);
+static void load_emulator(Emulator *emulator, StateReader *reader);
+static const Chunk *find_chunk(const uint8_t *tag);
+static int is_tag(const uint8_t *data, const char *tag);
+static int read_chunk_header(StateReader *state, const uint8_t **tag, StateReader *chunk);
+static size_t chunk_size(const Chunk *chunk, const Emulator *emulator, uint8_t include_framebuffer);
+static size_t save_state(const Emulator *emulator, uint8_t *buffer, size_t buffer_size, uint8_t include_framebuffer);
+
+// clang-format off
+static const Chunk chunks[] = {
+    {{'C', 'P', 'U', ' '}, save_cpu,      load_cpu},
+    {{'P', 'P', 'U', ' '}, save_ppu,      load_ppu},
+    {{'A', 'P', 'U', ' '}, save_apu,      load_apu},
+    {{'M', 'E', 'M', ' '}, save_mem,      load_mem},
+    {{'M', 'A', 'P', 'R'}, save_mapper,   load_mapper},
+    {{'E', 'M', 'U', ' '}, save_emulator, load_emulator},
+};
+// clang-format on
+#define CHUNK_COUNT (sizeof(chunks) / sizeof(chunks[0]))
+
+// --------------- PUBLIC FUNCTIONS --------------------------- //
+size_t emulator_save_state(const Emulator *emulator, uint8_t *buffer, size_t buffer_size) {
+    return save_state(emulator, buffer, buffer_size, TRUE);
+}
+
+size_t emulator_save_state_without_frame(const Emulator *emulator, uint8_t *buffer, size_t buffer_size) {
+    return save_state(emulator, buffer, buffer_size, FALSE);
+}
+
+int emulator_load_state(Emulator *emulator, const uint8_t *buffer, size_t size) {
+    StateReader state = {buffer, size, 0, FALSE};
+    uint8_t magic[4];
+    state_read_bytes(&state, magic, 4);
+    uint16_t version = state_read_16(&state);
+    uint32_t rom_checksum = state_read_32(&state);
+
+    if (state.error || !is_tag(magic, "NESS")) {
+        printf("Error: Not a save state\n");
+        return -1;
+    }
+    if (version != SAVE_STATE_VERSION) {
+        printf("Error: Save state version %u is not supported\n", version);
+        return -1;
+    }
+    if (rom_checksum != emulator->rom_checksum) {
+        printf("Error: Save state belongs to another ROM\n");
+        return -1;
+    }
+
+    // Check the framing and the chunks first, so that a broken state doesn't leave the emulator half loaded.
+    // Every known chunk has to be there once, with the size this emulator would save it with.
+    uint32_t found = 0;
+    const uint8_t *tag;
+    StateReader chunk;
+    while (state.position < state.size) {
+        if (read_chunk_header(&state, &tag, &chunk) != 0) {
+            printf("Error: Save state is truncated\n");
+            return -1;
+        }
+        const Chunk *handler = find_chunk(tag);
+        if (handler == NULL)
+            continue;
+
+        uint32_t chunk_bit = 1u << (handler - chunks);
+        if (found & chunk_bit) {
+            printf("Error: Save state has a chunk twice\n");
+            return -1;
+        }
+        found |= chunk_bit;
+        if (chunk.size != chunk_size(handler, emulator, FALSE) && chunk.size != chunk_size(handler, emulator, TRUE)) {
+            printf("Error: Save state has a chunk of the wrong size\n");
+            return -1;
+        }
+    }
+    if (found != (1u << CHUNK_COUNT) - 1) {
+        printf("Error: Save state is missing chunks\n");
+        return -1;
+    }
+
+    state.position = SAVE_STATE_HEADER_SIZE;
+    while (state.position < state.size) {
+        read_chunk_header(&state, &tag, &chunk);
+        const Chunk *handler = find_chunk(tag);
+        if (handler) {
+            handler->load(emulator, &chunk);
+        }
+    }
+
+    return 0;
+}
+
+#ifndef RISC_V
+// The buffers are allocated per call, so that emulators on different threads can save at the same time
+int emulator_save_state_file(const Emulator *emulator, const char *path) {
+    uint8_t *buffer = malloc(SAVE_STATE_MAX_SIZE);
+    size_t size = buffer ? emulator_save_state(emulator, buffer, SAVE_STATE_MAX_SIZE) : 0;
+
+    FILE *fp = size ? fopen(path, "wb") : NULL;
+    if (fp == NULL) {
+        printf("Error: Failed to save state to %s\n", path);
+        free(buffer);
+        return -1;
+    }
+    size_t written = fwrite(buffer, 1, size, fp);
+    fclose(fp);
+    free(buffer);
+    return written == size ? 0 : -1;
+}
+
+int emulator_load_state_file(Emulator *emulator, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        printf("Error: Failed to open file %s\n", path);
+        return -1;
+    }
+    uint8_t *buffer = malloc(SAVE_STATE_MAX_SIZE);
+    if (buffer == NULL) {
+        printf("Error: Failed to allocate the save state buffer\n");
+        fclose(fp);
+        return -1;
+    }
+    size_t size = fread(buffer, 1, SAVE_STATE_MAX_SIZE, fp);
+    fclose(fp);
+
+    int result = emulator_load_state(emulator, buffer, size);
+    free(buffer);
+    return result;
+}
+#endif
+
+void state_write_8(StateWriter *writer, uint8_t value) {
+    if (writer->buffer == NULL) {
+        writer->position++;
+        return;
+    }
+    if (writer->position >= writer->size) {
+        writer->overflow = TRUE;
+        return;
+    }
+    writer->buffer[writer->position++] = value;
+}
+
+void state_write_16(StateWriter *writer, uint16_t value) {
+    state_write_8(writer, value);
+    state_write_8(writer, value >> 8);
+}
+
+void state_write_32(StateWriter *writer, uint32_t value) {
+    state_write_16(writer, value);
+    state_write_16(writer, value >> 16);
+}
+
+void state_write_size(StateWriter *writer, size_t value) {
+    state_write_32(writer, value);
+    state_write_32(writer, sizeof(size_t) > 4 ? (value >> 16) >> 16 : 0); // no shift by 32 on 32-bit targets
+}
+
+void state_write_bytes(StateWriter *writer, const void *data, size_t size) {
+    if (writer->buffer == NULL) {
+        writer->position += size;
+        return;
+    }
+    if (writer->position + size > writer->size) {
+        writer->overflow = TRUE;
+        return;
+    }
+    memcpy(writer->buffer + writer->position, data, size);
+    writer->position += size;
+}
+
+uint8_t state_read_8(StateReader *reader) {
+    if (reader->position >= reader->size) {
+        reader->error = TRUE;
+        return 0;
+    }
+    return reader->buffer[reader->position++];
+}
+
+uint16_t state_read_16(StateReader *reader) {
+    uint16_t low = state_read_8(reader);
+    return low | (state_read_8(reader) << 8);
+}
+
+uint32_t state_read_32(StateReader *reader) {
+    uint32_t low = state_read_16(reader);
+    return low | ((uint32_t)state_read_16(reader) << 16);
+}
+
+size_t state_read_size(StateReader *reader) {
+    size_t low = state_read_32(reader);
+    size_t high = state_read_32(reader);
+    return sizeof(size_t) > 4 ? low | ((high << 16) << 16) : low;
+}
+
+void state_read_bytes(StateReader *reader, void *data, size_t size) {
+    if (reader->position + size > reader->size) {
+        reader->error = TRUE;
+        memset(data, 0, size);
+        return;
+    }
+    memcpy(data, reader->buffer + reader->position, size);
+    reader->position += size;
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+static void save_cpu(const Emulator *emulator, StateWriter *writer) { cpu_save_state(&emulator->cpu, writer); }
+static void load_cpu(Emulator *emulator, StateReader *reader) { cpu_load_state(&emulator->cpu, reader); }
+static void save_ppu(const Emulator *emulator, StateWriter *writer) { ppu_save_state(&emulator->ppu, writer); }
+static void load_ppu(Emulator *emulator, StateReader *reader) { ppu_load_state(&emulator->ppu, reader); }
+static void save_apu(const Emulator *emulator, StateWriter *writer) { apu_save_state(&emulator->apu, writer); }
+static void load_apu(Emulator *emulator, StateReader *reader) { apu_load_state(&emulator->apu, reader); }
+static void save_mem(const Emulator *emulator, StateWriter *writer) { mem_save_state(&emulator->mem, writer); }
+static void load_mem(Emulator *emulator, StateReader *reader) { mem_load_state(&emulator->mem, reader); }
+static void save_mapper(const Emulator *emulator, StateWriter *writer) { mapper_save_state(&emulator->mapper, writer); }
+static void load_mapper(Emulator *emulator, StateReader *reader) { mapper_load_state(&emulator->mapper, reader); }
+
+static void save_emulator(const Emulator *emulator, StateWriter *writer) {
+    state_write_32(writer, emulator->cur_frame);
+    state_write_8(writer, emulator->controller_input);
+}
+
+static void load_emulator(Emulator *emulator, StateReader *reader) {
+    emulator->cur_frame = state_read_32(reader);
+    emulator->controller_input = state_read_8(reader);
+}
+
+static const Chunk *find_chunk(const uint8_t *tag) {
+    for (size_t i = 0; i < CHUNK_COUNT; i++) {
+        if (is_tag(tag, chunks[i].tag))
+            return &chunks[i];
+    }
+    return NULL;
+}
+
+// memcmp isn't available on RISC-V
+static int is_tag(const uint8_t *data, const char *tag) {
+    return data[0] == tag[0] && data[1] == tag[1] && data[2] == tag[2] && data[3] == tag[3];
+}
+
+// Reads the tag and size of the next chunk, and sets up `chunk` to read its payload
+static int read_chunk_header(StateReader *state, const uint8_t **tag, StateReader *chunk) {
+    if (state->position + CHUNK_HEADER_SIZE > state->size) {
+        return -1;
+    }
+    *tag = state->buffer + state->position;
+    state->position += 4;
+    uint32_t size = state_read_32(state);
+    if (size > state->size - state->position) {
+        return -1;
+    }
+
+    chunk->buffer = state->buffer + state->position;
+    chunk->size = size;
+    chunk->position = 0;
+    chunk->error = FALSE;
+    state->position += size;
+    return 0;
+}
+
+// Only the PPU chunk differs with the framebuffer. The sizes don't depend on the values, only on the ROM.
+static size_t chunk_size(const Chunk *chunk, const Emulator *emulator, uint8_t include_framebuffer) {
+    StateWriter counter = {NULL, 0, 0, FALSE, include_framebuffer};
+    chunk->save(emulator, &counter);
+    return counter.position;
+}
+
+static size_t save_state(const Emulator *emulator, uint8_t *buffer, size_t buffer_size, uint8_t include_framebuffer) {
+    StateWriter writer = {buffer, buffer_size, 0, FALSE, include_framebuffer};
+
+    state_write_bytes(&writer, "NESS", 4);
+    state_write_16(&writer, SAVE_STATE_VERSION);
+    state_write_32(&writer, emulator->rom_checksum);
+
+    for (size_t i = 0; i < CHUNK_COUNT; i++) {
+        state_write_bytes(&writer, chunks[i].tag, 4);
+        size_t size_position = writer.position;
+        state_write_32(&writer, 0); // patched below
+
+        chunks[i].save(emulator, &writer);
+
+        if (!writer.overflow) {
+            uint32_t chunk_size = writer.position - size_position - 4;
+            StateWriter size_writer = {buffer + size_position, 4, 0, FALSE, FALSE};
+            state_write_32(&size_writer, chunk_size);
+        }
+    }
+
+    return writer.overflow ? 0 : writer.position;
+}
@@ -0,0 +1,97 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "common.h"
+
+/**
+ *  Save states
+ *
+ *  A save state is a header followed by chunks, all numbers are little endian:
+ *
+ *      "NESS"  u16 version  u32 ROM checksum
+ *      tag[4]  u32 size  payload[size]     (one chunk per device: "CPU ", "PPU ", "APU ", "MEM ", "MAPR", "EMU ")
+ *
+ *  Each device writes and reads its own chunk (see e.g. `cpu_save_state`). Pointers, the ROM, the
+ *  configuration and caches (tile cache, palette_colors, idle loop) are not part of the state,
+ *  they are rebuilt when the state is loaded. States are only loaded into an emulator running the
+ *  same ROM with the same SAVE_STATE_VERSION, unknown chunks are skipped.
+ */
+#define SAVE_STATE_VERSION 3
+#define SAVE_STATE_MAX_SIZE 0x20000 // bytes, enough for every chunk
+
+// Forward declarations
+typedef struct Emulator Emulator;
+
+// Writes the chunks of a save state into a buffer. Writing past the end of the buffer sets `overflow`.
+// Without a buffer, it only counts the bytes in `position`.
+typedef struct StateWriter {
+    uint8_t *buffer;
+    size_t size;
+    size_t position;
+    uint8_t overflow;
+    uint8_t include_framebuffer;
+} StateWriter;
+
+// Reads one chunk of a save state. Reading past the end of the chunk sets `error` and returns zeros.
+typedef struct StateReader {
+    const uint8_t *buffer;
+    size_t size;
+    size_t position;
+    uint8_t error;
+} StateReader;
+
+/**
+ *  Saves the state of `emulator` into `buffer`.
+ *
+ *  Returns the size of the state in bytes, or 0 if `buffer_size` is too small.
+ *  Should be called between frames or instructions, not from inside the CPU or PPU.
+ */
+size_t emulator_save_state(const Emulator *emulator, uint8_t *buffer, size_t buffer_size);
+
+/**
+ *  Like `emulator_save_state`, but leaves out the framebuffer, which makes the state about
+ *  60 KB smaller. Loading such a state keeps the current framebuffer until the next frame is drawn.
+ *
+ */
+size_t emulator_save_state_without_frame(const Emulator *emulator, uint8_t *buffer, size_t buffer_size);
+
+/**
+ *  Loads a state saved by `emulator_save_state` into `emulator`.
+ *
+ *  Returns 0 on success. Returns -1 and leaves the emulator untouched if the state is
+ *  truncated, is missing a chunk, has a chunk twice or with the wrong size, has another version or
+ *  was saved with another ROM.
+ *  It is fast enough to be called every frame.
+ */
+int emulator_load_state(Emulator *emulator, const uint8_t *buffer, size_t size);
+
+#ifndef RISC_V
+/**
+ *  Saves the state of `emulator` to the file at `path`.
+ *
+ *  Returns 0 on success, -1 if the file couldn't be written.
+ */
+int emulator_save_state_file(const Emulator *emulator, const char *path);
+
+/**
+ *  Loads the state in the file at `path` into `emulator`.
+ *
+ *  Returns 0 on success, -1 if the file couldn't be read or the state couldn't be loaded.
+ */
+int emulator_load_state_file(Emulator *emulator, const char *path);
+#endif
+
+// --------------- CHUNK SERIALIZATION ------------------------ //
+void state_write_8(StateWriter *writer, uint8_t value);
+void state_write_16(StateWriter *writer, uint16_t value);
+void state_write_32(StateWriter *writer, uint32_t value);
+void state_write_size(StateWriter *writer, size_t value); // always 64 bits, so that states are portable
+void state_write_bytes(StateWriter *writer, const void *data, size_t size);
+
+uint8_t state_read_8(StateReader *reader);
+uint16_t state_read_16(StateReader *reader);
+uint32_t state_read_32(StateReader *reader);
+size_t state_read_size(StateReader *reader);
+void state_read_bytes(StateReader *reader, void *data, size_t size);
+
+#endif
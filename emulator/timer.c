@@ -24,33 +24,24 @@ void sleep_us(uint32_t microseconds) {
 
 #else
 
-#include <SDL.h>
+// A monotonic clock with microsecond resolution. Only needs POSIX, so that builds without SDL can use it too.
 
-uint32_t get_time_point() { return (uint32_t)SDL_GetPerformanceCounter(); }
+uint32_t get_time_point() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
 
 uint32_t get_elapsed_us(uint32_t time_point_start, uint32_t time_point_end) {
-    double elapsed = time_point_end - time_point_start;
-    double frequency = SDL_GetPerformanceFrequency();
-    double elapsed_microseconds = (elapsed / frequency) * 1e6;
-    return (uint32_t)elapsed_microseconds;
+    return time_point_end - time_point_start; // wraps around correctly
 }
 
 void sleep_us(uint32_t microseconds) {
-    if (microseconds >= 1000) {
-        uint32_t milliseconds = microseconds / 1000;
-        SDL_Delay(milliseconds);
-        microseconds %= 1000;
-    }
-
-    if (microseconds > 0) {
-        uint64_t start = SDL_GetPerformanceCounter();
-        uint64_t frequency = SDL_GetPerformanceFrequency();
-        uint64_t ticks = (microseconds * frequency) / 1e6;
-
-        while ((SDL_GetPerformanceCounter() - start) < ticks) {
-            SDL_Delay(0);
-        }
-    }
+    struct timespec duration = {
+        .tv_sec = microseconds / 1000000,
+        .tv_nsec = (microseconds % 1000000) * 1000,
+    };
+    nanosleep(&duration, NULL);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,280 @@
+/*
+ * Runs many emulators at once, spread over all cores, and reports the aggregate speed.
+ *
+ * Usage: batchrunner [--threads <count>] [--frames <count>] [--jobs-file <path>] [<rom>...]
+ *
+ * Every job is one ROM run for a number of frames on an emulator of its own. The jobs come from the command
+ * line (all run for `--frames` frames, 600 by default) and from a jobs file with one `<rom> [<frames> [<movie>]]`
+ * per line. A job with a movie plays its input (see movie.h), 0 frames plays the whole movie. Each job prints the
+ * hash of its last frame, so runs can be compared with earlier ones.
+ *
+ * The jobs are dealt out to the threads up front. A thread works through its own queue from the back, and
+ * when that is empty it steals from the front of the queues of the others, so a few slow ROMs don't leave
+ * the other cores idle at the end. ROMs have to be supported by the emulator, it exits on unknown mappers.
+ */
+#include "emulator.h"
+#include "timer.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define DEFAULT_FRAMES 600
+#define MAX_THREADS 256
+#define MAX_PATH_LENGTH 4096
+
+typedef struct Job {
+    char *rom_path;
+    char *movie_path; // NULL without input
+    uint32_t frame_count;
+
+    // Results
+    int failed;
+    uint32_t frame_hash;
+    uint32_t elapsed_us;
+} Job;
+
+// Job indices of one thread. The owner takes from the back, thieves from the front.
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    size_t *jobs;
+    size_t front;
+    size_t back;
+} WorkQueue;
+
+typedef struct Worker {
+    pthread_t thread;
+    size_t index;
+    uint32_t jobs_run;
+    uint32_t jobs_stolen;
+} Worker;
+
+typedef struct Batch {
+    Job *jobs;
+    size_t job_count;
+    WorkQueue queues[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+    size_t thread_count;
+} Batch;
+
+static Batch batch;
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void add_job(const char *rom_path, uint32_t frame_count, const char *movie_path);
+static void read_jobs_file(const char *path, uint32_t default_frames);
+static void *run_worker(void *argument);
+static int take_job(WorkQueue *queue, int from_back, size_t *job);
+static void run_job(Job *job);
+
+int main(int argc, char *argv[]) {
+    size_t thread_count = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t frame_count = DEFAULT_FRAMES;
+
+    // The options apply to the ROMs after them
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_count = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jobs-file") == 0 && i + 1 < argc) {
+            read_jobs_file(argv[++i], frame_count);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            printf("Fatal Error: Unknown option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        } else {
+            add_job(argv[i], frame_count, NULL);
+        }
+    }
+    if (batch.job_count == 0) {
+        printf("Usage: %s [--threads <count>] [--frames <count>] [--jobs-file <path>] [<rom>...]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (thread_count < 1)
+        thread_count = 1;
+    if (thread_count > MAX_THREADS)
+        thread_count = MAX_THREADS;
+    if (thread_count > batch.job_count)
+        thread_count = batch.job_count;
+    batch.thread_count = thread_count;
+
+    // Deal the jobs out round-robin
+    for (size_t i = 0; i < thread_count; i++) {
+        WorkQueue *queue = &batch.queues[i];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->jobs = malloc(batch.job_count * sizeof(size_t));
+        queue->front = queue->back = 0;
+    }
+    for (size_t job = 0; job < batch.job_count; job++) {
+        WorkQueue *queue = &batch.queues[job % thread_count];
+        queue->jobs[queue->back++] = job;
+    }
+
+    uint32_t time_point_start = get_time_point();
+    for (size_t i = 0; i < thread_count; i++) {
+        batch.workers[i].index = i;
+        if (pthread_create(&batch.workers[i].thread, NULL, run_worker, &batch.workers[i]) != 0) {
+            printf("Fatal Error: Failed to start thread %zu\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        pthread_join(batch.workers[i].thread, NULL);
+    }
+    double seconds = get_elapsed_us(time_point_start, get_time_point()) / 1e6;
+
+    uint64_t total_frames = 0;
+    int failed_jobs = 0;
+    for (size_t i = 0; i < batch.job_count; i++) {
+        Job *job = &batch.jobs[i];
+        if (job->failed) {
+            printf("--------  %6u frames  failed              %s\n", job->frame_count, job->rom_path);
+            failed_jobs++;
+            continue;
+        }
+        printf("%08X  %6u frames  %8.1f FPS  %s\n", job->frame_hash, job->frame_count,
+               job->frame_count / (job->elapsed_us / 1e6), job->rom_path);
+        total_frames += job->frame_count;
+    }
+
+    uint32_t jobs_stolen = 0;
+    for (size_t i = 0; i < thread_count; i++) {
+        jobs_stolen += batch.workers[i].jobs_stolen;
+    }
+    printf("\n");
+    printf("Jobs:                        %zu (%i failed, %u stolen)\n", batch.job_count, failed_jobs, jobs_stolen);
+    printf("Threads:                     %zu\n", thread_count);
+    printf("Frames:                      %llu\n", (unsigned long long)total_frames);
+    printf("Wall time:                   %.3f s\n", seconds);
+    printf("Aggregate frames per second: %.1f\n", total_frames / seconds);
+
+    return failed_jobs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+static void add_job(const char *rom_path, uint32_t frame_count, const char *movie_path) {
+    static size_t capacity = 0;
+    if (batch.job_count == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        batch.jobs = realloc(batch.jobs, capacity * sizeof(Job));
+        if (batch.jobs == NULL) {
+            printf("Fatal Error: Failed to allocate the job list\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    Job job = {.rom_path = strdup(rom_path), .frame_count = frame_count};
+    job.movie_path = movie_path ? strdup(movie_path) : NULL;
+    batch.jobs[batch.job_count++] = job;
+}
+
+static void read_jobs_file(const char *path, uint32_t default_frames) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("Fatal Error: Failed to open file %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    char line[2 * MAX_PATH_LENGTH + 32];
+    while (fgets(line, sizeof(line), fp)) {
+        char rom_path[MAX_PATH_LENGTH];
+        char movie_path[MAX_PATH_LENGTH];
+        unsigned frame_count = default_frames;
+        int fields = line[0] == '#' ? 0 : sscanf(line, "%4095s %u %4095s", rom_path, &frame_count, movie_path);
+        if (fields < 1)
+            continue; // comment or empty line
+        add_job(rom_path, frame_count, fields == 3 ? movie_path : NULL);
+    }
+    fclose(fp);
+}
+
+static void *run_worker(void *argument) {
+    Worker *worker = argument;
+    size_t job;
+
+    while (1) {
+        if (take_job(&batch.queues[worker->index], TRUE, &job)) {
+            run_job(&batch.jobs[job]);
+            worker->jobs_run++;
+            continue;
+        }
+
+        // No jobs are added while running, so once every queue is empty the batch is done
+        int stole = FALSE;
+        for (size_t i = 1; i < batch.thread_count && !stole; i++) {
+            WorkQueue *victim = &batch.queues[(worker->index + i) % batch.thread_count];
+            stole = take_job(victim, FALSE, &job);
+        }
+        if (!stole)
+            return NULL;
+
+        run_job(&batch.jobs[job]);
+        worker->jobs_run++;
+        worker->jobs_stolen++;
+    }
+}
+
+static int take_job(WorkQueue *queue, int from_back, size_t *job) {
+    pthread_mutex_lock(&queue->lock);
+    int found = queue->front < queue->back;
+    if (found) {
+        *job = from_back ? queue->jobs[--queue->back] : queue->jobs[queue->front++];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void run_job(Job *job) {
+    FILE *fp = fopen(job->rom_path, "rb");
+    if (fp == NULL) {
+        printf("Error: Failed to open file %s\n", job->rom_path);
+        job->failed = TRUE;
+        return;
+    }
+    fseek(fp, 0, SEEK_END);
+    size_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *rom = malloc(size);
+    Emulator *emulator = malloc(sizeof(Emulator));
+    if (rom == NULL || emulator == NULL || fread(rom, 1, size, fp) != size) {
+        printf("Error: Failed to read file %s\n", job->rom_path);
+        job->failed = TRUE;
+        fclose(fp);
+        free(rom);
+        free(emulator);
+        return;
+    }
+    fclose(fp);
+
+    emulator_init(emulator, rom);
+
+    Movie movie;
+    MoviePlayer player;
+    if (job->movie_path) {
+        // movie_load cleans up after itself when it fails, a movie of another ROM has to be freed here
+        int loaded = movie_load(&movie, job->movie_path) == 0;
+        if (!loaded || movie.rom_checksum != emulator->rom_checksum) {
+            printf("Error: Movie %s doesn't belong to %s\n", job->movie_path, job->rom_path);
+            if (loaded)
+                movie_free(&movie);
+            job->failed = TRUE;
+            free(emulator);
+            free(rom);
+            return;
+        }
+        movie_player_init(&player, &movie);
+        emulator->input = &player.source;
+        if (job->frame_count == 0)
+            job->frame_count = movie.frame_count;
+    }
+
+    uint32_t time_point_start = get_time_point();
+    for (uint32_t frame = 0; frame < job->frame_count; frame++) {
+        emulator_run_frame(emulator);
+    }
+    job->elapsed_us = get_elapsed_us(time_point_start, get_time_point()) + 1; // never 0 for the FPS
+    job->frame_hash = emulator_frame_hash(emulator);
+
+    if (job->movie_path)
+        movie_free(&movie);
+    free(emulator);
+    free(rom);
+}
@@ -0,0 +1,336 @@
+/*
+ * Generates the synthetic MMC3 test ROMs in tests/mmc3, which ppu_renderer_diff runs on both PPU renderers.
+ *
+ * Usage: mmc3gen <output directory>
+ *
+ * All ROMs run the same program and differ in the pattern table layout (PPUCTRL), so that A12 rises at the
+ * background fetches, at the sprite fetches, or per sprite with 8x16 sprites:
+ *
+ *   mmc3_bg1000.nes      background at 0x1000, 8x8 sprites at 0x0000 (the counter is clocked at dot 325)
+ *   mmc3_spr1000.nes     background at 0x0000, 8x8 sprites at 0x1000 (the counter is clocked at dot 261)
+ *   mmc3_8x16.nes        background at 0x0000, 8x16 sprites from both tables, CHR inversion on
+ *
+ * Every frame the NMI handler copies 64 moving sprites to OAM, resets the scroll and the CHR banks, and sets
+ * the IRQ latch to 8 - 23 scanlines. The IRQ handler switches the background and the sprite CHR bank and changes
+ * the horizontal scroll, so an IRQ on another scanline or dot shows up in the frame hash, and in the CPU cycle
+ * count at the end of the frame. The program is assembled by hand below, the ROMs are checked in.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PRG_SIZE 0x8000 // 2 x 16 KB, four 8 KB banks, the program is in the last one at 0xE000
+#define CHR_SIZE 0x4000 // 2 x 8 KB, sixteen 1 KB banks
+#define PRG_ORIGIN 0x8000
+
+// Data in the fixed bank
+#define OAM_TABLE 0xF000
+#define PALETTE_TABLE 0xF100
+#define BANK_TABLE 0xF120
+
+// Zero page
+#define FRAME_COUNT 0x00
+#define IRQ_COUNT 0x01
+#define LOOP_COUNT 0x02
+#define BG_BANK 0x03
+#define SPRITE_BANK 0x04
+
+typedef struct Layout {
+    const char *file_name;
+    uint8_t ppu_ctrl;    // with NMI on
+    uint8_t bank_select; // 0x80 for CHR inversion
+    uint8_t bg_bank;     // register of a 1 KB or 2 KB bank in the background pattern table
+    uint8_t sprite_bank; // and in the sprite pattern table
+} Layout;
+
+// Without inversion R0 - R1 are at 0x0000 (2 KB banks) and R2 - R5 at 0x1000 (1 KB banks)
+static const Layout layouts[] = {
+    {"mmc3_bg1000.nes", 0x90, 0x00, 2, 0},
+    {"mmc3_spr1000.nes", 0x88, 0x00, 0, 2},
+    {"mmc3_8x16.nes", 0xA0, 0x80, 2, 0},
+};
+
+static uint8_t prg[PRG_SIZE];
+static uint8_t chr[CHR_SIZE];
+static size_t pc; // CPU address of the next byte
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static void emit(uint8_t value);
+static void op_imm(uint8_t opcode, uint8_t value);
+static void op_abs(uint8_t opcode, uint16_t address);
+static void branch(uint8_t opcode, size_t target);
+static void assemble(const Layout *layout);
+static void fill_chr();
+static int write_rom(const char *directory, const char *file_name);
+
+// 6502 opcodes used by the program
+#define PHA 0x48
+#define PLA 0x68
+#define TXA 0x8A
+#define TAX 0xAA
+#define INX 0xE8
+#define TXS 0x9A
+#define SEI 0x78
+#define CLI 0x58
+#define CLD 0xD8
+#define CLC 0x18
+#define ASL 0x0A
+#define RTI 0x40
+#define LDA_IMM 0xA9
+#define LDX_IMM 0xA2
+#define LDY_IMM 0xA0
+#define ORA_IMM 0x09
+#define AND_IMM 0x29
+#define ADC_IMM 0x69
+#define CPX_IMM 0xE0
+#define LDA_ZP 0xA5
+#define STA_ZP 0x85
+#define INC_ZP 0xE6
+#define LDA_ABS 0xAD
+#define STA_ABS 0x8D
+#define STX_ABS 0x8E
+#define BIT_ABS 0x2C
+#define JMP_ABS 0x4C
+#define LDA_ABS_X 0xBD
+#define STA_ABS_X 0x9D
+#define INC_ABS_X 0xFE
+#define DEY 0x88
+#define BPL 0x10
+#define BNE 0xD0
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Usage: %s <output directory>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fill_chr();
+    for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        assemble(&layouts[i]);
+        if (write_rom(argv[1], layouts[i].file_name) != 0)
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+static void emit(uint8_t value) { prg[pc++ - PRG_ORIGIN] = value; }
+
+static void op_imm(uint8_t opcode, uint8_t value) {
+    emit(opcode);
+    emit(value);
+}
+
+static void op_abs(uint8_t opcode, uint16_t address) {
+    emit(opcode);
+    emit(address & 0xFF);
+    emit(address >> 8);
+}
+
+// Only backwards, the loops are the only branches
+static void branch(uint8_t opcode, size_t target) { op_imm(opcode, (uint8_t)(target - (pc + 2))); }
+
+static void assemble(const Layout *layout) {
+    memset(prg, 0xFF, sizeof(prg));
+    uint8_t bank_select = layout->bank_select;
+
+    // Reset: wait for the PPU, map the banks, fill palette, nametables and OAM, then start rendering
+    const uint16_t reset = pc = 0xE000;
+    emit(SEI);
+    emit(CLD);
+    op_imm(LDX_IMM, 0xFF);
+    emit(TXS);
+    emit(INX);
+    op_abs(STX_ABS, 0x2000);
+    op_abs(STX_ABS, 0x2001);
+    op_abs(STX_ABS, 0xE000); // IRQ off
+    op_imm(LDA_IMM, 0x40);
+    op_abs(STA_ABS, 0x4017); // and the frame IRQ of the APU, only the mapper raises IRQs
+    for (int i = 0; i < 2; i++) {
+        size_t wait_vblank = pc;
+        op_abs(BIT_ABS, 0x2002);
+        branch(BPL, wait_vblank);
+    }
+
+    op_imm(LDX_IMM, 0x00);
+    size_t map_banks = pc;
+    emit(TXA);
+    op_imm(ORA_IMM, bank_select);
+    op_abs(STA_ABS, 0x8000);
+    op_abs(LDA_ABS_X, BANK_TABLE);
+    op_abs(STA_ABS, 0x8001);
+    emit(INX);
+    op_imm(CPX_IMM, 8);
+    branch(BNE, map_banks);
+    op_imm(LDA_IMM, 0x00);
+    op_abs(STA_ABS, 0xA000); // vertical mirroring
+
+    op_imm(LDA_IMM, 0x3F);
+    op_abs(STA_ABS, 0x2006);
+    op_imm(LDA_IMM, 0x00);
+    op_abs(STA_ABS, 0x2006);
+    op_imm(LDX_IMM, 0x00);
+    size_t fill_palette = pc;
+    op_abs(LDA_ABS_X, PALETTE_TABLE);
+    op_abs(STA_ABS, 0x2007);
+    emit(INX);
+    op_imm(CPX_IMM, 0x20);
+    branch(BNE, fill_palette);
+
+    // Both nametables with tiles 0x00 - 0xFF, the attribute tables get the last 64 of them
+    op_imm(LDA_IMM, 0x20);
+    op_abs(STA_ABS, 0x2006);
+    op_imm(LDA_IMM, 0x00);
+    op_abs(STA_ABS, 0x2006);
+    op_imm(LDY_IMM, 8);
+    op_imm(LDX_IMM, 0x00);
+    size_t fill_nametables = pc;
+    op_abs(STX_ABS, 0x2007);
+    emit(INX);
+    branch(BNE, fill_nametables);
+    emit(DEY);
+    branch(BNE, fill_nametables);
+
+    size_t copy_oam = pc;
+    op_abs(LDA_ABS_X, OAM_TABLE);
+    op_abs(STA_ABS_X, 0x0200);
+    emit(INX);
+    branch(BNE, copy_oam);
+
+    op_imm(LDA_IMM, 0x00);
+    op_abs(STA_ABS, 0x2005);
+    op_abs(STA_ABS, 0x2005);
+    op_imm(LDA_IMM, layout->ppu_ctrl);
+    op_abs(STA_ABS, 0x2000);
+    op_imm(LDA_IMM, 0x1E);
+    op_abs(STA_ABS, 0x2001);
+    emit(CLI);
+    size_t main_loop = pc;
+    op_imm(INC_ZP, LOOP_COUNT);
+    op_abs(JMP_ABS, (uint16_t)main_loop);
+
+    // NMI: OAM DMA, scroll and banks back to the top of the frame, a new IRQ latch, move the sprites
+    const uint16_t nmi = pc;
+    emit(PHA);
+    emit(TXA);
+    emit(PHA);
+    op_imm(LDA_IMM, 0x02);
+    op_abs(STA_ABS, 0x4014);
+    op_imm(LDA_IMM, 0x00);
+    op_abs(STA_ABS, 0x2005);
+    op_abs(STA_ABS, 0x2005);
+    op_imm(LDA_IMM, layout->ppu_ctrl);
+    op_abs(STA_ABS, 0x2000);
+    op_imm(LDA_IMM, bank_select | layout->bg_bank);
+    op_abs(STA_ABS, 0x8000);
+    op_abs(LDA_ABS, BANK_TABLE + layout->bg_bank);
+    op_imm(STA_ZP, BG_BANK);
+    op_abs(STA_ABS, 0x8001);
+    op_imm(LDA_IMM, bank_select | layout->sprite_bank);
+    op_abs(STA_ABS, 0x8000);
+    op_abs(LDA_ABS, BANK_TABLE + layout->sprite_bank);
+    op_imm(STA_ZP, SPRITE_BANK);
+    op_abs(STA_ABS, 0x8001);
+    op_imm(LDA_ZP, FRAME_COUNT);
+    op_imm(AND_IMM, 0x0F);
+    emit(CLC);
+    op_imm(ADC_IMM, 8);
+    op_abs(STA_ABS, 0xC000); // latch
+    op_abs(STA_ABS, 0xC001); // reload
+    op_abs(STA_ABS, 0xE001); // IRQ on
+    op_imm(INC_ZP, FRAME_COUNT);
+    op_imm(LDX_IMM, 0x00);
+    size_t move_sprites = pc;
+    op_abs(INC_ABS_X, 0x0200); // y
+    op_abs(INC_ABS_X, 0x0203); // x
+    for (int i = 0; i < 4; i++)
+        emit(INX);
+    branch(BNE, move_sprites);
+    emit(PLA);
+    emit(TAX);
+    emit(PLA);
+    emit(RTI);
+
+    // IRQ: acknowledge, switch a background and a sprite bank, scroll by 8 pixels more than the last split
+    const uint16_t irq = pc;
+    emit(PHA);
+    op_abs(STA_ABS, 0xE000); // acknowledge
+    op_abs(STA_ABS, 0xE001);
+    op_imm(LDA_IMM, bank_select | layout->bg_bank);
+    op_abs(STA_ABS, 0x8000);
+    op_imm(INC_ZP, BG_BANK);
+    op_imm(INC_ZP, BG_BANK); // by 2, the 2 KB banks ignore the lowest bit
+    op_imm(LDA_ZP, BG_BANK);
+    op_abs(STA_ABS, 0x8001);
+    op_imm(LDA_IMM, bank_select | layout->sprite_bank);
+    op_abs(STA_ABS, 0x8000);
+    op_imm(INC_ZP, SPRITE_BANK);
+    op_imm(INC_ZP, SPRITE_BANK);
+    op_imm(LDA_ZP, SPRITE_BANK);
+    op_abs(STA_ABS, 0x8001);
+    op_imm(INC_ZP, IRQ_COUNT);
+    op_imm(LDA_ZP, IRQ_COUNT);
+    emit(ASL);
+    emit(ASL);
+    emit(ASL);
+    op_abs(STA_ABS, 0x2005);
+    op_abs(STA_ABS, 0x2005);
+    emit(PLA);
+    emit(RTI);
+
+    // 64 sprites spread over the screen, with every tile number, palette, priority and flip
+    for (int i = 0; i < 64; i++) {
+        uint8_t *sprite = &prg[OAM_TABLE - PRG_ORIGIN + i * 4];
+        sprite[0] = (uint8_t)(i * 29 + 7);
+        sprite[1] = (uint8_t)(i * 37 + 1);
+        sprite[2] = (uint8_t)((i * 13) & 0xE3);
+        sprite[3] = (uint8_t)(i * 53 + 3);
+    }
+    static const uint8_t palette[0x20] = {
+        0x0F, 0x01, 0x11, 0x21, 0x0F, 0x06, 0x16, 0x26, 0x0F, 0x09, 0x19, 0x29, 0x0F, 0x04, 0x14, 0x24,
+        0x0F, 0x02, 0x12, 0x22, 0x0F, 0x07, 0x17, 0x27, 0x0F, 0x0A, 0x1A, 0x2A, 0x0F, 0x05, 0x15, 0x25,
+    };
+    memcpy(&prg[PALETTE_TABLE - PRG_ORIGIN], palette, sizeof(palette));
+    // R0 - R5 (CHR, in 1 KB units), R6 - R7 (PRG)
+    static const uint8_t banks[8] = {0, 2, 4, 5, 6, 7, 0, 1};
+    memcpy(&prg[BANK_TABLE - PRG_ORIGIN], banks, sizeof(banks));
+
+    uint16_t vectors[3] = {nmi, reset, irq};
+    for (int i = 0; i < 3; i++) {
+        prg[0xFFFA - PRG_ORIGIN + i * 2] = vectors[i] & 0xFF;
+        prg[0xFFFB - PRG_ORIGIN + i * 2] = vectors[i] >> 8;
+    }
+}
+
+// Tiles that differ in every 1 KB bank, with transparent and opaque pixels in all of them
+static void fill_chr() {
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < CHR_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        chr[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static int write_rom(const char *directory, const char *file_name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, file_name);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Error: Failed to open %s\n", path);
+        return -1;
+    }
+
+    // iNES header: 2 x 16 KB PRG-ROM, 2 x 8 KB CHR-ROM, mapper 4
+    const uint8_t header[16] = {'N', 'E', 'S', 0x1A, PRG_SIZE / 0x4000, CHR_SIZE / 0x2000, 0x40};
+    int failed = fwrite(header, sizeof(header), 1, file) != 1 || fwrite(prg, sizeof(prg), 1, file) != 1 ||
+                 fwrite(chr, sizeof(chr), 1, file) != 1;
+    fclose(file);
+    if (failed) {
+        printf("Error: Failed to write %s\n", path);
+        return -1;
+    }
+    printf("Wrote %s\n", path);
+    return 0;
+}
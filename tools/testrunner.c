@@ -0,0 +1,289 @@
+/*
+ * Runs test ROMs headless and reports whether they passed.
+ *
+ * Usage: testrunner [--jobs <count>] [--timeout <seconds>] <rom>...
+ *
+ * Every ROM runs uncapped in a child process of its own, up to `--jobs` at a time (all cores by default),
+ * so a ROM that crashes the emulator or hangs it only fails itself. The result is read from memory:
+ *
+ * - Newer blargg ROMs write $DE $B0 $61 to $6001 - $6003, their status to $6000 ($80 while running, $81 when
+ *   they need a reset, the result code when done, 0 means passed) and their text to $6004.
+ * - Older blargg ROMs (tests/ppu, tests/vbl) only print their result to the screen, so the text of the first
+ *   nametable is read instead. Once it shows a result ("PASSED", "FAILED" or a "$xx" code, where $01 means
+ *   passed) and stays the same for a second, the ROM is done.
+ *
+ * `--timeout` is in emulated seconds (60 seconds by default). The same number of wall clock seconds is the
+ * hard limit of a child, in case the emulator itself hangs.
+ */
+#include "emulator.h"
+#include "timer.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEFAULT_TIMEOUT 60 // emulated seconds
+#define MAX_JOBS 64
+#define MESSAGE_SIZE 1024
+
+#define STATUS_RUNNING 0x80
+#define STATUS_NEEDS_RESET 0x81
+#define SCREEN_CHECK_INTERVAL 60 // frames the screen text has to stay the same
+#define RESULT_EXIT_CODE 16       // the child exits with this plus its Result, the emulator itself exits with 1
+
+typedef enum Result {
+    RESULT_PASSED,
+    RESULT_FAILED,
+    RESULT_ERROR, // timed out, needed a reset or the emulator gave up
+} Result;
+
+typedef struct Job {
+    pid_t pid;
+    int pipe_fd; // stdout of the child
+    const char *rom_path;
+} Job;
+
+// --------------- STATIC FORWARD DECLARATIONS ---------------- //
+static Result run_rom(const char *rom_path, uint32_t max_frames);
+static int has_status_signature(const MEM *mem);
+static void read_status_text(const MEM *mem, char *text, size_t size);
+static void read_screen_text(const PPU *ppu, char *text, size_t size);
+static int screen_result(const char *text);
+static Job start_job(const char *rom_path, uint32_t timeout);
+static Result finish_job(const Job *job, int wait_status, char *message, size_t size);
+
+int main(int argc, char *argv[]) {
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t timeout = DEFAULT_TIMEOUT;
+
+    int first_rom = 1;
+    for (; first_rom + 1 < argc && strncmp(argv[first_rom], "--", 2) == 0; first_rom += 2) {
+        if (strcmp(argv[first_rom], "--jobs") == 0) {
+            jobs = atoi(argv[first_rom + 1]);
+        } else if (strcmp(argv[first_rom], "--timeout") == 0) {
+            timeout = (uint32_t)atoi(argv[first_rom + 1]);
+        } else {
+            printf("Fatal Error: Unknown option %s\n", argv[first_rom]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (first_rom >= argc || timeout == 0) {
+        printf("Usage: %s [--jobs <count>] [--timeout <seconds>] <rom>...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (jobs < 1)
+        jobs = 1;
+    if (jobs > MAX_JOBS)
+        jobs = MAX_JOBS;
+
+    Job running[MAX_JOBS];
+    int running_count = 0;
+    int next_rom = first_rom;
+    int results[3] = {0};
+    uint32_t time_point_start = get_time_point();
+
+    while (next_rom < argc || running_count > 0) {
+        if (next_rom < argc && running_count < jobs) {
+            running[running_count++] = start_job(argv[next_rom++], timeout);
+            continue;
+        }
+
+        int wait_status;
+        pid_t pid = wait(&wait_status);
+        for (int i = 0; i < running_count; i++) {
+            if (running[i].pid != pid)
+                continue;
+
+            char message[MESSAGE_SIZE];
+            Result result = finish_job(&running[i], wait_status, message, sizeof(message));
+            static const char *result_names[] = {"PASS ", "FAIL ", "ERROR"};
+            printf("%s %s\n%s", result_names[result], running[i].rom_path, message);
+            results[result]++;
+
+            running[i] = running[--running_count];
+            break;
+        }
+    }
+
+    double seconds = get_elapsed_us(time_point_start, get_time_point()) / 1e6;
+    printf("\n%i passed, %i failed, %i errors in %.2f s\n", results[RESULT_PASSED], results[RESULT_FAILED],
+           results[RESULT_ERROR], seconds);
+    return results[RESULT_PASSED] == argc - first_rom ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// --------------- STATIC FUNCTIONS --------------------------- //
+
+// Runs in the child. Everything printed ends up in the report of the ROM, the result is the exit code.
+static Result run_rom(const char *rom_path, uint32_t max_frames) {
+    FILE *fp = fopen(rom_path, "rb");
+    if (fp == NULL) {
+        printf("Error: Failed to open file %s\n", rom_path);
+        return RESULT_ERROR;
+    }
+    fseek(fp, 0, SEEK_END);
+    size_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *rom = malloc(size);
+    if (rom == NULL || fread(rom, 1, size, fp) != size) {
+        printf("Error: Failed to read file %s\n", rom_path);
+        return RESULT_ERROR;
+    }
+    fclose(fp);
+
+    static Emulator emulator;
+    emulator_init(&emulator, rom);
+    emulator.controller_input = 0;
+
+    char text[MESSAGE_SIZE];
+    char previous_text[MESSAGE_SIZE] = "";
+    for (uint32_t frame = 1; frame <= max_frames; frame++) {
+        emulator_run_frame(&emulator);
+
+        if (has_status_signature(&emulator.mem)) {
+            uint8_t status = mem_const_read_8(&emulator.mem, 0x6000);
+            if (status == STATUS_RUNNING)
+                continue;
+
+            read_status_text(&emulator.mem, text, sizeof(text));
+            if (status == STATUS_NEEDS_RESET) {
+                printf("%s\nError: The ROM needs a reset, which isn't emulated\n", text);
+                return RESULT_ERROR;
+            }
+            printf("%s\nResult code %i after %u frames\n", text, status, frame);
+            return status == 0 ? RESULT_PASSED : RESULT_FAILED;
+        }
+
+        if (frame % SCREEN_CHECK_INTERVAL != 0)
+            continue;
+        read_screen_text(&emulator.ppu, text, sizeof(text));
+        int result = screen_result(text);
+        if (result >= 0 && strcmp(text, previous_text) == 0) {
+            printf("%s\nScreen result after %u frames\n", text, frame);
+            return result;
+        }
+        strcpy(previous_text, text);
+    }
+
+    read_screen_text(&emulator.ppu, text, sizeof(text));
+    printf("%s\nError: No result after %u frames\n", text, max_frames);
+    return RESULT_ERROR;
+}
+
+static int has_status_signature(const MEM *mem) {
+    return mem_const_read_8(mem, 0x6001) == 0xDE && mem_const_read_8(mem, 0x6002) == 0xB0 &&
+           mem_const_read_8(mem, 0x6003) == 0x61;
+}
+
+// The text at $6004 is zero terminated, every line of it except empty ones is indented
+static void read_status_text(const MEM *mem, char *text, size_t size) {
+    size_t length = 0;
+    int line_start = TRUE;
+    for (uint16_t address = 0x6004; address < PRG_RAM_END && length + 3 < size; address++) {
+        char c = (char)mem_const_read_8(mem, address);
+        if (c == '\0')
+            break;
+        if (line_start && c != '\n') {
+            text[length++] = ' ';
+            text[length++] = ' ';
+        }
+        text[length++] = c;
+        line_start = c == '\n';
+    }
+    // Drop the trailing newline, the caller ends the line
+    while (length > 0 && (text[length - 1] == '\n' || text[length - 1] == ' ')) {
+        length--;
+    }
+    text[length] = '\0';
+}
+
+// The test ROMs use the ASCII code as the tile index. Only the lines that contain text are kept.
+static void read_screen_text(const PPU *ppu, char *text, size_t size) {
+    size_t length = 0;
+    for (int y = 0; y < NAMETABLE_HEIGHT; y++) {
+        char line[NAMETABLE_WIDTH + 1];
+        int line_length = 0;
+        for (int x = 0; x < NAMETABLE_WIDTH; x++) {
+            uint8_t tile = ppu_const_read_vram_data(ppu, 0x2000 + y * NAMETABLE_WIDTH + x);
+            line[x] = tile >= 0x20 && tile < 0x7F ? (char)tile : ' ';
+            if (line[x] != ' ')
+                line_length = x + 1;
+        }
+        if (line_length == 0 || length + line_length + 4 >= size)
+            continue;
+
+        line[line_length] = '\0';
+        length += snprintf(text + length, size - length, "%s  %s", length ? "\n" : "", line);
+    }
+    text[length] = '\0';
+}
+
+// Returns the result shown on the screen, or -1 if there is none yet
+static int screen_result(const char *text) {
+    if (strstr(text, "PASSED"))
+        return RESULT_PASSED;
+    if (strstr(text, "FAILED"))
+        return RESULT_FAILED;
+
+    const char *code = strchr(text, '$');
+    if (code && code[1] && code[2]) {
+        return strncmp(code, "$01", 3) == 0 ? RESULT_PASSED : RESULT_FAILED;
+    }
+    return -1;
+}
+
+static Job start_job(const char *rom_path, uint32_t timeout) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        printf("Fatal Error: Failed to create a pipe\n");
+        exit(EXIT_FAILURE);
+    }
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("Fatal Error: Failed to start a process for %s\n", rom_path);
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        alarm(timeout); // The emulated timeout can't end a hang inside the emulator
+        Result result = run_rom(rom_path, timeout * NTSC_FRAME_RATE);
+        fflush(stdout);
+        _exit(RESULT_EXIT_CODE + result);
+    }
+
+    close(fds[1]);
+    Job job = {.pid = pid, .pipe_fd = fds[0], .rom_path = rom_path};
+    return job;
+}
+
+// Reads what the child printed. Reading after it exited is fine, the pipe keeps far more than a report.
+static Result finish_job(const Job *job, int wait_status, char *message, size_t size) {
+    size_t length = 0;
+    ssize_t count;
+    while (length + 1 < size && (count = read(job->pipe_fd, message + length, size - 1 - length)) > 0) {
+        length += count;
+    }
+    message[length] = '\0';
+    close(job->pipe_fd);
+
+    if (WIFSIGNALED(wait_status)) {
+        int signal = WTERMSIG(wait_status);
+        snprintf(message + length, size - length, "Error: %s\n",
+                 signal == SIGALRM ? "Timed out" : "The emulator crashed");
+        return RESULT_ERROR;
+    }
+
+    if (length > 0 && message[length - 1] != '\n' && length + 1 < size) {
+        message[length++] = '\n';
+        message[length] = '\0';
+    }
+    int exit_code = WEXITSTATUS(wait_status);
+    if (exit_code < RESULT_EXIT_CODE || exit_code > RESULT_EXIT_CODE + RESULT_ERROR) {
+        snprintf(message + length, size - length, "Error: The emulator exited with code %i\n", exit_code);
+        return RESULT_ERROR;
+    }
+    return (Result)(exit_code - RESULT_EXIT_CODE);
+}